@@ -0,0 +1,127 @@
+#ifndef ARENA_ALLOCATOR
+#define ARENA_ALLOCATOR
+
+
+typedef struct Arena Arena;
+
+// every chunk starts with its size, allocations follow
+struct Arena {
+        char *ptr;
+        char *end;
+        char **chunks;
+        
+        size_t num_allocs;
+        size_t bytes_allocated;
+};
+
+enum {
+        ARENA_ALIGNMENT = 8,
+        ARENA_CHUNK_SIZE = 1024 * 1024
+};
+
+#define ALIGN_DOWN(n, a) ((n) & ~((a) - 1))
+#define ALIGN_UP(n, a) ALIGN_DOWN((n) + (a) - 1, (a))
+#define ALIGN_UP_PTR(p, a) ((void *) ALIGN_UP((uintptr_t) (p), (a)))
+
+#define arena__chunk_size(c) (*(size_t *) (c))
+#define arena__chunk_data(c) ((c) + sizeof(size_t))
+
+
+void arena_grow(Arena *arena, size_t min_size)
+{
+        size_t size = ALIGN_UP(min_size + sizeof(size_t), ARENA_ALIGNMENT);
+        char *chunk;
+        
+        if (size < ARENA_CHUNK_SIZE)
+                size = ARENA_CHUNK_SIZE;
+        chunk = malloc(size);
+        arena__chunk_size(chunk) = size;
+        arena->ptr = arena__chunk_data(chunk);
+        arena->end = chunk + size;
+        buf_push(arena->chunks, chunk);
+}
+
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+        void *ptr;
+        
+        if (size > (size_t) (arena->end - arena->ptr))
+                arena_grow(arena, size);
+        
+        ptr = arena->ptr;
+        arena->ptr = ALIGN_UP_PTR(arena->ptr + size, ARENA_ALIGNMENT);
+        assert(arena->ptr <= arena->end);
+        
+        arena->num_allocs++;
+        arena->bytes_allocated += size;
+        return ptr;
+}
+
+
+// total bytes of chunks owned by the arena
+size_t arena_reserved(Arena *arena)
+{
+        size_t size = 0;
+        
+        for (size_t i = 0; i < buf__len(arena->chunks); i++) {
+                size += arena__chunk_size(arena->chunks[i]);
+        }
+        return size;
+}
+
+
+// drop all allocations at once, the first chunk is kept for reuse
+void arena_reset(Arena *arena)
+{
+        char *first;
+        
+        if (arena->chunks == NULL)
+                return;
+        for (size_t i = 1; i < buf_len(arena->chunks); i++) {
+                free(arena->chunks[i]);
+        }
+        first = arena->chunks[0];
+        buf_len(arena->chunks) = 1;
+        arena->ptr = arena__chunk_data(first);
+        arena->end = first + arena__chunk_size(first);
+        arena->num_allocs = 0;
+        arena->bytes_allocated = 0;
+}
+
+
+void arena_free(Arena *arena)
+{
+        for (size_t i = 0; i < buf__len(arena->chunks); i++) {
+                free(arena->chunks[i]);
+        }
+        buf_free(arena->chunks);
+        memset(arena, 0, sizeof(Arena));
+}
+
+
+void arena_test()
+{
+        Arena arena = {0};
+        char *a, *b, *big;
+        
+        a = arena_alloc(&arena, 1);
+        b = arena_alloc(&arena, 3);
+        assert(b - a == ARENA_ALIGNMENT);
+        
+        big = arena_alloc(&arena, 3 * ARENA_CHUNK_SIZE);
+        memset(big, 0xff, 3 * ARENA_CHUNK_SIZE);
+        assert(buf_len(arena.chunks) == 2);
+        assert(arena.num_allocs == 3);
+        assert(arena.bytes_allocated == 4 + 3 * ARENA_CHUNK_SIZE);
+        assert(arena_reserved(&arena) > 4 * ARENA_CHUNK_SIZE);
+        
+        arena_reset(&arena);
+        assert(buf_len(arena.chunks) == 1);
+        assert(arena_alloc(&arena, 1) == a);
+        
+        arena_free(&arena);
+        assert(arena.chunks == NULL);
+}
+
+#endif
@@ -6,23 +6,56 @@ typedef struct Expr Expr;
 typedef struct Stmt Stmt;
 typedef struct Decl Decl;
 typedef struct Typespec Typespec;
+typedef struct Type Type; // see types.h
 
 typedef struct SwitchCase SwitchCase;
 typedef struct FuncDecl FuncDecl;
 typedef struct BoxDecl BoxDecl;
 
 
+// All nodes and their child lists live in ast_arena,
+// the whole tree is released at once with ast_free.
+// Each thread parses into its own arena.
+_Thread_local Arena ast_arena;
+
+
 void *ast_alloc(size_t size)
 {
         void *ptr;
         
         assert(size != 0);
-        ptr = malloc(size);
+        ptr = arena_alloc(&ast_arena, size);
         memset(ptr, 0, size);
         return ptr;
 }
 
 
+// move a stretchy buffer built by the parser into the arena
+void *ast_dup(void *buf, size_t elem_size)
+{
+        void *ptr = NULL;
+        size_t size;
+        
+        if (buf == NULL)
+                return NULL;
+        size = buf_len(buf) * elem_size;
+        if (size) {
+                ptr = arena_alloc(&ast_arena, size);
+                memcpy(ptr, buf, size);
+        }
+        buf_free(buf);
+        return ptr;
+}
+
+#define ast_dup_buf(b) ((b) = ast_dup((b), sizeof(*(b))))
+
+
+void ast_free(void)
+{
+        arena_free(&ast_arena);
+}
+
+
 enum ExprKind {
         EXPR_NONE,
         EXPR_NAME,
@@ -43,6 +76,15 @@ enum ExprKind {
 
 struct Expr {
         enum ExprKind kind;
+        SrcPos pos;
+        // filled in by the type checker, see check.h
+        Type *type;
+        char is_lvalue;
+        char is_const; // the value is in const_val or const_float
+        union {
+                int64_t const_val;
+                double const_float;
+        };
         union {
                 const char *name;
                 int64_t int_val;
@@ -93,77 +135,78 @@ struct Expr {
 };
 
 
-Expr *new_expr(enum ExprKind kind)
+Expr *new_expr(SrcPos pos, enum ExprKind kind)
 {
         Expr *e = ast_alloc(sizeof(Expr));
         e->kind = kind;
+        e->pos = pos;
         return e;
 }
 
 
-Expr *new_expr_name(const char *name)
+Expr *new_expr_name(SrcPos pos, const char *name)
 {
-        Expr *e = new_expr(EXPR_NAME);
+        Expr *e = new_expr(pos, EXPR_NAME);
         e->name = name;
         return e;
 }
 
 
-Expr *new_expr_int(int64_t int_val)
+Expr *new_expr_int(SrcPos pos, int64_t int_val)
 {
-        Expr *e = new_expr(EXPR_INT);
+        Expr *e = new_expr(pos, EXPR_INT);
         e->int_val = int_val;
         return e;
 }
 
 
-Expr *new_expr_float(double float_val)
+Expr *new_expr_float(SrcPos pos, double float_val)
 {
-        Expr *e = new_expr(EXPR_FLOAT);
+        Expr *e = new_expr(pos, EXPR_FLOAT);
         e->float_val = float_val;
         return e;
 }
 
 
-Expr *new_expr_str(const char *str_val)
+Expr *new_expr_str(SrcPos pos, const char *str_val)
 {
-        Expr *e = new_expr(EXPR_STR);
+        Expr *e = new_expr(pos, EXPR_STR);
         e->str_val = str_val;
         return e;
 }
 
 
-Expr *new_expr_cast(Typespec *type, Expr *expr)
+Expr *new_expr_cast(SrcPos pos, Typespec *type, Expr *expr)
 {
-        Expr *e = new_expr(EXPR_CAST);
+        Expr *e = new_expr(pos, EXPR_CAST);
         e->cast.type = type;
         e->cast.expr = expr;
         return e;
 }
 
 
-Expr *new_expr_call(Expr *expr, Expr **args, size_t num_args)
+Expr *new_expr_call(SrcPos pos, Expr *expr, Expr **args, size_t num_args)
 {
-        Expr *e = new_expr(EXPR_CALL);
+        Expr *e = new_expr(pos, EXPR_CALL);
         e->call.expr = expr;
-        e->call.args = args;
+        e->call.args = ast_dup(args, sizeof(Expr *));
         e->call.num_args = num_args;
         return e;
 }
 
 
-Expr *new_expr_index(Expr *oexpr, Expr *iexpr)
+Expr *new_expr_index(SrcPos pos, Expr *oexpr, Expr *iexpr)
 {
-        Expr *e = new_expr(EXPR_INDEX);
+        Expr *e = new_expr(pos, EXPR_INDEX);
         e->index.oexpr = oexpr;
         e->index.iexpr = iexpr;
         return e;
 }
 
 
-Expr *new_expr_field(Expr *expr, const char *name)
+Expr *new_expr_field(SrcPos pos, Expr *expr, const char *name)
 {
-        Expr *e = new_expr(EXPR_FIELD);
+        Expr *e = new_expr(pos, EXPR_FIELD);
         e->field.expr = expr;
         e->field.name = name;
         return e;
@@ -176,9 +219,9 @@ enum {
 };
 
 
-Expr *new_expr_unary(TokenKind op, Expr *expr)
+Expr *new_expr_unary(SrcPos pos, TokenKind op, Expr *expr)
 {
-        Expr *e = new_expr(EXPR_UNARY);
+        Expr *e = new_expr(pos, EXPR_UNARY);
         e->unary.op = op;
         e->unary.expr = expr;
         e->unary.is_postfix = PREFIX;
@@ -186,9 +229,9 @@ Expr *new_expr_unary(TokenKind op, Expr *expr)
 }
 
 
-Expr *new_expr_postfix(TokenKind op, Expr *expr)
+Expr *new_expr_postfix(SrcPos pos, TokenKind op, Expr *expr)
 {
-        Expr *e = new_expr(EXPR_UNARY);
+        Expr *e = new_expr(pos, EXPR_UNARY);
         e->unary.op = op;
         e->unary.expr = expr;
         e->unary.is_postfix = POSTFIX;
@@ -196,9 +239,9 @@ Expr *new_expr_postfix(TokenKind op, Expr *expr)
 }
 
 
-Expr *new_expr_binary(TokenKind op, Expr *left, Expr *right)
+Expr *new_expr_binary(SrcPos pos, TokenKind op, Expr *left, Expr *right)
 {
-        Expr *e = new_expr(EXPR_BINARY);
+        Expr *e = new_expr(pos, EXPR_BINARY);
         e->binary.op = op;
         e->binary.left = left;
         e->binary.right = right;
@@ -206,9 +249,9 @@ Expr *new_expr_binary(TokenKind op, Expr *left, Expr *right)
 }
 
 
-Expr *new_expr_ternary(Expr *cond, Expr *expr, Expr *or_expr)
+Expr *new_expr_ternary(SrcPos pos, Expr *cond, Expr *expr, Expr *or_expr)
 {
-        Expr *e = new_expr(EXPR_TERNARY);
+        Expr *e = new_expr(pos, EXPR_TERNARY);
         e->ternary.cond = cond;
         e->ternary.expr = expr;
         e->ternary.or_expr = or_expr;
@@ -216,17 +259,17 @@ Expr *new_expr_ternary(Expr *cond, Expr *expr, Expr *or_expr)
 }
 
 
-Expr *new_expr_sizeof(Expr *sizeof_expr)
+Expr *new_expr_sizeof(SrcPos pos, Expr *sizeof_expr)
 {
-        Expr *e = new_expr(EXPR_SIZEOF);
+        Expr *e = new_expr(pos, EXPR_SIZEOF);
         e->sizeof_expr = sizeof_expr;
         return e;
 }
 
 
-Expr *new_expr_sizeof_type(Typespec *sizeof_type)
+Expr *new_expr_sizeof_type(SrcPos pos, Typespec *sizeof_type)
 {
-        Expr *e = new_expr(EXPR_SIZEOF_TYPE);
+        Expr *e = new_expr(pos, EXPR_SIZEOF_TYPE);
         e->sizeof_type = sizeof_type;
         return e;
 }
@@ -243,6 +286,8 @@ enum TypespecKind {
 
 struct Typespec {
         enum TypespecKind kind;
+        SrcPos pos;
+        Type *type; // set once resolved
         union {
                 const char *name;
                 Typespec *base;
@@ -259,41 +304,42 @@ struct Typespec {
 };
 
 
-Typespec *new_typespec(enum TypespecKind kind)
+Typespec *new_typespec(SrcPos pos, enum TypespecKind kind)
 {
         Typespec *t = ast_alloc(sizeof(Typespec));
         t->kind = kind;
+        t->pos = pos;
         return t;
 }
 
 
-Typespec *new_typespec_name(const char *name)
+Typespec *new_typespec_name(SrcPos pos, const char *name)
 {
-        Typespec *t = new_typespec(TYPESPEC_NAME);
+        Typespec *t = new_typespec(pos, TYPESPEC_NAME);
         t->name = name;
         return t;
 }
 
 
-Typespec *new_typespec_const(Typespec *base)
+Typespec *new_typespec_const(SrcPos pos, Typespec *base)
 {
-        Typespec *t = new_typespec(TYPESPEC_CONST);
+        Typespec *t = new_typespec(pos, TYPESPEC_CONST);
         t->base = base;
         return t;
 }
 
 
-Typespec *new_typespec_ptr(Typespec *base)
+Typespec *new_typespec_ptr(SrcPos pos, Typespec *base)
 {
-        Typespec *t = new_typespec(TYPESPEC_PTR);
+        Typespec *t = new_typespec(pos, TYPESPEC_PTR);
         t->base = base;
         return t;
 }
 
 
-Typespec *new_typespec_array(Typespec *base, Expr *length)
+Typespec *new_typespec_array(SrcPos pos, Typespec *base, Expr *length)
 {
-        Typespec *t = new_typespec(TYPESPEC_ARRAY);
+        Typespec *t = new_typespec(pos, TYPESPEC_ARRAY);
         t->array.base = base;
         t->array.length = length;
         return t;
@@ -301,12 +347,13 @@ Typespec *new_typespec_array(Typespec *base, Expr *length)
 
 
 Typespec *new_typespec_function(
+        SrcPos pos,
         Typespec **args,
         size_t num_args,
         Typespec *ret
 ) {
-        Typespec *t = new_typespec(TYPESPEC_FUNCTION);
-        t->func.args = args;
+        Typespec *t = new_typespec(pos, TYPESPEC_FUNCTION);
+        t->func.args = ast_dup(args, sizeof(Typespec *));
         t->func.num_args = num_args;
         t->func.ret = ret;
         return t;
@@ -329,6 +376,7 @@ enum StmtKind {
 
 struct Stmt {
         enum StmtKind kind;
+        SrcPos pos;
         union {
                 Expr *expr;
                 
@@ -369,10 +417,11 @@ struct SwitchCase {
 };
 
 
-Stmt *new_stmt(enum StmtKind kind)
+Stmt *new_stmt(SrcPos pos, enum StmtKind kind)
 {
         Stmt *s = ast_alloc(sizeof(Stmt));
         s->kind = kind;
+        s->pos = pos;
         return s;
 }
 
@@ -382,21 +431,21 @@ SwitchCase *new_switch_case()
 }
 
 
-#define new_stmt_break() new_stmt(STMT_BREAK)
-#define new_stmt_continue() new_stmt(STMT_CONTINUE)
+#define new_stmt_break(pos) new_stmt(pos, STMT_BREAK)
+#define new_stmt_continue(pos) new_stmt(pos, STMT_CONTINUE)
 
 
-Stmt *new_stmt_return(Expr *expr)
+Stmt *new_stmt_return(SrcPos pos, Expr *expr)
 {
-        Stmt *s = new_stmt(STMT_RETURN);
+        Stmt *s = new_stmt(pos, STMT_RETURN);
         s->expr = expr;
         return s;
 }
 
 
-Stmt *new_stmt_if(Expr *cond, Stmt *body, Stmt *other)
+Stmt *new_stmt_if(SrcPos pos, Expr *cond, Stmt *body, Stmt *other)
 {
-        Stmt *s = new_stmt(STMT_IF);
+        Stmt *s = new_stmt(pos, STMT_IF);
         s->if_stmt.cond = cond;
         s->if_stmt.body = body;
         s->if_stmt.other = other;
@@ -404,26 +453,26 @@ Stmt *new_stmt_if(Expr *cond, Stmt *body, Stmt *other)
 }
 
 
-Stmt *new_stmt_while(Expr *cond, Stmt *body)
+Stmt *new_stmt_while(SrcPos pos, Expr *cond, Stmt *body)
 {
-        Stmt *s = new_stmt(STMT_WHILE);
+        Stmt *s = new_stmt(pos, STMT_WHILE);
         s->while_stmt.cond = cond;
         s->while_stmt.body = body;
         return s;
 }
 
 
-Stmt *new_stmt_do_while(Stmt *body, Expr *cond)
+Stmt *new_stmt_do_while(SrcPos pos, Stmt *body, Expr *cond)
 {
-        Stmt *s = new_stmt_while(cond, body);
+        Stmt *s = new_stmt_while(pos, cond, body);
         s->kind = STMT_DO_WHILE;
         return s;
 }
 
 
-Stmt *new_stmt_for(Expr *init, Expr *cond, Expr *step, Stmt *body)
+Stmt *new_stmt_for(SrcPos pos, Expr *init, Expr *cond, Expr *step, Stmt *body)
 {
-        Stmt *s = new_stmt(STMT_FOR);
+        Stmt *s = new_stmt(pos, STMT_FOR);
         s->for_stmt.init = init;
         s->for_stmt.cond = cond;
         s->for_stmt.step = step;
@@ -432,28 +481,28 @@ Stmt *new_stmt_for(Expr *init, Expr *cond, Expr *step, Stmt *body)
 }
 
 
-Stmt *new_stmt_switch(Expr *expr, SwitchCase **cases, size_t num_cases)
+Stmt *new_stmt_switch(SrcPos pos, Expr *expr, SwitchCase **cases, size_t num_cases)
 {
-        Stmt *s = new_stmt(STMT_SWITCH);
+        Stmt *s = new_stmt(pos, STMT_SWITCH);
         s->switch_stmt.expr = expr;
-        s->switch_stmt.cases = cases;
+        s->switch_stmt.cases = ast_dup(cases, sizeof(SwitchCase *));
         s->switch_stmt.num_cases = num_cases;
         return s;
 }
 
 
-Stmt *new_stmt_block(Stmt **stmt, size_t num_stmt)
+Stmt *new_stmt_block(SrcPos pos, Stmt **stmt, size_t num_stmt)
 {
-        Stmt *s = new_stmt(STMT_BLOCK);
-        s->block.stmt = stmt;
+        Stmt *s = new_stmt(pos, STMT_BLOCK);
+        s->block.stmt = ast_dup(stmt, sizeof(Stmt *));
         s->block.num_stmt = num_stmt;
         return s;
 }
 
 
-Stmt *new_stmt_expr(Expr *expr)
+Stmt *new_stmt_expr(SrcPos pos, Expr *expr)
 {
-        Stmt *s = new_stmt(STMT_EXPR);
+        Stmt *s = new_stmt(pos, STMT_EXPR);
         s->expr = expr;
         return s;
 }
@@ -472,6 +521,7 @@ enum DeclKind {
 
 struct Decl {
         enum DeclKind kind;
+        SrcPos pos;
         const char *name;
         union {
                 Typespec *typespec;
@@ -506,10 +556,11 @@ struct FuncDecl {
 };
 
 
-Decl *new_decl(enum DeclKind kind, const char *name)
+Decl *new_decl(SrcPos pos, enum DeclKind kind, const char *name)
 {
         Decl *d = ast_alloc(sizeof(Decl));
         d->kind = kind;
+        d->pos = pos;
         d->name = name;
         return d;
 }
@@ -531,46 +582,50 @@ FuncDecl *new_func_decl()
 }
 
 
-Decl *new_decl_typedef(const char *name, Typespec *typespec)
+Decl *new_decl_typedef(SrcPos pos, const char *name, Typespec *typespec)
 {
-        Decl *d = new_decl(DECL_TYPEDEF, name);
+        Decl *d = new_decl(pos, DECL_TYPEDEF, name);
         d->typespec = typespec;
         return d;
 }
 
 
-Decl *new_decl_box(enum DeclKind kind, const char *name, BoxDecl *box)
+Decl *new_decl_box(SrcPos pos, enum DeclKind kind, const char *name, BoxDecl *box)
 {
-        Decl *d = new_decl(kind, name);
+        Decl *d = new_decl(pos, kind, name);
+        ast_dup_buf(box->names);
+        ast_dup_buf(box->types);
         d->box = box;
         return d;
 }
 
-#define new_decl_enum(name, box) new_decl_box(DECL_ENUM, name, box)
-#define new_decl_struct(name, box) new_decl_box(DECL_STRUCT, name, box)
-#define new_decl_union(name, box) new_decl_box(DECL_UNION, name, box)
+#define new_decl_enum(pos, name, box) new_decl_box(pos, DECL_ENUM, name, box)
+#define new_decl_struct(pos, name, box) new_decl_box(pos, DECL_STRUCT, name, box)
+#define new_decl_union(pos, name, box) new_decl_box(pos, DECL_UNION, name, box)
 
 
-Decl *new_decl_const(const char *name, Typespec *type, Expr *expr)
+Decl *new_decl_const(SrcPos pos, const char *name, Typespec *type, Expr *expr)
 {
-        Decl *d = new_decl(DECL_CONST, name);
+        Decl *d = new_decl(pos, DECL_CONST, name);
         d->var.type = type;
         d->var.expr = expr;
         return d;
 }
 
 
-Decl *new_decl_var(const char *name, Typespec *type, Expr *expr)
+Decl *new_decl_var(SrcPos pos, const char *name, Typespec *type, Expr *expr)
 {
-        Decl *d = new_decl_const(name, type, expr);
+        Decl *d = new_decl_const(pos, name, type, expr);
         d->kind = DECL_VAR;
         return d;
 }
 
 
-Decl *new_decl_func(const char *name, FuncDecl *decl, Stmt *body)
+Decl *new_decl_func(SrcPos pos, const char *name, FuncDecl *decl, Stmt *body)
 {
-        Decl *d = new_decl(DECL_FUNC, name);
+        Decl *d = new_decl(pos, DECL_FUNC, name);
+        ast_dup_buf(decl->args);
+        ast_dup_buf(decl->types);
         d->func.decl = decl;
         assert(body->kind == STMT_BLOCK);
         d->func.body = body;
@@ -0,0 +1,299 @@
+#ifndef ION_AST_CACHE
+#define ION_AST_CACHE
+
+// Parsed files are kept on disk as their flat AST, one file per source
+// named after a hash of the source text.  A cache file is the header
+// followed by the four node arrays, their positions relative to the
+// start of the source (0 meaning none), the extra array, the string
+// offsets and the string bytes.  Everything is 4 byte aligned so the
+// mapped file is read in place, loading only re-interns the strings
+// and rebuilds the pointer AST with unflatten_ast.
+//
+// Bump AST_CACHE_VERSION whenever the AST or the flat layout changes.
+
+enum {
+        AST_CACHE_MAGIC = 0x54534149, // "IAST"
+        AST_CACHE_VERSION = 1,
+};
+
+typedef struct AstCacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t hash; // of the source text
+        uint64_t size; // of the source text
+        uint64_t check; // of everything after the header
+        uint32_t num_exprs, num_stmts, num_typespecs, num_decls;
+        uint32_t num_extra, num_strs, str_bytes;
+        uint32_t pad;
+} AstCacheHeader;
+
+// directory of the cache files, NULL turns the cache off
+const char *ast_cache_dir;
+
+
+static size_t ast_cache_bytes(AstCacheHeader *h)
+{
+        size_t nodes = (size_t) h->num_exprs + h->num_stmts +
+                h->num_typespecs + h->num_decls;
+
+        return sizeof(AstCacheHeader) + nodes * (sizeof(FlatNode) + sizeof(SrcPos)) +
+                (h->num_extra + h->num_strs + 1) * sizeof(uint32_t) +
+                ALIGN_UP(h->str_bytes, 4);
+}
+
+
+static char *cache_put(char *buf, const void *data, size_t size)
+{
+        buf__fit(buf, size);
+        memcpy(buf + buf_len(buf), data, size);
+        buf_len(buf) += size;
+        return buf;
+}
+
+
+static char *cache_put_pos(char *buf, SrcPos *positions, size_t n, SrcPos base)
+{
+        SrcPos *out;
+
+        buf__fit(buf, n * sizeof(SrcPos));
+        out = (SrcPos *) (buf + buf_len(buf));
+        for (size_t i = 0; i < n; i++)
+                out[i] = positions[i] ? positions[i] - base + 1 : 0;
+        buf_len(buf) += n * sizeof(SrcPos);
+        return buf;
+}
+
+
+// f was flattened from a source of the given hash and size whose
+// positions start at base
+char *encode_ast_cache(FlatAst *f, uint64_t hash, size_t size, SrcPos base)
+{
+        AstCacheHeader h = {
+                .magic = AST_CACHE_MAGIC,
+                .version = AST_CACHE_VERSION,
+                .hash = hash,
+                .size = size,
+                .num_exprs = buf_len(f->exprs),
+                .num_stmts = buf_len(f->stmts),
+                .num_typespecs = buf_len(f->typespecs),
+                .num_decls = buf_len(f->decls),
+                .num_extra = buf__len(f->extra),
+                .num_strs = buf_len(f->strs),
+        };
+        uint32_t offset = 0, zero = 0;
+        char *buf = NULL;
+        size_t len;
+
+        for (size_t i = 1; i < h.num_strs; i++)
+                h.str_bytes += strlen(f->strs[i]) + 1;
+
+        buf__fit(buf, ast_cache_bytes(&h));
+        buf = cache_put(buf, &h, sizeof(h));
+        buf = cache_put(buf, f->exprs, h.num_exprs * sizeof(FlatNode));
+        buf = cache_put(buf, f->stmts, h.num_stmts * sizeof(FlatNode));
+        buf = cache_put(buf, f->typespecs, h.num_typespecs * sizeof(FlatNode));
+        buf = cache_put(buf, f->decls, h.num_decls * sizeof(FlatNode));
+        buf = cache_put_pos(buf, f->expr_pos, h.num_exprs, base);
+        buf = cache_put_pos(buf, f->stmt_pos, h.num_stmts, base);
+        buf = cache_put_pos(buf, f->typespec_pos, h.num_typespecs, base);
+        buf = cache_put_pos(buf, f->decl_pos, h.num_decls, base);
+        buf = cache_put(buf, f->extra, h.num_extra * sizeof(uint32_t));
+
+        // strs[0] is NULL and gets an empty entry
+        for (size_t i = 0; i <= h.num_strs; i++) {
+                buf = cache_put(buf, &offset, sizeof(offset));
+                if (i > 0 && i < h.num_strs)
+                        offset += strlen(f->strs[i]) + 1;
+        }
+        for (size_t i = 1; i < h.num_strs; i++)
+                buf = cache_put(buf, f->strs[i], strlen(f->strs[i]) + 1);
+        buf = cache_put(buf, &zero, ALIGN_UP(h.str_bytes, 4) - h.str_bytes);
+
+        len = buf_len(buf);
+        assert(len == ast_cache_bytes(&h));
+        ((AstCacheHeader *) buf)->check = hash_text(buf + sizeof(h), len - sizeof(h));
+        return buf;
+}
+
+
+// Returns 0 unless data is an intact cache of the source with the
+// given hash and size, base is where the positions of that source
+// start.  The decls go to ast_arena.
+char decode_ast_cache(const char *data, size_t len, uint64_t hash, size_t size,
+        SrcPos base, Decl ***decls)
+{
+        AstCacheHeader *h = (AstCacheHeader *) data;
+        const uint32_t *offsets;
+        const char *p, *bytes;
+        FlatAst f = {0};
+
+        if (len < sizeof(AstCacheHeader) || h->magic != AST_CACHE_MAGIC ||
+                h->version != AST_CACHE_VERSION || h->hash != hash ||
+                h->size != size || h->num_decls == 0 ||
+                len != ast_cache_bytes(h) ||
+                h->check != hash_text(data + sizeof(*h), len - sizeof(*h)))
+                        return 0;
+
+        p = data + sizeof(*h);
+#define cache_take(arr, n) ((arr) = (void *) p, p += (n) * sizeof(*(arr)))
+        cache_take(f.exprs, h->num_exprs);
+        cache_take(f.stmts, h->num_stmts);
+        cache_take(f.typespecs, h->num_typespecs);
+        cache_take(f.decls, h->num_decls);
+        cache_take(f.expr_pos, h->num_exprs);
+        cache_take(f.stmt_pos, h->num_stmts);
+        cache_take(f.typespec_pos, h->num_typespecs);
+        cache_take(f.decl_pos, h->num_decls);
+        cache_take(f.extra, h->num_extra);
+        cache_take(offsets, h->num_strs + 1);
+#undef cache_take
+        bytes = p;
+
+        // the only pointers to fix up
+        f.strs = malloc(h->num_strs * sizeof(const char *));
+        f.strs[0] = NULL;
+        for (size_t i = 1; i < h->num_strs; i++) {
+                f.strs[i] = str_intern_slice(bytes + offsets[i],
+                        offsets[i + 1] - offsets[i] - 1);
+        }
+
+        *decls = unflatten_ast(&f, h->num_decls, base - 1);
+        free(f.strs);
+        return 1;
+}
+
+
+static char *ast_cache_path(char *path, uint64_t hash)
+{
+        buf_len(path) = 0;
+        return buf_printf(path, "%s/%016llx.ast", ast_cache_dir, (unsigned long long) hash);
+}
+
+
+// hash is hash_text of the source text
+char load_ast_cache(Source *src, uint64_t hash, Decl ***decls)
+{
+        char *path = NULL, *data, found = 0;
+        struct stat st;
+        int fd;
+
+        buf_init(path);
+        path = ast_cache_path(path, hash);
+        fd = open(path, O_RDONLY);
+        buf_free(path);
+        if (fd < 0)
+                return 0;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data != MAP_FAILED) {
+                        found = decode_ast_cache(data, st.st_size, hash, src->size,
+                                add_src_file(src->name, src->text, src->size), decls);
+                        munmap(data, st.st_size);
+                }
+        }
+        close(fd);
+        return found;
+}
+
+
+// The cache is only an optimization, failing to write it is not an
+// error.  Files are written under a temporary name and renamed so
+// concurrent compiles never see a partial file.
+void save_ast_cache(Source *src, uint64_t hash, Decl **decls)
+{
+        char *path = NULL, *tmp = NULL, *data;
+        FlatAst flat;
+        ssize_t n = 0;
+        size_t done;
+        int fd;
+
+        flat = flatten_ast(decls, buf__len(decls));
+        data = encode_ast_cache(&flat, hash, src->size,
+                add_src_file(src->name, src->text, src->size));
+        flat_ast_free(&flat);
+
+        buf_init(path);
+        path = ast_cache_path(path, hash);
+        tmp = buf_printf(tmp, "%s.XXXXXX", path);
+        if (mkdir(ast_cache_dir, 0777) != 0 && errno != EEXIST)
+                goto out;
+        fd = mkstemp(tmp);
+        if (fd < 0)
+                goto out;
+        for (done = 0; done < buf_len(data); done += n) {
+                n = write(fd, data + done, buf_len(data) - done);
+                if (n <= 0)
+                        break;
+        }
+        close(fd);
+        if (n <= 0 || rename(tmp, path) != 0)
+                unlink(tmp);
+out:
+        buf_free(data);
+        buf_free(path);
+        buf_free(tmp);
+}
+
+
+void ast_cache_test()
+{
+        const char *source =
+                "struct S { i: int; t: T* }\n"
+                "enum E { A = 1, B }\n"
+                "var s = \"cached\"\n"
+                "func f(a: int, b: char*): int {\n"
+                "        switch (a) { case 1: return 2; default: b++ }\n"
+                "        for (i := 0; i < a; i++) if (b[i]) f(i, b) else { return; }\n"
+                "        return a ? sizeof(:S) : cast(int) 2.5\n"
+                "}\n";
+        Source src = {.name = "<ast_cache_test>", .text = source, .size = strlen(source)};
+        uint64_t hash = hash_text(src.text, src.size);
+        FlatAst flat, again;
+        Decl **ast, **decls;
+        SrcPos base;
+        char *data;
+
+        filename = src.name;
+        init_lex(src.name, src.text);
+        ast = recursive_descent_parser();
+        base = add_src_file(src.name, src.text, src.size);
+        flat = flatten_ast(ast, buf_len(ast));
+        data = encode_ast_cache(&flat, hash, src.size, base);
+
+        assert(!decode_ast_cache(data, buf_len(data), hash + 1, src.size, base, &decls));
+        assert(!decode_ast_cache(data, buf_len(data), hash, src.size + 1, base, &decls));
+        assert(!decode_ast_cache(data, buf_len(data) - 4, hash, src.size, base, &decls));
+        data[buf_len(data) - 4] ^= 1;
+        assert(!decode_ast_cache(data, buf_len(data), hash, src.size, base, &decls));
+        data[buf_len(data) - 4] ^= 1;
+
+        // flattening the decoded tree gives back the same arrays,
+        // positions included
+        assert(decode_ast_cache(data, buf_len(data), hash, src.size, base, &decls));
+        assert(buf_len(decls) == buf_len(ast));
+        again = flatten_ast(decls, buf_len(decls));
+#define same_array(a, b) (buf__len(a) == buf__len(b) && \
+        memcmp((a), (b), buf__len(a) * sizeof(*(a))) == 0)
+        assert(same_array(again.exprs, flat.exprs));
+        assert(same_array(again.stmts, flat.stmts));
+        assert(same_array(again.typespecs, flat.typespecs));
+        assert(same_array(again.decls, flat.decls));
+        assert(same_array(again.expr_pos, flat.expr_pos));
+        assert(same_array(again.stmt_pos, flat.stmt_pos));
+        assert(same_array(again.typespec_pos, flat.typespec_pos));
+        assert(same_array(again.decl_pos, flat.decl_pos));
+        assert(same_array(again.extra, flat.extra));
+#undef same_array
+        assert(buf_len(again.strs) == buf_len(flat.strs));
+        for (size_t i = 1; i < buf_len(flat.strs); i++)
+                assert(strcmp(again.strs[i], flat.strs[i]) == 0);
+        assert(decls[0]->name == str_intern("S"));
+
+        flat_ast_free(&again);
+        flat_ast_free(&flat);
+        buf_free(data);
+        buf_free(decls);
+        buf_free(ast);
+}
+
+#endif
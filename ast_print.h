@@ -2,12 +2,14 @@
 #define AST_PRINT_AUTOMATON
 
 
-char use_print_buf, *print_buf;
+_Thread_local char use_print_buf, *print_buf;
 
 #define buf_printf(...) (print_buf = buf_printf(print_buf, __VA_ARGS__))
 #define printf(...) \
         use_print_buf ? (void) buf_printf(__VA_ARGS__) : printf(__VA_ARGS__)
 
+void print_typespec(Typespec *type);
+
 
 void print_expr(Expr *expr)
 {
@@ -27,7 +29,12 @@ void print_expr(Expr *expr)
                 printf("%c%s%c", '"', expr->str_val, '"');
                 return;
         case EXPR_CAST:
-                assert(EXPR_CAST);
+                printf("(cast ");
+                print_typespec(e.cast.type);
+                printf(" ");
+                print_expr(e.cast.expr);
+                printf(")");
+                return;
         case EXPR_CALL:
                 printf("(call ");
                 print_expr(e.call.expr);
@@ -80,7 +87,10 @@ void print_expr(Expr *expr)
                 printf(")");
                 return;
         case EXPR_SIZEOF_TYPE:
-                assert(EXPR_SIZEOF_TYPE);
+                printf("(sizeof ");
+                print_typespec(expr->sizeof_type);
+                printf(")");
+                return;
         default:
                 assert(EXPR_NONE);
         }
@@ -326,6 +336,341 @@ void print_ast(Decl **ast, size_t len)
         }
 }
 
+
+// The same output from the flat AST, see flat_ast.h for the layout
+
+void print_flat_typespec(FlatAst *f, NodeRef ref);
+void print_flat_stmt(FlatAst *f, NodeRef ref);
+
+
+void print_flat_expr(FlatAst *f, NodeRef ref)
+{
+        const FlatNode n = f->exprs[ref];
+        const uint32_t *x;
+        uint64_t bits = (uint64_t) n.b << 32 | n.a;
+        double float_val;
+
+        switch (n.kind) {
+        case EXPR_NAME:
+                printf(f->strs[n.a]);
+                return;
+        case EXPR_INT:
+                printf("%ld", (int64_t) bits);
+                return;
+        case EXPR_FLOAT:
+                memcpy(&float_val, &bits, sizeof(float_val));
+                printf("%f", float_val);
+                return;
+        case EXPR_STR:
+                printf("%c%s%c", '"', f->strs[n.a], '"');
+                return;
+        case EXPR_CAST:
+                printf("(cast ");
+                print_flat_typespec(f, n.a);
+                printf(" ");
+                print_flat_expr(f, n.b);
+                printf(")");
+                return;
+        case EXPR_CALL:
+                printf("(call ");
+                print_flat_expr(f, n.a);
+                x = f->extra + n.b;
+                for (uint32_t i = 0; i < x[0]; i++) {
+                        printf(" ");
+                        print_flat_expr(f, x[1 + i]);
+                }
+                printf(")");
+                return;
+        case EXPR_INDEX:
+                printf("([] ");
+                print_flat_expr(f, n.a);
+                printf(" ");
+                print_flat_expr(f, n.b);
+                printf(")");
+                return;
+        case EXPR_FIELD:
+                printf("(. ");
+                print_flat_expr(f, n.a);
+                printf(" ");
+                printf(f->strs[n.b]);
+                printf(")");
+                return;
+        case EXPR_UNARY:
+                printf("(%s ", token_kind(n.op));
+                print_flat_expr(f, n.a);
+                printf(")");
+                return;
+        case EXPR_BINARY:
+                printf("(%s ", token_kind(n.op));
+                print_flat_expr(f, n.a);
+                printf(" ");
+                print_flat_expr(f, n.b);
+                printf(")");
+                return;
+        case EXPR_TERNARY:
+                printf("(? ");
+                print_flat_expr(f, n.a);
+                printf(" ");
+                print_flat_expr(f, f->extra[n.b]);
+                printf(" ");
+                print_flat_expr(f, f->extra[n.b + 1]);
+                printf(")");
+                return;
+        case EXPR_SIZEOF:
+                printf("(sizeof ");
+                print_flat_expr(f, n.a);
+                printf(")");
+                return;
+        case EXPR_SIZEOF_TYPE:
+                printf("(sizeof ");
+                print_flat_typespec(f, n.a);
+                printf(")");
+                return;
+        default:
+                assert(EXPR_NONE);
+        }
+}
+
+
+void print_flat_typespec(FlatAst *f, NodeRef ref)
+{
+        const FlatNode n = f->typespecs[ref];
+        const uint32_t *x;
+
+        switch (n.kind) {
+        case TYPESPEC_NAME:
+                printf(f->strs[n.a]);
+                return;
+        case TYPESPEC_CONST:
+                printf("(const ");
+                print_flat_typespec(f, n.a);
+                printf(")");
+                return;
+        case TYPESPEC_PTR:
+                printf("(ptr ");
+                print_flat_typespec(f, n.a);
+                printf(")");
+                return;
+        case TYPESPEC_ARRAY:
+                printf("(array ");
+                print_flat_typespec(f, n.a);
+                printf(" ");
+                print_flat_expr(f, n.b);
+                printf(")");
+                return;
+        case TYPESPEC_FUNCTION:
+                printf("(func (");
+                x = f->extra + n.b;
+                for (uint32_t i = 0; i < x[0]; i++) {
+                        if (i) printf(", ");
+                        print_flat_typespec(f, x[1 + i]);
+                }
+                printf(") ");
+                if (n.a) print_flat_typespec(f, n.a);
+                else printf("void");
+                printf(")");
+                return;
+        default:
+                assert(TYPESPEC_NONE);
+        }
+}
+
+
+static void print_flat_optional_expr(FlatAst *f, NodeRef ref)
+{
+        if (ref) {
+                print_flat_expr(f, ref);
+        } else {
+                printf("()");
+        }
+}
+
+
+void print_flat_stmt(FlatAst *f, NodeRef ref)
+{
+        const FlatNode n = f->stmts[ref];
+        const uint32_t *x;
+
+        switch (n.kind) {
+        case STMT_BREAK:
+                printf("(break)");
+                return;
+        case STMT_CONTINUE:
+                printf("(continue)");
+                return;
+        case STMT_RETURN:
+                printf("(return");
+                if (n.a) {
+                        printf(" ");
+                        print_flat_expr(f, n.a);
+                }
+                printf(")");
+                return;
+        case STMT_IF:
+                printf("(if ");
+                print_flat_expr(f, n.a);
+                printf(" ");
+                print_flat_stmt(f, f->extra[n.b]);
+                if (f->extra[n.b + 1]) {
+                        printf(" else ");
+                        print_flat_stmt(f, f->extra[n.b + 1]);
+                }
+                printf(")");
+                return;
+        case STMT_WHILE:
+                printf("(while ");
+                print_flat_expr(f, n.a);
+                printf(" ");
+                print_flat_stmt(f, n.b);
+                printf(")");
+                return;
+        case STMT_DO_WHILE:
+                printf("(do ");
+                print_flat_stmt(f, n.b);
+                printf(" while ");
+                print_flat_expr(f, n.a);
+                printf(")");
+                return;
+        case STMT_FOR:
+                x = f->extra + n.a;
+                printf("(for ");
+                print_flat_optional_expr(f, x[0]);
+                printf(" ");
+                print_flat_optional_expr(f, x[1]);
+                printf(" ");
+                print_flat_optional_expr(f, x[2]);
+                printf(" ");
+                print_flat_stmt(f, x[3]);
+                printf(")");
+                return;
+        case STMT_SWITCH:
+                printf("(switch ");
+                print_flat_expr(f, n.a);
+                x = f->extra + n.b;
+                for (uint32_t i = 0; i < x[0]; i++) {
+                        printf(" ");
+                        if (x[1 + 2 * i]) {
+                                printf("(case ");
+                                print_flat_expr(f, x[1 + 2 * i]);
+                                printf(" ");
+                        } else {
+                                printf("(default ");
+                        }
+                        print_flat_stmt(f, x[2 + 2 * i]);
+                        printf(")");
+                }
+                printf(")");
+                return;
+        case STMT_BLOCK:
+                printf("(block");
+                x = f->extra + n.a;
+                if (x[0] == 0) {
+                        printf(" nil)");
+                        return;
+                }
+                for (uint32_t i = 0; i < x[0]; i++) {
+                        printf(" ");
+                        print_flat_stmt(f, x[1 + i]);
+                }
+                printf(")");
+                return;
+        case STMT_EXPR:
+                print_flat_expr(f, n.a);
+                return;
+        default:
+                assert(STMT_NONE);
+        }
+}
+
+
+void print_flat_decl(FlatAst *f, NodeRef ref)
+{
+        const FlatNode n = f->decls[ref];
+        const char *name = f->strs[n.a];
+        const uint32_t *x;
+
+        switch (n.kind) {
+        case DECL_TYPEDEF:
+                printf("(typedef %s ", name);
+                print_flat_typespec(f, n.b);
+                printf(")");
+                return;
+        case DECL_ENUM:
+                printf("(enum %s ", name);
+                x = f->extra + n.b;
+                for (uint32_t i = 0; i < x[0]; i++) {
+                        if (i) printf(" ");
+                        if (x[2 + 2 * i]) {
+                                printf("(%s ", f->strs[x[1 + 2 * i]]);
+                                print_flat_expr(f, x[2 + 2 * i]);
+                                printf(")");
+                        } else {
+                                printf(f->strs[x[1 + 2 * i]]);
+                        }
+                }
+                printf(")");
+                return;
+        case DECL_STRUCT:
+                printf("(struct %s ", name);
+                goto aggregate;
+        case DECL_UNION:
+                printf("(union %s ", name);
+aggregate:
+                x = f->extra + n.b;
+                for (uint32_t i = 0; i < x[0]; i++) {
+                        if (i) printf(" ");
+                        printf("(%s ", f->strs[x[1 + 2 * i]]);
+                        print_flat_typespec(f, x[2 + 2 * i]);
+                        printf(")");
+                }
+                printf(")");
+                return;
+        case DECL_CONST:
+                printf("(const %s ", name);
+                print_flat_expr(f, f->extra[n.b + 1]);
+                printf(")");
+                return;
+        case DECL_VAR:
+                x = f->extra + n.b;
+                printf("(var %s (", name);
+                if (x[0]) print_flat_typespec(f, x[0]);
+                printf(")");
+                if (x[1]) {
+                        printf(" ");
+                        print_flat_expr(f, x[1]);
+                }
+                printf(")");
+                return;
+        case DECL_FUNC:
+                x = f->extra + n.b;
+                printf("(func %s", name);
+                for (uint32_t i = 0; i < x[2]; i++) {
+                        printf(" (%s ", f->strs[x[3 + 2 * i]]);
+                        print_flat_typespec(f, x[4 + 2 * i]);
+                        printf(")");
+                }
+                printf(" (ret ");
+                if (x[0]) print_flat_typespec(f, x[0]);
+                else printf("void");
+                printf(") ");
+                print_flat_stmt(f, x[1]);
+                printf(")");
+                return;
+        default:
+                assert(DECL_NONE);
+        }
+}
+
+
+void print_flat_ast(FlatAst *f)
+{
+        for (size_t i = 1; i < buf_len(f->decls); i++) {
+                print_flat_decl(f, i);
+                printf("\n");
+        }
+}
+
 #undef printf
+#undef buf_printf
 #endif
 
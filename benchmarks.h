@@ -0,0 +1,879 @@
+#ifndef ION_BENCHMARKS
+#define ION_BENCHMARKS
+
+// Benchmarks are regular entry points, build one with
+// cc -O2 -DMAIN=bench_intern compiler.c
+
+
+int bench_intern(int argc, char **argv)
+{
+        enum { NAME_LEN = 32 };
+        size_t num_names = 1 << 20, num_lookups = 1 << 22;
+        char *names;
+        uint64_t start, elapsed;
+        const char *p;
+
+        if (argc > 1)
+                num_names = strtoul(argv[1], NULL, 0);
+        if (argc > 2)
+                num_lookups = strtoul(argv[2], NULL, 0);
+
+        names = malloc(num_names * NAME_LEN);
+        for (size_t i = 0; i < num_names; i++) {
+                snprintf(names + i * NAME_LEN, NAME_LEN, "ident_%x_%zu", (unsigned) (i * 2654435761u), i);
+        }
+
+        start = nanotime();
+        for (size_t i = 0; i < num_names; i++) {
+                str_intern(names + i * NAME_LEN);
+        }
+        elapsed = nanotime() - start;
+        printf("intern:  %zu new names, %.1f ns/insert\n",
+                num_names, (double) elapsed / num_names);
+
+        start = nanotime();
+        for (size_t i = 0; i < num_lookups; i++) {
+                p = str_intern(names + (i * 7919 % num_names) * NAME_LEN);
+                assert(p);
+        }
+        elapsed = nanotime() - start;
+        printf("intern:  %zu lookups, %.1f ns/lookup\n",
+                num_lookups, (double) elapsed / num_lookups);
+        printf("intern:  load factor %.3f\n", str_load_factor());
+
+        free(names);
+        return 0;
+}
+
+
+struct InternBench {
+        char *names;
+        size_t num_names, ops;
+};
+
+
+static void bench_intern_job(void *ctx, size_t t)
+{
+        struct InternBench *b = ctx;
+        size_t j = t * 104729;
+
+        // skewed towards a hot set, like identifiers in real code
+        for (size_t i = 0; i < b->ops; i++) {
+                j = j * 6364136223846793005u + 1442695040888963407u;
+                str_intern(b->names + (j >> 33) % (i & 3 ? 256 : b->num_names) * 32);
+        }
+}
+
+
+// bench_intern_threads [names] [ops per thread]
+int bench_intern_threads(int argc, char **argv)
+{
+        static const int threads[] = {1, 4, 16, 64};
+        struct InternBench b = {NULL, 1 << 16, 1 << 20};
+        uint64_t start, elapsed;
+
+        if (argc > 1)
+                b.num_names = strtoul(argv[1], NULL, 0);
+        if (argc > 2)
+                b.ops = strtoul(argv[2], NULL, 0);
+
+        b.names = malloc(b.num_names * 32);
+        for (size_t i = 0; i < b.num_names; i++)
+                snprintf(b.names + i * 32, 32, "shared_name_%u", (unsigned) i);
+
+        for (int cache = 0; cache <= 1; cache++) {
+                use_intern_cache = cache;
+                for (size_t i = 0; i < sizeof(threads) / sizeof(*threads); i++) {
+                        start = nanotime();
+                        run_jobs(bench_intern_job, &b, threads[i], threads[i]);
+                        elapsed = nanotime() - start;
+                        printf("intern:  %s %2d threads %7.1f Mops/s\n",
+                                cache ? "cached  " : "uncached", threads[i],
+                                threads[i] * b.ops / (elapsed / 1e3));
+                }
+        }
+        use_intern_cache = 1;
+        free(b.names);
+        return 0;
+}
+
+
+// the loader read_file used to be, kept for comparison
+static char *read_file_stdio(const char *name)
+{
+        FILE *stream;
+        char *content = NULL;
+        int c;
+        
+        stream = fopen(name, "r");
+        if (stream == NULL)
+                return NULL;
+        while (c = fgetc(stream), c != EOF) {
+                buf_push(content, c);
+        }
+        buf_push(content, 0);
+        fclose(stream);
+        return content;
+}
+
+
+static const char *write_temp_file(size_t size)
+{
+        static char name[64];
+        const char *line = "func f(a: int, b: int): int { return a * b + 7 }\n";
+        size_t len = strlen(line);
+        FILE *f;
+        
+        snprintf(name, sizeof(name), "/tmp/ion_bench_%d.ion", getpid());
+        f = fopen(name, "w");
+        for (size_t n = 0; n + len <= size; n += len) {
+                fputs(line, f);
+        }
+        fclose(f);
+        return name;
+}
+
+
+static uint64_t checksum(const char *text)
+{
+        uint64_t sum = 0;
+        
+        while (*text)
+                sum += *text++;
+        return sum;
+}
+
+
+int bench_load(int argc, char **argv)
+{
+        size_t sizes[] = {1 << 20, 100 << 20};
+        const char *name;
+        uint64_t start, t_stdio, t_source, sum1, sum2;
+        char *content;
+        Source *src;
+        
+        (void) argc, (void) argv;
+        
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+                name = write_temp_file(sizes[i]);
+                
+                start = nanotime();
+                content = read_file_stdio(name);
+                sum1 = checksum(content);
+                t_stdio = nanotime() - start;
+                free(buf__hdr(content));
+                
+                start = nanotime();
+                src = load_source(name);
+                sum2 = checksum(src->text);
+                t_source = nanotime() - start;
+                unload_source(src);
+                
+                assert(sum1 == sum2);
+                printf("load:    %3zu MB  fgetc %8.2f ms  load_source %8.2f ms\n",
+                        sizes[i] >> 20, t_stdio / 1e6, t_source / 1e6);
+                unlink(name);
+        }
+        return 0;
+}
+
+
+// synthetic Ion source of roughly the given size, stretchy buffer
+char *gen_corpus(size_t size)
+{
+        char *text = NULL;
+        
+        buf_init(text);
+        for (size_t i = 0; buf_len(text) < size; i++) {
+                text = buf_printf(text,
+                        "struct Vec%zu { x: float; y: float; next: Vec%zu* }\n"
+                        "const LIMIT_%zu = %zu * 16 + 0x%zx\n"
+                        "func update_%zu(v: Vec%zu*, n: int): int {\n"
+                        "        total := 0\n"
+                        "        for (i := 0; i < n; i++) {\n"
+                        "                if (v.x > v.y && i %% 3 == 0) {\n"
+                        "                        total += cast(int) (v.x * 2.5)\n"
+                        "                } else {\n"
+                        "                        total = total - arr[i] << 1\n"
+                        "                }\n"
+                        "                v = v.next\n"
+                        "        }\n"
+                        "        switch (total) { case 0: return LIMIT_%zu; default: break }\n"
+                        "        return total\n"
+                        "}\n",
+                        i, i, i, i, i, i, i, i);
+        }
+        return text;
+}
+
+
+int bench_parse(int argc, char **argv)
+{
+        size_t size = 64 << 20, lines = 0;
+        uint64_t start, t_parse, t_free;
+        Decl **ast;
+        char *text;
+        
+        if (argc > 1)
+                size = strtoul(argv[1], NULL, 0) << 20;
+        text = gen_corpus(size);
+        for (char *p = text; *p; p++)
+                lines += *p == '\n';
+        
+        start = nanotime();
+        init_lex("<corpus>", text);
+        ast = recursive_descent_parser();
+        t_parse = nanotime() - start;
+        
+        printf("parse:   %zu decls, %.1f MB/s, %.0f lines/s\n", buf_len(ast),
+                buf_len(text) / (t_parse / 1e3), lines / (t_parse / 1e9));
+        printf("parse:   %zu nodes, %.1f MB in arena\n", ast_arena.num_allocs,
+                ast_arena.bytes_allocated / 1e6);
+        
+        start = nanotime();
+        ast_free();
+        buf_free(ast);
+        t_free = nanotime() - start;
+        printf("parse:   teardown %.2f ms\n", t_free / 1e6);
+        
+        release_src_file(text);
+        buf_free(text);
+        return 0;
+}
+
+
+int bench_lex(int argc, char **argv)
+{
+        size_t size = 64 << 20, num_tokens;
+        uint64_t start, elapsed;
+        char *text;
+        
+        if (argc > 1)
+                size = strtoul(argv[1], NULL, 0) << 20;
+        text = gen_corpus(size);
+        
+        for (enum LexSimd level = LEX_SIMD_SCALAR; level <= LEX_SIMD_AVX2; level++) {
+                if (select_lex_simd(level) != level)
+                        continue;
+                
+                num_tokens = 0;
+                start = nanotime();
+                init_lex("<corpus>", text);
+                while (token.kind != TOKEN_EOF) {
+                        next_token();
+                        num_tokens++;
+                }
+                elapsed = nanotime() - start;
+                
+                printf("lex:     %-6s %zu tokens, %.1f MB/s, %.1f Mtokens/s\n",
+                        lex_simd_name[level], num_tokens,
+                        buf_len(text) / (elapsed / 1e3), num_tokens / (elapsed / 1e3));
+        }
+        release_src_file(text);
+        buf_free(text);
+        return 0;
+}
+
+
+static Sym *sym_get_linear(const char *name)
+{
+        for (size_t i = 0; i < buf_len(global_symbols); i++) {
+                if (global_symbols[i]->name == name)
+                        return global_symbols[i];
+        }
+        return NULL;
+}
+
+
+int bench_sym_get(int argc, char **argv)
+{
+        size_t sizes[] = {10000, 100000};
+        size_t num_refs = 1 << 22, num_linear = 1 << 12;
+        const char **names, *name;
+        uint64_t start, t_map, t_linear;
+        char buf[32];
+        
+        if (argc > 1)
+                num_refs = strtoul(argv[1], NULL, 0);
+        
+        for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+                size_t n = sizes[k];
+                
+                names = malloc(n * sizeof(char *));
+                for (size_t i = 0; i < n; i++) {
+                        snprintf(buf, sizeof(buf), "global_%zu", i);
+                        names[i] = str_intern(buf);
+                        sym_global_put(new_sym(SYM_VAR, names[i], NULL));
+                }
+                
+                start = nanotime();
+                for (size_t i = 0; i < num_refs; i++) {
+                        name = names[i * 7919 % n];
+                        if (sym_get(name) == NULL)
+                                abort();
+                }
+                t_map = nanotime() - start;
+                
+                start = nanotime();
+                for (size_t i = 0; i < num_linear; i++) {
+                        name = names[i * 7919 % n];
+                        if (sym_get_linear(name) == NULL)
+                                abort();
+                }
+                t_linear = nanotime() - start;
+                
+                printf("sym_get: %6zu globals  map %6.1f ns/ref  linear %8.1f ns/ref\n",
+                        n, (double) t_map / num_refs, (double) t_linear / num_linear);
+                sym_reset_globals();
+                free(names);
+        }
+        return 0;
+}
+
+
+// bench_token_buffer [MB of source]
+int bench_token_buffer(int argc, char **argv)
+{
+        size_t size = 32 << 20, num_tokens, bytes;
+        uint64_t start, t_direct, t_lex, t_replay, t_scratch;
+        TokenBuffer tb;
+        Decl **ast;
+        char *text;
+
+        if (argc > 1)
+                size = strtoul(argv[1], NULL, 0) << 20;
+        text = gen_corpus(size);
+
+        // warm up the interner so both runs only look names up
+        init_lex("<corpus>", text);
+        ast = recursive_descent_parser();
+        ast_free();
+        buf_free(ast);
+
+        start = nanotime();
+        init_lex("<corpus>", text);
+        ast = recursive_descent_parser();
+        t_direct = nanotime() - start;
+        ast_free();
+        buf_free(ast);
+
+        start = nanotime();
+        tb = lex_all("<corpus>", text);
+        t_lex = nanotime() - start;
+
+        start = nanotime();
+        replay_tokens(&tb, "<corpus>");
+        ast = recursive_descent_parser();
+        t_replay = nanotime() - start;
+        ast_free();
+        buf_free(ast);
+
+        // token buffer mode reuses the per thread buffer, already
+        // grown by the warm up
+        use_token_buffer = 1;
+        init_lex("<corpus>", text);
+        ast = recursive_descent_parser();
+        ast_free();
+        buf_free(ast);
+        start = nanotime();
+        init_lex("<corpus>", text);
+        ast = recursive_descent_parser();
+        t_scratch = nanotime() - start;
+        ast_free();
+        buf_free(ast);
+        use_token_buffer = 0;
+
+        num_tokens = buf_len(tb.kinds);
+        bytes = num_tokens * (sizeof(*tb.kinds) + sizeof(*tb.positions) +
+                sizeof(*tb.payloads)) +
+                buf_len(tb.values) * sizeof(*tb.values);
+        printf("tokens:  %zu tokens, %.1f bytes/token\n",
+                num_tokens, (double) bytes / num_tokens);
+        printf("tokens:  lex+parse interleaved  %7.1f MB/s\n", buf_len(text) / (t_direct / 1e3));
+        printf("tokens:  lex_all then parse     %7.1f MB/s (lex %.0f ms, parse %.0f ms)\n",
+                buf_len(text) / ((t_lex + t_replay) / 1e3), t_lex / 1e6, t_replay / 1e6);
+        printf("tokens:  reused buffer          %7.1f MB/s\n", buf_len(text) / (t_scratch / 1e3));
+        printf("tokens:  parse of a kept buffer %7.1f MB/s\n", buf_len(text) / (t_replay / 1e3));
+
+        token_buffer = NULL;
+        free_token_buffer(&tb);
+        release_src_file(text);
+        buf_free(text);
+        return 0;
+}
+
+
+// bench_flat_ast [MB of source]
+int bench_flat_ast(int argc, char **argv)
+{
+        size_t size = 16 << 20, lines = 0, flat_bytes, out_len;
+        uint64_t start, t_flatten, t_print, t_print_flat;
+        Decl **ast;
+        FlatAst flat;
+        char *text;
+
+        if (argc > 1)
+                size = strtoul(argv[1], NULL, 0) << 20;
+        text = gen_corpus(size);
+        for (char *p = text; *p; p++)
+                lines += *p == '\n';
+
+        init_lex("<corpus>", text);
+        ast = recursive_descent_parser();
+
+        start = nanotime();
+        flat = flatten_ast(ast, buf_len(ast));
+        t_flatten = nanotime() - start;
+        flat_bytes = flat_ast_bytes(&flat);
+
+        printf("flat:    %zu lines, %zu decls\n", lines, buf_len(ast));
+        printf("flat:    pointer AST %8.1f MB %6.1f bytes/line\n",
+                ast_arena.bytes_allocated / 1e6, (double) ast_arena.bytes_allocated / lines);
+        printf("flat:    flat AST    %8.1f MB %6.1f bytes/line (%zu exprs, %zu stmts, %zu extra)\n",
+                flat_bytes / 1e6, (double) flat_bytes / lines, buf_len(flat.exprs),
+                buf_len(flat.stmts), buf__len(flat.extra));
+        printf("flat:    flatten %.1f ms\n", t_flatten / 1e6);
+
+        // print into a buffer so the terminal doesn't dominate
+        use_print_buf = 1;
+        buf_init(print_buf);
+
+        start = nanotime();
+        print_ast(ast, buf_len(ast));
+        t_print = nanotime() - start;
+        out_len = buf_len(print_buf);
+        buf_len(print_buf) = 0;
+
+        start = nanotime();
+        print_flat_ast(&flat);
+        t_print_flat = nanotime() - start;
+        assert(buf_len(print_buf) == out_len);
+
+        printf("flat:    print_ast %.1f ms, print_flat_ast %.1f ms\n",
+                t_print / 1e6, t_print_flat / 1e6);
+
+        use_print_buf = 0;
+        buf_free(print_buf);
+        flat_ast_free(&flat);
+        ast_free();
+        buf_free(ast);
+        release_src_file(text);
+        buf_free(text);
+        return 0;
+}
+
+
+// bench_parallel [files] [MB per file] [max threads]
+int bench_parallel(int argc, char **argv)
+{
+        size_t num_files = 64, size = 4 << 20, total = 0;
+        int max_threads = 32;
+        uint64_t start, elapsed, t_single = 0;
+        ParseJob *jobs;
+        Source *srcs;
+        Decl **decls;
+
+        if (argc > 1)
+                num_files = strtoul(argv[1], NULL, 0);
+        if (argc > 2)
+                size = strtoul(argv[2], NULL, 0) << 20;
+        if (argc > 3)
+                max_threads = atoi(argv[3]);
+
+        srcs = calloc(num_files, sizeof(Source));
+        jobs = calloc(num_files, sizeof(ParseJob));
+        for (size_t i = 0; i < num_files; i++) {
+                srcs[i].name = "<corpus>";
+                srcs[i].text = gen_corpus(size);
+                srcs[i].size = buf_len(srcs[i].text);
+                total += srcs[i].size;
+        }
+        printf("parallel: %zu files, %.1f MB, %d cpus\n",
+                num_files, total / 1e6, num_cpus());
+
+        for (int threads = 1; threads <= max_threads; threads *= 2) {
+                for (size_t i = 0; i < num_files; i++)
+                        jobs[i].src = srcs + i;
+
+                start = nanotime();
+                decls = parse_files(jobs, num_files, threads);
+                elapsed = nanotime() - start;
+                if (threads == 1)
+                        t_single = elapsed;
+
+                printf("parallel: %2d threads %8.1f MB/s  speedup %5.2f  %zu decls\n",
+                        threads, total / (elapsed / 1e3),
+                        (double) t_single / elapsed, buf__len(decls));
+                buf_free(decls);
+                free_parse_jobs(jobs, num_files);
+        }
+
+        for (size_t i = 0; i < num_files; i++)
+                buf_free(srcs[i].text);
+        free(srcs);
+        free(jobs);
+        return 0;
+}
+
+
+// the same file parsed without the cache, parsed and written to an
+// empty cache, and loaded from the cache
+int bench_ast_cache(int argc, char **argv)
+{
+        const char *modes[] = {"no cache", "cold", "warm"};
+        char dir[] = "/tmp/ion_cache_XXXXXX", *path = NULL, *text;
+        size_t size = 16 << 20, num_decls = 0;
+        uint64_t start, elapsed;
+        ParseJob job;
+        Source src;
+        struct dirent *e;
+        struct stat st;
+        DIR *d;
+
+        if (argc > 1)
+                size = strtoul(argv[1], NULL, 0) << 20;
+        if (mkdtemp(dir) == NULL) {
+                perror(dir);
+                return 1;
+        }
+        src.name = "<corpus>";
+        text = gen_corpus(size);
+        src.text = text;
+        src.size = buf_len(text);
+        src.mapped = 0;
+
+        for (int mode = 0; mode < 3; mode++) {
+                ast_cache_dir = mode ? dir : NULL;
+                job = (ParseJob) {.name = src.name, .src = &src};
+                start = nanotime();
+                parse_job(&job, 0);
+                elapsed = nanotime() - start;
+                assert(job.cached == (mode == 2));
+                assert(mode == 0 || buf_len(job.decls) == num_decls);
+                num_decls = buf_len(job.decls);
+                printf("cache:   %-8s %8.1f ms %8.1f MB/s  %zu decls\n", modes[mode],
+                        elapsed / 1e6, src.size / (elapsed / 1e3), num_decls);
+                free_parse_jobs(&job, 1);
+        }
+        ast_cache_dir = NULL;
+
+        buf_init(path);
+        d = opendir(dir);
+        while (d && (e = readdir(d)) != NULL) {
+                if (e->d_name[0] == '.')
+                        continue;
+                buf_len(path) = 0;
+                path = buf_printf(path, "%s/%s", dir, e->d_name);
+                if (stat(path, &st) == 0)
+                        printf("cache:   %s %.1f MB for %.1f MB of source\n",
+                                e->d_name, st.st_size / 1e6, src.size / 1e6);
+                unlink(path);
+        }
+        if (d)
+                closedir(d);
+        rmdir(dir);
+
+        buf_free(path);
+        release_src_file(text);
+        buf_free(text);
+        return 0;
+}
+
+
+// A package of units that resolves and checks without errors, get<k>
+// calls get<k-1>, so main reaches the first reachable units.
+static char *gen_package(size_t units, size_t reachable)
+{
+        char *text = NULL;
+
+        for (size_t k = 0; k < units; k++) {
+                text = buf_printf(text,
+                        "struct Node%zu { next: Node%zu*; val: int; data: int[4] }\n"
+                        "const K%zu = %zu\n"
+                        "func get%zu(n: Node%zu*): int {\n"
+                        "        total := 0\n"
+                        "        for (i := 0; i < n.val; i++) {\n"
+                        "                total += i * K%zu\n"
+                        "                n.data[i %% 4] = (total >> 1) + cast(int) (1.5 * i)\n"
+                        "        }\n",
+                        k, k, k, k, k, k, k);
+                if (k > 0)
+                        text = buf_printf(text, "        total += get%zu(cast(Node%zu*) n.next)\n",
+                                k - 1, k - 1);
+                text = buf_printf(text, "        return total\n}\n");
+        }
+        return buf_printf(text, "var node: Node%zu\nfunc main(): int { return get%zu(&node) }\n",
+                reachable - 1, reachable - 1);
+}
+
+
+// Lazy resolution pays for what main reaches, not for the package.
+// bench_resolve [units] [reachable]
+int bench_resolve(int argc, char **argv)
+{
+        size_t units = 100000, reachable = 100, errors = num_errors;
+        const char *modes[] = {"main", "all"};
+        uint64_t start, elapsed;
+        char *text;
+        Decl **ast;
+
+        if (argc > 1)
+                units = strtoul(argv[1], NULL, 0);
+        if (argc > 2)
+                reachable = strtoul(argv[2], NULL, 0);
+        if (reachable == 0 || reachable > units)
+                reachable = units;
+        text = gen_package(units, reachable);
+
+        // resolving keeps types in the AST, so each mode parses anew
+        for (int mode = 0; mode < 2; mode++) {
+                init_lex("<bench_resolve>", text);
+                ast = recursive_descent_parser();
+                init_resolver();
+                resolve_decls(ast, buf_len(ast));
+                start = nanotime();
+                if (mode == 0)
+                        resolve_entry("main");
+                else    resolve_all();
+                elapsed = nanotime() - start;
+                printf("resolve: %-4s %9.2f ms %8zu of %zu syms\n", modes[mode],
+                        elapsed / 1e6, buf__len(resolved_syms), buf_len(global_symbols));
+                ast_free();
+                buf_free(ast);
+        }
+        assert(num_errors == errors);
+
+        sym_reset_globals();
+        buf_free(resolved_syms);
+        release_src_file(text);
+        buf_free(text);
+        return 0;
+}
+
+
+// Cost of type checking per expression of a package where everything
+// is reachable.  bench_check [units]
+int bench_check(int argc, char **argv)
+{
+        size_t units = 100000, errors = num_errors, exprs;
+        uint64_t start, t_parse, t_resolve, t_check;
+        char *text;
+        Decl **ast;
+
+        if (argc > 1)
+                units = strtoul(argv[1], NULL, 0);
+        text = gen_package(units, units);
+
+        start = nanotime();
+        init_lex("<bench_check>", text);
+        ast = recursive_descent_parser();
+        t_parse = nanotime() - start;
+
+        init_resolver();
+        resolve_decls(ast, buf_len(ast));
+        start = nanotime();
+        resolve_entry("main");
+        t_resolve = nanotime() - start;
+
+        exprs = checked_exprs;
+        start = nanotime();
+        check_resolved();
+        t_check = nanotime() - start;
+        exprs = checked_exprs - exprs;
+        assert(num_errors == errors);
+
+        printf("check:   %.1f MB, parse %.2f ms, resolve %.2f ms, check %.2f ms\n",
+                buf_len(text) / 1e6, t_parse / 1e6, t_resolve / 1e6, t_check / 1e6);
+        printf("check:   %zu exprs, %.1f ns per expr, %zu bytes per expr node\n",
+                exprs, (double) t_check / exprs, sizeof(Expr));
+
+        sym_reset_globals();
+        buf_free(resolved_syms);
+        ast_free();
+        buf_free(ast);
+        release_src_file(text);
+        buf_free(text);
+        return 0;
+}
+
+
+// Cost of generating code for a package where everything is reachable,
+// per function and per line of source.  bench_codegen [units]
+int bench_codegen(int argc, char **argv)
+{
+        size_t units = 100000, errors = num_errors, lines = 0;
+        uint64_t start, t_front, t_codegen;
+        char *text;
+        Decl **ast;
+
+        if (argc > 1)
+                units = strtoul(argv[1], NULL, 0);
+        text = gen_package(units, units);
+        for (const char *c = text; *c; c++)
+                lines += *c == '\n';
+
+        start = nanotime();
+        init_lex("<bench_codegen>", text);
+        ast = recursive_descent_parser();
+        init_resolver();
+        resolve_decls(ast, buf_len(ast));
+        resolve_entry("main");
+        check_resolved();
+        t_front = nanotime() - start;
+        assert(num_errors == errors);
+
+        start = nanotime();
+        codegen_resolved();
+        t_codegen = nanotime() - start;
+        assert(num_errors == errors);
+
+        printf("codegen: %.1f MB, front end %.2f ms, codegen %.2f ms, %.1f MB of code\n",
+                buf_len(text) / 1e6, t_front / 1e6, t_codegen / 1e6, buf__len(x64_code) / 1e6);
+        printf("codegen: %zu functions, %.1f us per function, %.1f Mlines/s\n",
+                generated_funcs, t_codegen / 1e3 / generated_funcs, lines / (t_codegen / 1e3));
+
+        buf_free(x64_code);
+        sym_reset_globals();
+        buf_free(resolved_syms);
+        ast_free();
+        buf_free(ast);
+        release_src_file(text);
+        buf_free(text);
+        return 0;
+}
+
+
+typedef struct BenchStats {
+        double min, median, mean, stddev; // ms
+} BenchStats;
+
+
+static int cmp_u64(const void *a, const void *b)
+{
+        uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+        return (x > y) - (x < y);
+}
+
+
+// keeps the benchmarks free of libm
+static double bench_sqrt(double x)
+{
+        double r = x > 1 ? x : 1;
+
+        for (int i = 0; i < 64 && x > 0; i++)
+                r = (r + x / r) / 2;
+        return x > 0 ? r : 0;
+}
+
+
+static BenchStats bench_stats(uint64_t *ns, int n)
+{
+        BenchStats s = {0};
+        double d;
+
+        qsort(ns, n, sizeof(*ns), cmp_u64);
+        s.min = ns[0] / 1e6;
+        s.median = (n % 2 ? ns[n / 2] : (ns[n / 2 - 1] + ns[n / 2]) / 2) / 1e6;
+        for (int i = 0; i < n; i++)
+                s.mean += ns[i] / 1e6 / n;
+        for (int i = 0; i < n; i++) {
+                d = ns[i] / 1e6 - s.mean;
+                s.stddev += d * d / (n > 1 ? n - 1 : 1);
+        }
+        s.stddev = bench_sqrt(s.stddev);
+        return s;
+}
+
+
+enum { BENCH_LEX, BENCH_PARSE, BENCH_PRINT, NUM_BENCH_PHASES };
+
+const char *bench_phase_name[NUM_BENCH_PHASES] = {"lex", "parse", "print"};
+
+
+// bench_suite [size MB] [repetitions] [shape]
+// Lexes, parses and prints every corpus shape (see corpus.h) after a
+// warmup run.  Writes one JSON object per line for every shape and
+// phase to stdout and a summary to stderr.  Rates are taken from the
+// median.
+int bench_suite(int argc, char **argv)
+{
+        size_t size = 8 << 20, num_tokens = 0, num_nodes = 0;
+        int reps = 5, warmup = 1;
+        uint64_t seed = 1, start, *times[NUM_BENCH_PHASES];
+        CorpusShape first = 0, last = NUM_CORPUS_SHAPES - 1;
+        BenchStats st;
+        Decl **ast;
+        char *text;
+
+        if (argc > 1)
+                size = strtoul(argv[1], NULL, 0) << 20;
+        if (argc > 2)
+                reps = atoi(argv[2]) > 0 ? atoi(argv[2]) : 1;
+        for (CorpusShape shape = 0; argc > 3 && shape < NUM_CORPUS_SHAPES; shape++) {
+                if (strcmp(argv[3], corpus_shape_name[shape]) == 0)
+                        first = last = shape;
+        }
+        for (int p = 0; p < NUM_BENCH_PHASES; p++)
+                times[p] = malloc(reps * sizeof(uint64_t));
+        use_print_buf = 1;
+        buf_init(print_buf);
+
+        for (CorpusShape shape = first; shape <= last; shape++) {
+                text = gen_ion_corpus(shape, size, seed);
+
+                for (int rep = -warmup; rep < reps; rep++) {
+                        num_tokens = 0;
+                        start = nanotime();
+                        init_lex(corpus_shape_name[shape], text);
+                        while (token.kind != TOKEN_EOF) {
+                                next_token();
+                                num_tokens++;
+                        }
+                        if (rep >= 0)
+                                times[BENCH_LEX][rep] = nanotime() - start;
+
+                        start = nanotime();
+                        init_lex(corpus_shape_name[shape], text);
+                        ast = recursive_descent_parser();
+                        if (rep >= 0)
+                                times[BENCH_PARSE][rep] = nanotime() - start;
+                        num_nodes = ast_arena.num_allocs;
+
+                        buf_len(print_buf) = 0;
+                        start = nanotime();
+                        print_ast(ast, buf_len(ast));
+                        if (rep >= 0)
+                                times[BENCH_PRINT][rep] = nanotime() - start;
+
+                        ast_free();
+                        buf_free(ast);
+                }
+
+                for (int p = 0; p < NUM_BENCH_PHASES; p++) {
+                        st = bench_stats(times[p], reps);
+                        printf("{\"bench\":\"%s\",\"shape\":\"%s\",\"phase\":\"%s\","
+                                "\"simd\":\"%s\",\"seed\":%llu,\"bytes\":%zu,\"tokens\":%zu,"
+                                "\"nodes\":%zu,\"reps\":%d,\"warmup\":%d,\"min_ms\":%.3f,"
+                                "\"median_ms\":%.3f,\"mean_ms\":%.3f,\"stddev_ms\":%.3f,"
+                                "\"mb_per_s\":%.2f}\n",
+                                "frontend", corpus_shape_name[shape], bench_phase_name[p],
+                                lex_simd_name[lex_simd], (unsigned long long) seed,
+                                buf_len(text), num_tokens, num_nodes, reps, warmup,
+                                st.min, st.median, st.mean, st.stddev,
+                                buf_len(text) / (st.median * 1e3));
+                        fprintf(stderr, "suite:   %-10s %-6s %8.2f ms +- %6.2f  %7.1f MB/s\n",
+                                corpus_shape_name[shape], bench_phase_name[p],
+                                st.median, st.stddev, buf_len(text) / (st.median * 1e3));
+                }
+                release_src_file(text);
+                buf_free(text);
+        }
+
+        use_print_buf = 0;
+        buf_free(print_buf);
+        for (int p = 0; p < NUM_BENCH_PHASES; p++)
+                free(times[p]);
+        return 0;
+}
+
+#endif
@@ -0,0 +1,767 @@
+#ifndef ION_CHECK
+#define ION_CHECK
+
+// Type checks what the resolver reached.  Every expression gets its
+// type, whether it is an lvalue and, where it is constant, its value,
+// so later passes read them off the node.  Types are the canonical ones
+// of types.h, compared by pointer.  Conversions follow C: arithmetic
+// types convert to each other, arrays decay to pointers, void pointers
+// convert to and from other pointers and the constant 0 to any pointer.
+//
+// Expressions with errors get type_none, which converts to anything, so
+// an error is reported once rather than at every expression around it.
+// Names were reported by the resolver already.
+
+size_t checked_exprs; // for the benchmarks
+
+static Type *check_ret; // of the function being checked
+static int check_loops;
+static int check_switches;
+
+Type *check_expr(Expr *e);
+
+
+// appends the Ion spelling of a type to a stretchy buffer
+char *type_str(char *buf, Type *type)
+{
+        switch (type->kind) {
+        case TYPE_NONE:
+                return buf_printf(buf, "<error>");
+        case TYPE_PTR:
+                return buf_printf(type_str(buf, type->elem), "*");
+        case TYPE_ARRAY:
+                return buf_printf(type_str(buf, type->array.type), "[%zu]",
+                        type->array.length);
+        case TYPE_FUNC:
+                buf = buf_printf(buf, "func(");
+                for (size_t i = 0; i < type->func.num_args; i++) {
+                        buf = type_str(buf, type->func.args[i]);
+                        if (i + 1 < type->func.num_args)
+                                buf = buf_printf(buf, ", ");
+                }
+                return type_str(buf_printf(buf, "): "), type->func.ret);
+        default:
+                return buf_printf(buf, "%s", type->symbol ? type->symbol->name : "?");
+        }
+}
+
+
+// fmt takes the spellings of a and b
+static void log_type_error(SrcPos pos, const char *fmt, Type *a, Type *b)
+{
+        char *sa = type_str(NULL, a), *sb = b ? type_str(NULL, b) : NULL;
+
+        log_error_at(pos, fmt, sa, sb);
+        buf_free(sa);
+        buf_free(sb);
+}
+
+
+#define is_scalar(t) (is_arithmetic(t) || (t)->kind == TYPE_PTR || (t)->kind == TYPE_FUNC)
+#define is_null(e) ((e)->is_const && is_integer((e)->type) && (e)->const_val == 0)
+
+
+static Type *decay(Type *type)
+{
+        if (type->kind == TYPE_ARRAY)
+                return type_ptr(type->array.type);
+        return type;
+}
+
+
+static char convertible(Type *to, Expr *e)
+{
+        Type *from = decay(e->type);
+
+        if (to == from || to == type_none || from == type_none)
+                return 1;
+        if (is_arithmetic(to) && is_arithmetic(from))
+                return 1;
+        if (to->kind == TYPE_PTR && from->kind == TYPE_PTR)
+                return to->elem == type_void || from->elem == type_void;
+        return to->kind == TYPE_PTR && is_null(e);
+}
+
+
+// reports and returns 0 if e doesn't convert to type
+static char check_convert(Type *to, Expr *e, const char *what)
+{
+        char *msg = NULL;
+
+        if (convertible(to, e))
+                return 1;
+        msg = buf_printf(msg, "cannot convert %%s to %%s in %s", what);
+        log_type_error(e->pos, msg, e->type, to);
+        buf_free(msg);
+        return 0;
+}
+
+
+static Type *set_operand(Expr *e, Type *type, char is_lvalue)
+{
+        e->type = type;
+        e->is_lvalue = is_lvalue;
+        return type;
+}
+
+
+// keeps the value of an expression whose operands are all constant,
+// converted to its type so integers are wrapped and extended to it
+static void set_const(Expr *e)
+{
+        Val v;
+
+        if (    e->type == type_none || !is_arithmetic(e->type) || !eval_const(e, &v) ||
+                !convert_val(e, &v, e->type)) {
+                        return;
+        }
+        e->is_const = 1;
+        if (is_float_val(&v))
+                e->const_float = v.float_val;
+        else    e->const_val = v.int_val;
+}
+
+
+// globals are typed with their initializer where they have no type
+static void check_global_var(Sym *sym)
+{
+        Decl *decl = sym->decl;
+        Expr *init = decl->var.expr;
+        Scope *locals;
+
+        if (init == NULL || init->type)
+                return;
+        locals = sym_hide_locals();
+        if (sym->type == NULL) {
+                sym->type = type_none; // for initializers using the variable
+                sym->type = decay(check_expr(init));
+                if (sym->type == type_void) {
+                        log_error_at(init->pos, "%s initialized with no value", sym->name);
+                        sym->type = type_none;
+                }
+        } else if (check_expr(init) != type_none) {
+                check_convert(sym->type, init, "initializer");
+        }
+        sym_show_locals(locals);
+}
+
+
+static Type *check_name(Expr *e)
+{
+        Sym *sym = sym_get(e->name);
+
+        if (sym == NULL)
+                return set_operand(e, type_none, 0);
+        switch (sym->kind) {
+        case SYM_VAR:
+                if (sym->type == NULL && sym->decl)
+                        check_global_var(sym);
+                return set_operand(e, sym->type ? sym->type : type_none, 1);
+        case SYM_CONST:
+        case SYM_ENUM_CONST:
+                if (sym->type == NULL)
+                        return set_operand(e, type_none, 0);
+                e->is_const = 1;
+                if (sym->type->kind == TYPE_FLOAT)
+                        e->const_float = sym->float_val;
+                else    e->const_val = sym->val;
+                return set_operand(e, sym->type, 0);
+        case SYM_FUNC:
+                return set_operand(e, sym->type, 0);
+        default:
+                log_error_at(e->pos, "type %s used as a value", e->name);
+                return set_operand(e, type_none, 0);
+        }
+}
+
+
+static Type *check_call(Expr *e)
+{
+        Type *type = check_expr(e->call.expr), *param;
+
+        for (size_t i = 0; i < e->call.num_args; i++)
+                check_expr(e->call.args[i]);
+        if (type->kind == TYPE_PTR && type->elem->kind == TYPE_FUNC)
+                type = type->elem;
+        if (type == type_none)
+                return set_operand(e, type_none, 0);
+        if (type->kind != TYPE_FUNC) {
+                log_type_error(e->pos, "calling %s, not a function", type, NULL);
+                return set_operand(e, type_none, 0);
+        }
+        if (e->call.num_args != type->func.num_args) {
+                log_error_at(e->pos, "%zu arguments where %zu are expected",
+                        e->call.num_args, type->func.num_args);
+        } else {
+                for (size_t i = 0; i < e->call.num_args; i++) {
+                        param = type->func.args[i];
+                        check_convert(param, e->call.args[i], "argument");
+                }
+        }
+        return set_operand(e, type->func.ret, 0);
+}
+
+
+static Type *check_index(Expr *e)
+{
+        Type *type = decay(check_expr(e->index.oexpr));
+        Type *index = check_expr(e->index.iexpr);
+
+        if (type == type_none || index == type_none)
+                return set_operand(e, type_none, 1);
+        if (!is_integer(index)) {
+                log_type_error(e->index.iexpr->pos, "index of type %s", index, NULL);
+                return set_operand(e, type_none, 1);
+        }
+        if (type->kind != TYPE_PTR || type->elem == type_void) {
+                log_type_error(e->pos, "indexing %s", type, NULL);
+                return set_operand(e, type_none, 1);
+        }
+        return set_operand(e, type->elem, 1);
+}
+
+
+// . works on structs and on pointers to them
+static Type *check_field(Expr *e)
+{
+        Type *type = check_expr(e->field.expr);
+        char is_lvalue = e->field.expr->is_lvalue;
+        size_t i;
+
+        if (type->kind == TYPE_PTR) {
+                type = type->elem;
+                is_lvalue = 1;
+        }
+        if (type == type_none)
+                return set_operand(e, type_none, is_lvalue);
+        complete_type(type, e->pos);
+        if (type->kind != TYPE_STRUCT && type->kind != TYPE_UNION) {
+                log_type_error(e->pos, "%s has no fields", type, NULL);
+                return set_operand(e, type_none, is_lvalue);
+        }
+        i = field_index(type, e->field.name);
+        if (i == NO_FIELD) {
+                log_error_at(e->pos, "no field %s in %s", e->field.name, type->symbol->name);
+                return set_operand(e, type_none, is_lvalue);
+        }
+        return set_operand(e, type->bucket.types[i], is_lvalue);
+}
+
+
+static Type *check_unary(Expr *e)
+{
+        Expr *operand = e->unary.expr;
+        Type *type = check_expr(operand);
+
+        if (type == type_none)
+                return set_operand(e, type_none, e->unary.op == TOKEN_MUL);
+        switch (e->unary.op) {
+        case TOKEN_MUL:
+                type = decay(type);
+                if (type->kind != TYPE_PTR || type->elem == type_void) {
+                        log_type_error(e->pos, "dereferencing %s", type, NULL);
+                        return set_operand(e, type_none, 1);
+                }
+                return set_operand(e, type->elem, 1);
+        case TOKEN_AND:
+                if (!operand->is_lvalue && type->kind != TYPE_FUNC) {
+                        log_error_at(e->pos, "taking the address of a value");
+                        return set_operand(e, type_none, 0);
+                }
+                return set_operand(e, type_ptr(type), 0);
+        case TOKEN_INC:
+        case TOKEN_DEC:
+                if (!operand->is_lvalue)
+                        log_error_at(e->pos, "%s of a value", e->unary.op == TOKEN_INC ? "++" : "--");
+                else if (!is_arithmetic(type) && type->kind != TYPE_PTR)
+                        log_type_error(e->pos, "incrementing %s", type, NULL);
+                return set_operand(e, type, 0);
+        case TOKEN_NOT:
+                if (!is_scalar(decay(type)))
+                        log_type_error(e->pos, "! of %s", type, NULL);
+                set_operand(e, type_int, 0);
+                break;
+        case TOKEN_NEG:
+                if (!is_integer(type)) {
+                        log_type_error(e->pos, "~ of %s", type, NULL);
+                        return set_operand(e, type_none, 0);
+                }
+                set_operand(e, promote(type), 0);
+                break;
+        default:
+                if (!is_arithmetic(type)) {
+                        log_type_error(e->pos, "sign of %s", type, NULL);
+                        return set_operand(e, type_none, 0);
+                }
+                set_operand(e, promote(type), 0);
+        }
+        if (operand->is_const)
+                set_const(e);
+        return e->type;
+}
+
+
+static Type *check_assign(Expr *e, Type *left, Type *right)
+{
+        Expr *dest = e->binary.left;
+        TokenKind op = e->binary.op;
+
+        if (!dest->is_lvalue || left->kind == TYPE_ARRAY) {
+                log_error_at(e->pos, "assigning to a value");
+                return set_operand(e, type_none, 0);
+        }
+        if (left == type_none || right == type_none)
+                return set_operand(e, left, 0);
+        switch (op) {
+        case TOKEN_ASSIGN:
+                check_convert(left, e->binary.right, "assignment");
+                break;
+        case TOKEN_ADD_ASSIGN:
+        case TOKEN_SUB_ASSIGN:
+                if (left->kind == TYPE_PTR && is_integer(right))
+                        break;
+                // fall through
+        case TOKEN_MUL_ASSIGN:
+        case TOKEN_DIV_ASSIGN:
+                if (!is_arithmetic(left) || !is_arithmetic(decay(right)))
+                        log_type_error(e->pos, "arithmetic on %s and %s", left, right);
+                break;
+        default:
+                if (!is_integer(left) || !is_integer(right))
+                        log_type_error(e->pos, "integer operator on %s and %s", left, right);
+        }
+        return set_operand(e, left, 0);
+}
+
+
+static Type *check_binary(Expr *e)
+{
+        Expr *l = e->binary.left, *r = e->binary.right;
+        Type *right, *left, *type = type_none;
+
+        right = check_expr(r);
+        if (e->binary.op == TOKEN_COLON_ASSIGN) {
+                // the resolver checked the name is a fresh local
+                type = decay(right);
+                if (type == type_void) {
+                        log_error_at(r->pos, "%s initialized with no value", l->name);
+                        type = type_none;
+                }
+                set_operand(l, type, 1);
+                sym_push(l->name, type);
+                return set_operand(e, type, 0);
+        }
+        left = check_expr(l);
+        if (e->binary.op >= TOKEN_ASSIGN && e->binary.op <= TOKEN_OR_ASSIGN)
+                return check_assign(e, left, right);
+        left = decay(left);
+        right = decay(right);
+        if (left == type_none || right == type_none)
+                return set_operand(e, type_none, 0);
+
+        switch (e->binary.op) {
+        case TOKEN_ADD:
+        case TOKEN_SUB:
+                if (left->kind == TYPE_PTR && is_integer(right)) {
+                        type = left;
+                        break;
+                }
+                if (e->binary.op == TOKEN_ADD && is_integer(left) && right->kind == TYPE_PTR) {
+                        type = right;
+                        break;
+                }
+                if (e->binary.op == TOKEN_SUB && left->kind == TYPE_PTR && left == right) {
+                        type = type_int64;
+                        break;
+                }
+                // fall through
+        case TOKEN_MUL:
+        case TOKEN_DIV:
+                if (is_arithmetic(left) && is_arithmetic(right))
+                        type = arith_type(left, right);
+                break;
+        case TOKEN_MOD:
+        case TOKEN_AND:
+        case TOKEN_OR:
+        case TOKEN_XOR:
+                if (is_integer(left) && is_integer(right))
+                        type = arith_type(left, right);
+                break;
+        case TOKEN_LSHIFT:
+        case TOKEN_RSHIFT:
+                if (is_integer(left) && is_integer(right))
+                        type = promote(left);
+                break;
+        case TOKEN_EQ:
+        case TOKEN_NEQ:
+        case TOKEN_LT:
+        case TOKEN_GT:
+        case TOKEN_LTEQ:
+        case TOKEN_GTEQ:
+                if (    (is_arithmetic(left) && is_arithmetic(right)) ||
+                        (left->kind == TYPE_PTR && convertible(left, r)) ||
+                        (right->kind == TYPE_PTR && convertible(right, l)) ||
+                        (left->kind == TYPE_FUNC && left == right)) {
+                                type = type_int;
+                }
+                break;
+        case TOKEN_LOGICAL_AND:
+        case TOKEN_LOGICAL_OR:
+                if (is_scalar(left) && is_scalar(right))
+                        type = type_int;
+                break;
+        default:
+                assert(0);
+        }
+        if (type == type_none) {
+                log_type_error(e->pos, "operands of types %s and %s", left, right);
+                return set_operand(e, type_none, 0);
+        }
+        set_operand(e, type, 0);
+        if (l->is_const && r->is_const)
+                set_const(e);
+        return type;
+}
+
+
+static Type *check_ternary(Expr *e)
+{
+        Type *cond = decay(check_expr(e->ternary.cond));
+        Type *a = decay(check_expr(e->ternary.expr));
+        Type *b = decay(check_expr(e->ternary.or_expr));
+        Type *type = type_none;
+
+        if (cond == type_none || a == type_none || b == type_none)
+                return set_operand(e, type_none, 0);
+        if (!is_scalar(cond))
+                log_type_error(e->ternary.cond->pos, "condition of type %s", cond, NULL);
+        if (is_arithmetic(a) && is_arithmetic(b))
+                type = arith_type(a, b);
+        else if (a == b)
+                type = a;
+        else if (a->kind == TYPE_PTR && convertible(a, e->ternary.or_expr))
+                type = a;
+        else if (b->kind == TYPE_PTR && convertible(b, e->ternary.expr))
+                type = b;
+        else    log_type_error(e->pos, "branches of types %s and %s", a, b);
+        set_operand(e, type, 0);
+        if (e->ternary.cond->is_const && e->ternary.expr->is_const &&
+                e->ternary.or_expr->is_const)
+                        set_const(e);
+        return type;
+}
+
+
+static Type *check_cast(Expr *e)
+{
+        Type *to = e->cast.type->type, *from = decay(check_expr(e->cast.expr));
+
+        if (to == NULL || from == type_none)
+                return set_operand(e, to ? to : type_none, 0);
+        if (    to->kind != TYPE_VOID &&
+                !(is_arithmetic(to) && is_arithmetic(from)) &&
+                !(to->kind == TYPE_PTR && (from->kind == TYPE_PTR || is_integer(from))) &&
+                !(is_integer(to) && from->kind == TYPE_PTR) &&
+                !(to->kind == TYPE_FUNC && (from->kind == TYPE_PTR || from == to))) {
+                        log_type_error(e->pos, "cast from %s to %s", from, to);
+                        return set_operand(e, type_none, 0);
+        }
+        set_operand(e, to, 0);
+        if (e->cast.expr->is_const)
+                set_const(e);
+        return to;
+}
+
+
+static Type *check_sizeof(Expr *e, Type *type)
+{
+        if (type == type_none)
+                return set_operand(e, type_none, 0);
+        complete_type(type, e->pos);
+        if (type->kind == TYPE_VOID || type->kind == TYPE_FUNC) {
+                log_type_error(e->pos, "sizeof of %s", type, NULL);
+                return set_operand(e, type_none, 0);
+        }
+        e->is_const = 1;
+        e->const_val = type->size;
+        return set_operand(e, type_size_t, 0);
+}
+
+
+// the type of e, also kept in e->type
+Type *check_expr(Expr *e)
+{
+        checked_exprs++;
+        switch (e->kind) {
+        case EXPR_NAME:
+                return check_name(e);
+        case EXPR_INT:
+                e->is_const = 1;
+                e->const_val = e->int_val;
+                return set_operand(e, e->int_val >= INT32_MIN && e->int_val <= INT32_MAX ?
+                        type_int : type_int64, 0);
+        case EXPR_FLOAT:
+                e->is_const = 1;
+                e->const_float = e->float_val;
+                return set_operand(e, type_double, 0);
+        case EXPR_STR:
+                return set_operand(e, type_ptr(type_char), 0);
+        case EXPR_CAST:
+                return check_cast(e);
+        case EXPR_CALL:
+                return check_call(e);
+        case EXPR_INDEX:
+                return check_index(e);
+        case EXPR_FIELD:
+                return check_field(e);
+        case EXPR_UNARY:
+                return check_unary(e);
+        case EXPR_BINARY:
+                return check_binary(e);
+        case EXPR_TERNARY:
+                return check_ternary(e);
+        case EXPR_SIZEOF:
+                return check_sizeof(e, check_expr(e->sizeof_expr));
+        case EXPR_SIZEOF_TYPE:
+                return check_sizeof(e, e->sizeof_type->type ? e->sizeof_type->type : type_none);
+        default:
+                assert(0);
+                return type_none;
+        }
+}
+
+
+static void check_cond(Expr *e)
+{
+        Type *type = decay(check_expr(e));
+
+        if (type != type_none && !is_scalar(type))
+                log_type_error(e->pos, "condition of type %s", type, NULL);
+}
+
+
+static void check_stmt(Stmt *s)
+{
+        SwitchCase *c;
+        Type *type;
+        size_t depth;
+
+        if (s == NULL)
+                return;
+        switch (s->kind) {
+        case STMT_BREAK:
+                if (check_loops == 0 && check_switches == 0)
+                        log_error_at(s->pos, "break outside of a loop or switch");
+                break;
+        case STMT_CONTINUE:
+                if (check_loops == 0)
+                        log_error_at(s->pos, "continue outside of a loop");
+                break;
+        case STMT_RETURN:
+                if (s->expr == NULL) {
+                        if (check_ret != type_void)
+                                log_error_at(s->pos, "return without a value");
+                } else if (check_expr(s->expr) != type_none) {
+                        if (check_ret == type_void)
+                                log_error_at(s->pos, "return with a value in a void function");
+                        else    check_convert(check_ret, s->expr, "return");
+                }
+                break;
+        case STMT_EXPR:
+                check_expr(s->expr);
+                break;
+        case STMT_IF:
+                check_cond(s->if_stmt.cond);
+                check_stmt(s->if_stmt.body);
+                check_stmt(s->if_stmt.other);
+                break;
+        case STMT_WHILE:
+        case STMT_DO_WHILE:
+                check_cond(s->while_stmt.cond);
+                check_loops++;
+                check_stmt(s->while_stmt.body);
+                check_loops--;
+                break;
+        case STMT_FOR:
+                depth = sym_enter();
+                if (s->for_stmt.init)
+                        check_expr(s->for_stmt.init);
+                if (s->for_stmt.cond)
+                        check_cond(s->for_stmt.cond);
+                if (s->for_stmt.step)
+                        check_expr(s->for_stmt.step);
+                check_loops++;
+                check_stmt(s->for_stmt.body);
+                check_loops--;
+                sym_leave(depth);
+                break;
+        case STMT_SWITCH:
+                type = check_expr(s->switch_stmt.expr);
+                if (type != type_none && !is_integer(type))
+                        log_type_error(s->switch_stmt.expr->pos, "switch on %s", type, NULL);
+                depth = sym_enter();
+                check_switches++;
+                for (size_t i = 0; i < s->switch_stmt.num_cases; i++) {
+                        c = s->switch_stmt.cases[i];
+                        if (c->expr && check_expr(c->expr) != type_none &&
+                                (!c->expr->is_const || !is_integer(c->expr->type)))
+                                        log_error_at(c->expr->pos, "case is not an integer constant");
+                        check_stmt(c->stmt);
+                }
+                check_switches--;
+                sym_leave(depth);
+                break;
+        case STMT_BLOCK:
+                depth = sym_enter();
+                for (size_t i = 0; i < s->block.num_stmt; i++)
+                        check_stmt(s->block.stmt[i]);
+                sym_leave(depth);
+                break;
+        default:
+                assert(0);
+        }
+}
+
+
+static void check_func(Sym *sym)
+{
+        FuncDecl *f = sym->decl->func.decl;
+        uint64_t start = trace_begin();
+        size_t depth;
+
+        check_ret = sym->type->func.ret;
+        check_loops = check_switches = 0;
+        depth = sym_enter();
+        for (size_t i = 0; i < f->num_args; i++)
+                sym_push(f->args[i], sym->type->func.args[i]);
+        check_stmt(sym->decl->func.body);
+        sym_leave(depth);
+        trace_end(start, "check", sym->name);
+}
+
+
+// Checks every function, global and constant resolved so far, run
+// after resolve_entry or resolve_all.
+void check_resolved(void)
+{
+        Sym *sym;
+
+        for (size_t i = 0; i < buf__len(resolved_syms); i++) {
+                sym = resolved_syms[i];
+                if (sym->decl == NULL)
+                        continue;
+                switch (sym->kind) {
+                case SYM_VAR:
+                        check_global_var(sym);
+                        break;
+                case SYM_CONST:
+                        if (sym->decl->var.expr->type == NULL)
+                                check_expr(sym->decl->var.expr);
+                        break;
+                case SYM_FUNC:
+                        check_func(sym);
+                        break;
+                default:
+                        break;
+                }
+        }
+}
+
+
+static Expr *check_test_expr(Decl **ast, size_t decl, size_t stmt)
+{
+        Stmt *s = ast[decl]->func.body->block.stmt[stmt];
+
+        return s->expr;
+}
+
+
+void check_test()
+{
+        size_t errors = num_errors;
+        const char *errors_source[] = {
+                "func f(): int { return \"s\" }\n",
+                "func f() { return 1 }\n",
+                "func f(): int { x := 1; x.y = 2; return x }\n",
+                "func f(a: int*): int { return a + a }\n",
+                "func f(): int { return f(1) }\n",
+                "func f(): int { break; return 0 }\n",
+                "struct S { a: int }\nfunc f(s: S): int { return s.b }\n",
+                "func f(a: int) { 1 = a }\n",
+                "func f(a: int) { switch (a) { case a: break } }\n",
+                "func f(a: float*) { a[1.5] = 0 }\n",
+                "func f(): int { return *2 }\n",
+        };
+        Type *s_type;
+        Decl **ast;
+        Expr *e;
+
+        num_errors = 0;
+        ast = parse_resolve_test(
+                "struct S { a: char; next: S*; arr: int[4] }\n"
+                "const N = 10\n"
+                "var g = N * 2.5\n"
+                "var p: S*\n"
+                "func f(s: S*, n: int, c: char, u: uint32_t): int {\n"
+                "        x := s.next.arr[2]\n"
+                "        y := c + c\n"
+                "        z := u + 1\n"
+                "        w := &s.arr\n"
+                "        q := g + n\n"
+                "        r := cast(char) 300\n"
+                "        t := sizeof(s.arr)\n"
+                "        v := n ? s : 0\n"
+                "        a := (cast(uint32_t) 1) - 2\n"
+                "        b := (cast(uint64_t) -1) >> 60\n"
+                "        for (i := 0; i < N; i++) { s.a = x }\n"
+                "        return f(p, N, c == 0, 2)\n"
+                "}\n");
+        assert(num_errors == 0);
+        resolve_entry("f");
+        check_resolved();
+        assert(num_errors == 0);
+
+        s_type = ((Sym *) map_get(&global_symbols_map, str_intern("S")))->type;
+        e = check_test_expr(ast, 4, 0);
+        assert(e->type == type_int && e->binary.right->is_lvalue);
+        assert(e->binary.right->index.oexpr->type == type_array(type_int, 4));
+        assert(check_test_expr(ast, 4, 1)->type == type_int);
+        assert(check_test_expr(ast, 4, 2)->type ==
+                ((Sym *) map_get(&global_symbols_map, str_intern("uint32_t")))->type);
+        assert(check_test_expr(ast, 4, 3)->type == type_ptr(type_array(type_int, 4)));
+        assert(check_test_expr(ast, 4, 4)->type == type_double);
+        e = check_test_expr(ast, 4, 5);
+        assert(e->type == type_char && e->binary.right->is_const);
+        assert(e->binary.right->const_val == 44);
+        e = check_test_expr(ast, 4, 6)->binary.right;
+        assert(e->type == type_size_t && e->is_const && e->const_val == 16);
+        assert(check_test_expr(ast, 4, 7)->type == type_ptr(s_type));
+        e = check_test_expr(ast, 4, 8)->binary.right;
+        assert(e->type->is_unsigned && e->is_const && e->const_val == 0xffffffff);
+        e = check_test_expr(ast, 4, 9)->binary.right;
+        assert(e->type->is_unsigned && e->is_const && e->const_val == 15);
+        assert(((Sym *) map_get(&global_symbols_map, str_intern("g")))->type == type_double);
+        assert(s_type->kind == TYPE_STRUCT);
+
+        ast_free();
+        buf_free(ast);
+        quiet_errors = 1;
+        for (size_t i = 0; i < sizeof(errors_source) / sizeof(*errors_source); i++) {
+                num_errors = 0;
+                ast = parse_resolve_test(errors_source[i]);
+                resolve_all();
+                check_resolved();
+                assert(num_errors == 1);
+                ast_free();
+                buf_free(ast);
+        }
+        quiet_errors = 0;
+
+        buf_free(resolved_syms);
+        sym_reset_globals();
+        num_errors = errors;
+}
+
+#undef is_null
+
+#endif
@@ -0,0 +1,1513 @@
+#ifndef ION_CODEGEN
+#define ION_CODEGEN
+
+// Generates x86-64 code for what the checker typed, in one pass over
+// each function and in the manner of Wirth's compilers: no IR and no
+// register allocation, every expression leaves its value in rax, or in
+// xmm0 if it is a float, and the left operand of a binary operator is
+// pushed while the right one is computed.  Constants and locals that
+// need no code of their own are used as immediates and [rbp + disp]
+// operands directly, conditions compile to jumps rather than values.
+// Values of structs, unions and arrays are their addresses.
+//
+// Integers narrower than int are kept extended to 32 bits and computed
+// at 32 bits, like int, 8 byte integers and pointers at 64 bits.
+// Functions follow the System V calling convention for up to 6 integer
+// and 8 float arguments, so C can call them, though not with structs.
+//
+// Locals live in the frame below rbp and globals in a block of memory
+// allocated before code is generated, the offset of either is kept in
+// Sym.val.  Calls, function addresses and string literals are rip
+// relative, string literals follow the code.  Jumps to code not yet
+// generated are patched once it is.
+
+uint8_t *cg_data; // the globals
+size_t cg_data_size;
+size_t generated_funcs; // for the benchmarks
+
+typedef struct Loc { // memory at [base + disp]
+        int base;
+        int32_t disp;
+} Loc;
+
+typedef struct CodeFixup { // a rel32 to the function or string literal
+        size_t at;
+        Sym *func;
+        const char *str;
+} CodeFixup;
+
+static CodeFixup *cg_fixups;
+static Type *cg_ret; // of the function being generated
+static Stmt *cg_tail_return; // the return ending it, which needs no jump
+static size_t cg_frame, cg_frame_max; // bytes of locals
+static int cg_pushed; // 8 byte slots pushed below the locals
+static size_t *cg_returns, *cg_breaks, *cg_continues; // jumps to patch
+
+static const int int_arg_regs[] = {RDI, RSI, RDX, RCX, R8, R9};
+enum {
+        NUM_INT_ARG_REGS = 6,
+        NUM_FLOAT_ARG_REGS = 8,
+        ADDR_REG = RSI, // keeps an address while a value is computed
+};
+
+static void cg_expr(Expr *e);
+static void cg_stmt(Stmt *s);
+
+
+#define is_float_type(t) ((t)->kind == TYPE_FLOAT)
+#define is_aggregate(t) ((t)->kind == TYPE_STRUCT || (t)->kind == TYPE_UNION || (t)->kind == TYPE_ARRAY)
+#define is_unsigned_type(t) ((t)->is_unsigned || (t)->kind == TYPE_PTR || (t)->kind == TYPE_FUNC)
+
+// bytes of a value in a register, aggregates and functions are addresses
+#define val_size(t) (is_aggregate(t) || (t)->kind == TYPE_FUNC ? 8 : (int) (t)->size)
+
+// bytes integers of the type are computed at
+#define op_size(t) (val_size(t) == 8 ? 8 : 4)
+
+#define const_truth(e) (is_float_type((e)->type) ? (e)->const_float != 0 : (e)->const_val != 0)
+
+
+static void patch_here(size_t *jumps)
+{
+        for (size_t i = 0; i < buf__len(jumps); i++)
+                x64_patch(jumps[i], x64_pos());
+}
+
+
+static void cg_unsupported(SrcPos pos, const char *what)
+{
+        log_error_at(pos, "%s not supported by the code generator", what);
+}
+
+
+// a frame slot for a local of the type
+static int32_t cg_alloc(Type *type)
+{
+        size_t align = type->align ? type->align : 1;
+
+        cg_frame = ALIGN_UP(cg_frame + type->size, align);
+        if (cg_frame > cg_frame_max)
+                cg_frame_max = cg_frame;
+        return -(int32_t) cg_frame;
+}
+
+
+static void cg_push(Type *type)
+{
+        if (is_float_type(type)) {
+                x64_alu_ri(ALU_SUB, 8, RSP, 8);
+                x64_sse_store(type->size, XMM0, RSP, 0);
+        } else {
+                x64_push(RAX);
+        }
+        cg_pushed++;
+}
+
+
+// into reg, an xmm register for floats
+static void cg_pop(Type *type, int reg)
+{
+        if (is_float_type(type)) {
+                x64_sse_load(type->size, reg, RSP, 0);
+                x64_alu_ri(ALU_ADD, 8, RSP, 8);
+        } else {
+                x64_pop(reg);
+        }
+        cg_pushed--;
+}
+
+
+static void cg_load(Type *type, Loc loc)
+{
+        if (is_float_type(type))
+                x64_sse_load(type->size, XMM0, loc.base, loc.disp);
+        else if (is_aggregate(type) && (loc.base != RAX || loc.disp))
+                x64_lea(RAX, loc.base, loc.disp);
+        else if (!is_aggregate(type))
+                x64_load(val_size(type), is_unsigned_type(type), RAX, loc.base, loc.disp);
+}
+
+
+// stores reg, an xmm register for floats, aggregates are copied from
+// the address in reg
+static void cg_store(Type *type, int reg, Loc loc)
+{
+        if (is_float_type(type)) {
+                x64_sse_store(type->size, reg, loc.base, loc.disp);
+        } else if (is_aggregate(type)) {
+                x64_lea(RDI, loc.base, loc.disp);
+                if (reg != RSI)
+                        x64_mov_rr(8, RSI, reg);
+                x64_mov_ri(RCX, type->size);
+                x64_rep_movsb();
+        } else {
+                x64_store(val_size(type), reg, loc.base, loc.disp);
+        }
+}
+
+
+// Converts the integer or pointer in reg, keeping narrow integers
+// extended to 32 bits.
+static void convert_int(Type *from, Type *to, int reg)
+{
+        int fs = val_size(from), ts = val_size(to);
+
+        if (ts == 8 && fs < 8)
+                x64_extend(8, 4, fs == 4 && is_unsigned_type(from), reg, reg);
+        else if (ts < 4 && (ts < fs || is_unsigned_type(to) != is_unsigned_type(from)))
+                x64_extend(4, ts, is_unsigned_type(to), reg, reg);
+}
+
+
+// converts the value in rax or xmm0 to the type, as C does
+static void cg_convert(Type *from, Type *to)
+{
+        from = decay(from);
+        if (from == to || to->kind == TYPE_VOID)
+                return;
+        if (is_float_type(from) && is_float_type(to)) {
+                if (from->size != to->size)
+                        x64_cvt_float(to->size, XMM0, XMM0);
+        } else if (is_float_type(from)) {
+                // unsigned 32 bit results need the 64 bit form
+                x64_cvt_to_int(from->size, val_size(to) == 8 || is_unsigned_type(to) ? 8 : 4,
+                        RAX, XMM0);
+                if (val_size(to) < 4)
+                        x64_extend(4, val_size(to), is_unsigned_type(to), RAX, RAX);
+        } else if (is_float_type(to)) {
+                // unsigned 64 bit values past INT64_MAX come out negative
+                if (val_size(from) == 4 && is_unsigned_type(from))
+                        x64_extend(8, 4, 1, RAX, RAX);
+                x64_cvt_from_int(to->size, val_size(from) == 8 ||
+                        (val_size(from) == 4 && is_unsigned_type(from)) ? 8 : 4, XMM0, RAX);
+        } else {
+                convert_int(from, to, RAX);
+        }
+}
+
+
+static void cg_float_const(Type *type, double val)
+{
+        float f = val;
+        uint32_t bits32;
+        uint64_t bits;
+
+        if (type->size == 4) {
+                memcpy(&bits32, &f, 4);
+                x64_mov_ri(RAX, bits32);
+        } else {
+                memcpy(&bits, &val, 8);
+                x64_mov_ri(RAX, bits);
+        }
+        x64_movq_to_xmm(XMM0, RAX);
+}
+
+
+static void cg_const(Expr *e)
+{
+        if (is_float_type(e->type))
+                cg_float_const(e->type, e->const_float);
+        else if (val_size(e->type) == 8)
+                x64_mov_ri(RAX, e->const_val);
+        else    x64_mov_ri(RAX, (uint32_t) e->const_val);
+}
+
+
+static Loc var_loc(Sym *sym)
+{
+        if (sym->decl == NULL)
+                return (Loc) {RBP, sym->val};
+        x64_mov_ri(RAX, (intptr_t) (cg_data + sym->val));
+        return (Loc) {RAX, 0};
+}
+
+
+static int32_t field_offset(Type *type, const char *name)
+{
+        return type->bucket.offsets[field_index(type, name)];
+}
+
+
+// The location of e if it takes no code, for locals and fields and
+// constant indexes of them.
+static char static_addr(Expr *e, Loc *loc)
+{
+        Type *type;
+        Sym *sym;
+
+        switch (e->kind) {
+        case EXPR_NAME:
+                sym = sym_get(e->name);
+                if (sym->kind != SYM_VAR || sym->decl)
+                        return 0;
+                *loc = (Loc) {RBP, sym->val};
+                return 1;
+        case EXPR_FIELD:
+                type = e->field.expr->type;
+                if (type->kind == TYPE_PTR || !static_addr(e->field.expr, loc))
+                        return 0;
+                loc->disp += field_offset(type, e->field.name);
+                return 1;
+        case EXPR_INDEX:
+                type = e->index.oexpr->type;
+                if (    type->kind != TYPE_ARRAY || !e->index.iexpr->is_const ||
+                        !static_addr(e->index.oexpr, loc)) {
+                                return 0;
+                }
+                loc->disp += e->index.iexpr->const_val * type->array.type->size;
+                return 1;
+        default:
+                return 0;
+        }
+}
+
+
+// Leaves an integer constant or a local in reg without touching rax,
+// returns 0 for anything else.
+static char cg_leaf(Expr *e, int reg, Type *type)
+{
+        Sym *sym;
+
+        if (is_float_type(e->type) || is_float_type(type) || is_aggregate(e->type))
+                return 0;
+        if (e->is_const) {
+                x64_mov_ri(reg, val_size(type) == 8 ? e->const_val : (uint32_t) e->const_val);
+                return 1;
+        }
+        if (e->kind != EXPR_NAME)
+                return 0;
+        sym = sym_get(e->name);
+        if (sym->kind != SYM_VAR || sym->decl)
+                return 0;
+        x64_load(val_size(e->type), is_unsigned_type(e->type), reg, RBP, sym->val);
+        convert_int(e->type, type, reg);
+        return 1;
+}
+
+
+// multiplies the 64 bit integer in reg by a size
+static void cg_scale(int reg, size_t size)
+{
+        if (size <= 1)
+                return;
+        if ((size & (size - 1)) == 0)
+                x64_shift_ri(SHIFT_SHL, 8, reg, __builtin_ctzll(size));
+        else    x64_imul_ri(8, reg, reg, size);
+}
+
+
+// moves an address in rax out of the way of a value to be computed
+static Loc keep_addr(Loc loc)
+{
+        if (loc.base == RAX) {
+                x64_mov_rr(8, ADDR_REG, RAX);
+                loc.base = ADDR_REG;
+        }
+        return loc;
+}
+
+
+static Loc cg_addr(Expr *e)
+{
+        Type *type, *elem;
+        Expr *index;
+        Loc loc;
+
+        if (static_addr(e, &loc))
+                return loc;
+        switch (e->kind) {
+        case EXPR_NAME:
+                return var_loc(sym_get(e->name));
+        case EXPR_FIELD:
+                type = e->field.expr->type;
+                if (type->kind == TYPE_PTR) {
+                        cg_expr(e->field.expr);
+                        return (Loc) {RAX, field_offset(type->elem, e->field.name)};
+                }
+                loc = cg_addr(e->field.expr);
+                loc.disp += field_offset(type, e->field.name);
+                return loc;
+        case EXPR_INDEX:
+                // the array or pointer is an address to be indexed
+                cg_expr(e->index.oexpr);
+                elem = e->type;
+                index = e->index.iexpr;
+                if (index->is_const && fits_int32(index->const_val * (int64_t) elem->size))
+                        return (Loc) {RAX, index->const_val * elem->size};
+                if (!cg_leaf(index, RCX, type_int64)) {
+                        cg_push(type_int64);
+                        cg_expr(index);
+                        convert_int(index->type, type_int64, RAX);
+                        x64_mov_rr(8, RCX, RAX);
+                        cg_pop(type_int64, RAX);
+                }
+                cg_scale(RCX, elem->size);
+                x64_alu_rr(ALU_ADD, 8, RAX, RCX);
+                return (Loc) {RAX, 0};
+        case EXPR_UNARY:
+                assert(e->unary.op == TOKEN_MUL);
+                cg_expr(e->unary.expr);
+                return (Loc) {RAX, 0};
+        default:
+                cg_unsupported(e->pos, "this lvalue is");
+                return (Loc) {RAX, 0};
+        }
+}
+
+
+static int32_t int_imm(Expr *e, Type *type, char *has_imm)
+{
+        *has_imm = !is_float_type(type) && !is_float_type(e->type) && e->is_const &&
+                fits_int32(e->const_val);
+        return *has_imm ? e->const_val : 0;
+}
+
+
+// Leaves l converted to the type in rax or xmm0 and r in rcx or xmm1,
+// or in the immediate returned, if has_imm.
+static int32_t cg_operands(Expr *l, Expr *r, Type *type, char *has_imm)
+{
+        int32_t imm = int_imm(r, type, has_imm);
+
+        cg_expr(l);
+        cg_convert(l->type, type);
+        if (*has_imm || cg_leaf(r, RCX, type))
+                return imm;
+        cg_push(type);
+        cg_expr(r);
+        cg_convert(r->type, type);
+        if (is_float_type(type)) {
+                x64_movaps(XMM1, XMM0);
+                cg_pop(type, XMM0);
+        } else {
+                x64_mov_rr(8, RCX, RAX);
+                cg_pop(type, RAX);
+        }
+        return imm;
+}
+
+
+// rax or xmm0 op= rcx, xmm1 or the immediate, computed at the type
+static void cg_arith(TokenKind op, Type *type, char has_imm, int32_t imm)
+{
+        int size = op_size(type);
+
+        if (is_float_type(type)) {
+                switch (op) {
+                case TOKEN_ADD:
+                        x64_sse_rr(type->size, SSE_ADD, XMM0, XMM1);
+                        break;
+                case TOKEN_SUB:
+                        x64_sse_rr(type->size, SSE_SUB, XMM0, XMM1);
+                        break;
+                case TOKEN_MUL:
+                        x64_sse_rr(type->size, SSE_MUL, XMM0, XMM1);
+                        break;
+                default:
+                        x64_sse_rr(type->size, SSE_DIV, XMM0, XMM1);
+                }
+                return;
+        }
+        switch (op) {
+        case TOKEN_ADD:
+        case TOKEN_SUB:
+        case TOKEN_AND:
+        case TOKEN_OR:
+        case TOKEN_XOR: {
+                enum AluOp alu = op == TOKEN_ADD ? ALU_ADD : op == TOKEN_SUB ? ALU_SUB :
+                        op == TOKEN_AND ? ALU_AND : op == TOKEN_OR ? ALU_OR : ALU_XOR;
+
+                if (has_imm)
+                        x64_alu_ri(alu, size, RAX, imm);
+                else    x64_alu_rr(alu, size, RAX, RCX);
+                break;
+        }
+        case TOKEN_MUL:
+                if (has_imm)
+                        x64_imul_ri(size, RAX, RAX, imm);
+                else    x64_imul_rr(size, RAX, RCX);
+                break;
+        case TOKEN_DIV:
+        case TOKEN_MOD:
+                if (has_imm)
+                        x64_mov_ri(RCX, size == 8 ? (int64_t) imm : (int64_t) (uint32_t) imm);
+                x64_div(size, is_unsigned_type(type), RCX);
+                if (op == TOKEN_MOD)
+                        x64_mov_rr(size, RAX, RDX);
+                break;
+        case TOKEN_LSHIFT:
+        case TOKEN_RSHIFT: {
+                enum ShiftOp shift = op == TOKEN_LSHIFT ? SHIFT_SHL :
+                        is_unsigned_type(type) ? SHIFT_SHR : SHIFT_SAR;
+
+                if (has_imm)
+                        x64_shift_ri(shift, size, RAX, imm & (size * 8 - 1));
+                else    x64_shift_cl(shift, size, RAX);
+                break;
+        }
+        default:
+                assert(0);
+        }
+        // narrow results stay extended
+        if (val_size(type) < 4)
+                x64_extend(4, val_size(type), is_unsigned_type(type), RAX, RAX);
+}
+
+
+// the type both operands of a comparison convert to
+static Type *compare_type(Type *a, Type *b)
+{
+        a = decay(a);
+        b = decay(b);
+        if (is_arithmetic(a) && is_arithmetic(b))
+                return arith_type(a, b);
+        return a->kind == TYPE_PTR || a->kind == TYPE_FUNC ? a : b;
+}
+
+
+// sets the flags comparing the operands and returns the condition that
+// holds when the comparison does, floats equal only if not NaN as well
+static enum Cond cg_compare(Expr *e)
+{
+        Expr *l = e->binary.left, *r = e->binary.right;
+        Type *type = compare_type(l->type, r->type);
+        char has_imm, is_unsigned = is_unsigned_type(type);
+        int32_t imm = cg_operands(l, r, type, &has_imm);
+
+        if (is_float_type(type)) {
+                switch (e->binary.op) {
+                case TOKEN_LT:
+                        x64_ucomis(type->size, XMM1, XMM0);
+                        return CC_A;
+                case TOKEN_LTEQ:
+                        x64_ucomis(type->size, XMM1, XMM0);
+                        return CC_AE;
+                default:
+                        x64_ucomis(type->size, XMM0, XMM1);
+                }
+                is_unsigned = 1;
+        } else if (has_imm) {
+                x64_alu_ri(ALU_CMP, op_size(type), RAX, imm);
+        } else {
+                x64_alu_rr(ALU_CMP, op_size(type), RAX, RCX);
+        }
+        switch (e->binary.op) {
+        case TOKEN_EQ:
+                return CC_E;
+        case TOKEN_NEQ:
+                return CC_NE;
+        case TOKEN_LT:
+                return is_unsigned ? CC_B : CC_L;
+        case TOKEN_LTEQ:
+                return is_unsigned ? CC_BE : CC_LE;
+        case TOKEN_GT:
+                return is_unsigned ? CC_A : CC_G;
+        default:
+                return is_unsigned ? CC_AE : CC_GE;
+        }
+}
+
+
+#define is_compare_op(op) ((op) >= TOKEN_EQ && (op) <= TOKEN_NEQ)
+
+
+// jumps on whether a float is equal, to itself or to 0, with the flags
+// of a ucomis set
+static void cg_float_eq_branch(char jump_if_equal, size_t **jumps)
+{
+        size_t unordered;
+
+        if (jump_if_equal) {
+                unordered = x64_jcc(CC_P, 0);
+                buf_push((*jumps), x64_jcc(CC_E, 0));
+                x64_patch(unordered, x64_pos());
+        } else {
+                buf_push((*jumps), x64_jcc(CC_NE, 0));
+                buf_push((*jumps), x64_jcc(CC_P, 0));
+        }
+}
+
+
+// Adds to jumps those taken when e is true, if when, or false, falling
+// through otherwise.  && and || short circuit without computing values.
+static void cg_branch(Expr *e, char when, size_t **jumps)
+{
+        size_t *skip = NULL;
+        TokenKind op;
+        Type *type;
+
+        if (e->is_const) {
+                if (const_truth(e) == when)
+                        buf_push((*jumps), x64_jmp(0));
+                return;
+        }
+        if (e->kind == EXPR_UNARY && e->unary.op == TOKEN_NOT) {
+                cg_branch(e->unary.expr, !when, jumps);
+                return;
+        }
+        if (e->kind == EXPR_BINARY) {
+                op = e->binary.op;
+                if (op == TOKEN_LOGICAL_AND || op == TOKEN_LOGICAL_OR) {
+                        // a && b jumps on false if either does, on true if both do
+                        if (when == (op == TOKEN_LOGICAL_OR)) {
+                                cg_branch(e->binary.left, when, jumps);
+                                cg_branch(e->binary.right, when, jumps);
+                        } else {
+                                cg_branch(e->binary.left, !when, &skip);
+                                cg_branch(e->binary.right, when, jumps);
+                                patch_here(skip);
+                                buf_free(skip);
+                        }
+                        return;
+                }
+                if (is_compare_op(op)) {
+                        type = compare_type(e->binary.left->type, e->binary.right->type);
+                        if (is_float_type(type) && (op == TOKEN_EQ || op == TOKEN_NEQ)) {
+                                cg_compare(e);
+                                cg_float_eq_branch((op == TOKEN_EQ) == when, jumps);
+                        } else {
+                                enum Cond cc = cg_compare(e);
+                                buf_push((*jumps), x64_jcc(when ? cc : cc_not(cc), 0));
+                        }
+                        return;
+                }
+        }
+        cg_expr(e);
+        type = decay(e->type);
+        if (is_float_type(type)) {
+                x64_xorps(XMM1, XMM1);
+                x64_ucomis(type->size, XMM0, XMM1);
+                cg_float_eq_branch(!when, jumps);
+                return;
+        }
+        x64_test_rr(op_size(type), RAX, RAX);
+        buf_push((*jumps), x64_jcc(when ? CC_NE : CC_E, 0));
+}
+
+
+// 1 or 0 in rax for comparisons, ! and the logical operators
+static void cg_bool(Expr *e)
+{
+        size_t *jumps = NULL, end;
+        Type *type;
+
+        if (e->kind == EXPR_BINARY && is_compare_op(e->binary.op)) {
+                type = compare_type(e->binary.left->type, e->binary.right->type);
+                if (!is_float_type(type) ||
+                        (e->binary.op != TOKEN_EQ && e->binary.op != TOKEN_NEQ)) {
+                                x64_setcc(cg_compare(e), RAX);
+                                return;
+                }
+        }
+        cg_branch(e, 0, &jumps);
+        x64_mov_ri(RAX, 1);
+        end = x64_jmp(0);
+        patch_here(jumps);
+        x64_mov_ri(RAX, 0);
+        x64_patch(end, x64_pos());
+        buf_free(jumps);
+}
+
+
+static void cg_name(Expr *e)
+{
+        Sym *sym = sym_get(e->name);
+        CodeFixup fixup = {0, sym, NULL};
+
+        if (sym->kind == SYM_FUNC) {
+                fixup.at = x64_lea_rip(RAX);
+                buf_push(cg_fixups, fixup);
+                return;
+        }
+        cg_load(e->type, var_loc(sym));
+}
+
+
+// p + i, i + p and p - i
+static void cg_ptr_arith(Expr *e)
+{
+        Expr *p = e->binary.left, *i = e->binary.right;
+        size_t size;
+        char has_imm;
+        int32_t imm;
+
+        if (decay(p->type)->kind != TYPE_PTR) {
+                p = e->binary.right;
+                i = e->binary.left;
+        }
+        size = decay(p->type)->elem->size;
+        imm = int_imm(i, type_int64, &has_imm);
+        if (has_imm && fits_int32(imm * (int64_t) size)) {
+                cg_expr(p);
+                x64_alu_ri(e->binary.op == TOKEN_ADD ? ALU_ADD : ALU_SUB, 8, RAX, imm * size);
+                return;
+        }
+        cg_expr(i);
+        convert_int(i->type, type_int64, RAX);
+        cg_scale(RAX, size);
+        cg_push(type_int64);
+        cg_expr(p);
+        cg_pop(type_int64, RCX);
+        x64_alu_rr(e->binary.op == TOKEN_ADD ? ALU_ADD : ALU_SUB, 8, RAX, RCX);
+}
+
+
+// p - q, in elements
+static void cg_ptr_diff(Expr *e)
+{
+        Type *type = decay(e->binary.left->type);
+        size_t size = type->elem->size;
+        char has_imm;
+
+        cg_operands(e->binary.left, e->binary.right, type, &has_imm);
+        x64_alu_rr(ALU_SUB, 8, RAX, RCX);
+        if (size <= 1)
+                return;
+        if ((size & (size - 1)) == 0) {
+                x64_shift_ri(SHIFT_SAR, 8, RAX, __builtin_ctzll(size));
+        } else {
+                x64_mov_ri(RCX, size);
+                x64_div(8, 0, RCX);
+        }
+}
+
+
+static const TokenKind assign_op[] = {
+        [TOKEN_MUL_ASSIGN] = TOKEN_MUL,
+        [TOKEN_DIV_ASSIGN] = TOKEN_DIV,
+        [TOKEN_MOD_ASSIGN] = TOKEN_MOD,
+        [TOKEN_AND_ASSIGN] = TOKEN_AND,
+        [TOKEN_LSHIFT_ASSIGN] = TOKEN_LSHIFT,
+        [TOKEN_RSHIFT_ASSIGN] = TOKEN_RSHIFT,
+        [TOKEN_ADD_ASSIGN] = TOKEN_ADD,
+        [TOKEN_SUB_ASSIGN] = TOKEN_SUB,
+        [TOKEN_XOR_ASSIGN] = TOKEN_XOR,
+        [TOKEN_OR_ASSIGN] = TOKEN_OR,
+};
+
+
+// the value assigned is left in rax or xmm0
+static void cg_assign(Expr *e)
+{
+        Expr *l = e->binary.left, *r = e->binary.right;
+        Type *type = l->type, *op_type = type;
+        TokenKind op = assign_op[e->binary.op];
+        char has_imm = 0, is_static;
+        int32_t imm = 0;
+        Loc loc;
+
+        if (e->binary.op == TOKEN_ASSIGN) {
+                cg_expr(r);
+                cg_convert(r->type, type);
+                if (!static_addr(l, &loc)) {
+                        cg_push(type);
+                        loc = keep_addr(cg_addr(l));
+                        cg_pop(type, RAX);
+                }
+                cg_store(type, RAX, loc);
+                return;
+        }
+
+        // l op= r computes l op r at the type C would, then stores it
+        if (type->kind == TYPE_PTR) {
+                imm = int_imm(r, type_int64, &has_imm);
+                if (has_imm && fits_int32(imm * (int64_t) type->elem->size)) {
+                        imm *= type->elem->size;
+                } else {
+                        has_imm = 0;
+                        cg_expr(r);
+                        convert_int(r->type, type_int64, RAX);
+                        cg_scale(RAX, type->elem->size);
+                }
+        } else {
+                if (op != TOKEN_LSHIFT && op != TOKEN_RSHIFT)
+                        op_type = arith_type(type, decay(r->type));
+                op_type = promote(op_type);
+                imm = int_imm(r, op_type, &has_imm);
+                if (!has_imm) {
+                        cg_expr(r);
+                        cg_convert(r->type, op_type);
+                }
+        }
+        is_static = static_addr(l, &loc);
+        if (!has_imm) {
+                if (is_static && is_float_type(op_type))
+                        x64_movaps(XMM1, XMM0);
+                else if (is_static)
+                        x64_mov_rr(8, RCX, RAX);
+                else    cg_push(op_type);
+        }
+        if (!is_static)
+                loc = keep_addr(cg_addr(l));
+        cg_load(type, loc);
+        cg_convert(type, op_type);
+        if (!has_imm && !is_static)
+                cg_pop(op_type, is_float_type(op_type) ? XMM1 : RCX);
+        cg_arith(op, op_type, has_imm, imm);
+        cg_convert(op_type, type);
+        cg_store(type, RAX, loc);
+}
+
+
+// ++ and --, the value before or after in rax or xmm0
+static void cg_inc_dec(Expr *e)
+{
+        Expr *operand = e->unary.expr;
+        Type *type = operand->type;
+        char is_inc = e->unary.op == TOKEN_INC;
+        int size = op_size(type);
+        Loc loc;
+
+        if (!static_addr(operand, &loc))
+                loc = keep_addr(cg_addr(operand));
+        cg_load(type, loc);
+        if (is_float_type(type)) {
+                x64_movaps(XMM2, XMM0);
+                cg_float_const(type, 1);
+                x64_movaps(XMM1, XMM0);
+                x64_movaps(XMM0, XMM2);
+                x64_sse_rr(type->size, is_inc ? SSE_ADD : SSE_SUB, XMM2, XMM1);
+                cg_store(type, XMM2, loc);
+                if (!e->unary.is_postfix)
+                        x64_movaps(XMM0, XMM2);
+                return;
+        }
+        x64_mov_rr(8, RCX, RAX);
+        x64_alu_ri(is_inc ? ALU_ADD : ALU_SUB, size, RCX,
+                type->kind == TYPE_PTR ? type->elem->size : 1);
+        cg_store(type, RCX, loc);
+        if (!e->unary.is_postfix)
+                x64_extend(val_size(type), val_size(type), is_unsigned_type(type), RAX, RCX);
+}
+
+
+static void cg_unary(Expr *e)
+{
+        Expr *operand = e->unary.expr;
+        Loc loc;
+
+        switch (e->unary.op) {
+        case TOKEN_MUL:
+                cg_load(e->type, cg_addr(e));
+                break;
+        case TOKEN_AND:
+                if (operand->type->kind == TYPE_FUNC) {
+                        cg_expr(operand);
+                        break;
+                }
+                loc = cg_addr(operand);
+                if (loc.base != RAX || loc.disp)
+                        x64_lea(RAX, loc.base, loc.disp);
+                break;
+        case TOKEN_INC:
+        case TOKEN_DEC:
+                cg_inc_dec(e);
+                break;
+        case TOKEN_NOT:
+                cg_bool(e);
+                break;
+        case TOKEN_NEG:
+                cg_expr(operand);
+                cg_convert(operand->type, e->type);
+                x64_not(op_size(e->type), RAX);
+                break;
+        case TOKEN_SUB:
+                cg_expr(operand);
+                cg_convert(operand->type, e->type);
+                if (is_float_type(e->type)) {
+                        // 0 - x would lose the sign of 0
+                        x64_movaps(XMM1, XMM0);
+                        cg_float_const(e->type, -0.0);
+                        x64_xorps(XMM0, XMM1);
+                } else {
+                        x64_neg(op_size(e->type), RAX);
+                }
+                break;
+        default: // unary +
+                cg_expr(operand);
+                cg_convert(operand->type, e->type);
+        }
+}
+
+
+static void cg_binary(Expr *e)
+{
+        Expr *l = e->binary.left, *r = e->binary.right;
+        TokenKind op = e->binary.op;
+        char has_imm;
+        int32_t imm;
+        Sym *sym;
+
+        if (op == TOKEN_COLON_ASSIGN) {
+                cg_expr(r);
+                cg_convert(r->type, l->type);
+                sym = sym_push(l->name, l->type);
+                sym->val = cg_alloc(l->type);
+                cg_store(l->type, RAX, (Loc) {RBP, sym->val});
+                return;
+        }
+        if (op >= TOKEN_ASSIGN && op <= TOKEN_OR_ASSIGN) {
+                cg_assign(e);
+                return;
+        }
+        if (is_compare_op(op) || op == TOKEN_LOGICAL_AND || op == TOKEN_LOGICAL_OR) {
+                cg_bool(e);
+                return;
+        }
+        if ((op == TOKEN_ADD || op == TOKEN_SUB) && e->type->kind == TYPE_PTR) {
+                cg_ptr_arith(e);
+                return;
+        }
+        if (op == TOKEN_SUB && decay(l->type)->kind == TYPE_PTR) {
+                cg_ptr_diff(e);
+                return;
+        }
+        imm = cg_operands(l, r, e->type, &has_imm);
+        cg_arith(op, e->type, has_imm, imm);
+}
+
+
+static void cg_ternary(Expr *e)
+{
+        size_t *jumps = NULL, end;
+
+        cg_branch(e->ternary.cond, 0, &jumps);
+        cg_expr(e->ternary.expr);
+        cg_convert(e->ternary.expr->type, e->type);
+        end = x64_jmp(0);
+        patch_here(jumps);
+        cg_expr(e->ternary.or_expr);
+        cg_convert(e->ternary.or_expr->type, e->type);
+        x64_patch(end, x64_pos());
+        buf_free(jumps);
+}
+
+
+static void cg_call(Expr *e)
+{
+        Expr *callee = e->call.expr, *arg;
+        Type *type = decay(callee->type), *param;
+        int regs[NUM_INT_ARG_REGS + NUM_FLOAT_ARG_REGS];
+        int ints = 0, floats = 0, pad;
+        CodeFixup fixup = {0, NULL, NULL};
+        Sym *sym = NULL;
+
+        if (type->kind == TYPE_PTR)
+                type = type->elem;
+        if (e->call.num_args > NUM_INT_ARG_REGS + NUM_FLOAT_ARG_REGS) {
+                cg_unsupported(e->pos, "passing arguments on the stack is");
+                return;
+        }
+        if (is_aggregate(type->func.ret)) {
+                cg_unsupported(e->pos, "returning structs is");
+                return;
+        }
+        for (size_t i = 0; i < e->call.num_args; i++) {
+                param = type->func.args[i];
+                if (is_aggregate(param)) {
+                        cg_unsupported(e->call.args[i]->pos, "passing structs is");
+                        return;
+                }
+                if (is_float_type(param))
+                        regs[i] = floats++;
+                else if (ints < NUM_INT_ARG_REGS)
+                        regs[i] = int_arg_regs[ints++];
+                else    ints++;
+        }
+        if (ints > NUM_INT_ARG_REGS || floats > NUM_FLOAT_ARG_REGS) {
+                cg_unsupported(e->pos, "passing arguments on the stack is");
+                return;
+        }
+
+        for (size_t i = 0; i < e->call.num_args; i++) {
+                arg = e->call.args[i];
+                cg_expr(arg);
+                cg_convert(arg->type, type->func.args[i]);
+                cg_push(type->func.args[i]);
+        }
+        if (callee->kind == EXPR_NAME)
+                sym = sym_get(callee->name);
+        if (sym == NULL || sym->kind != SYM_FUNC) {
+                cg_expr(callee);
+                x64_mov_rr(8, R11, RAX);
+        }
+        for (size_t i = e->call.num_args; i > 0; i--)
+                cg_pop(type->func.args[i - 1], regs[i - 1]);
+
+        // rsp is 16 byte aligned at calls
+        pad = cg_pushed % 2;
+        if (pad)
+                x64_alu_ri(ALU_SUB, 8, RSP, 8);
+        if (sym && sym->kind == SYM_FUNC) {
+                fixup.at = x64_call(0);
+                fixup.func = sym;
+                buf_push(cg_fixups, fixup);
+        } else {
+                x64_call_r(R11);
+        }
+        if (pad)
+                x64_alu_ri(ALU_ADD, 8, RSP, 8);
+}
+
+
+static void cg_expr(Expr *e)
+{
+        CodeFixup fixup = {0, NULL, NULL};
+
+        if (e->is_const) {
+                cg_const(e);
+                return;
+        }
+        switch (e->kind) {
+        case EXPR_NAME:
+                cg_name(e);
+                break;
+        case EXPR_STR:
+                fixup.at = x64_lea_rip(RAX);
+                fixup.str = e->str_val;
+                buf_push(cg_fixups, fixup);
+                break;
+        case EXPR_CAST:
+                cg_expr(e->cast.expr);
+                cg_convert(e->cast.expr->type, e->type);
+                break;
+        case EXPR_CALL:
+                cg_call(e);
+                break;
+        case EXPR_INDEX:
+        case EXPR_FIELD:
+                cg_load(e->type, cg_addr(e));
+                break;
+        case EXPR_UNARY:
+                cg_unary(e);
+                break;
+        case EXPR_BINARY:
+                cg_binary(e);
+                break;
+        case EXPR_TERNARY:
+                cg_ternary(e);
+                break;
+        default:
+                // sizeof is constant
+                assert(0);
+        }
+}
+
+
+// Cases compare in order and jump to their statements, which don't
+// fall through to the next case, empty cases share the next statement.
+static void cg_switch(Stmt *s)
+{
+        size_t n = s->switch_stmt.num_cases, *case_jumps = NULL, *breaks = cg_breaks;
+        Type *type = s->switch_stmt.expr->type;
+        size_t no_match, depth, frame = cg_frame;
+        char has_default = 0;
+        SwitchCase *c;
+        int64_t val;
+
+        cg_expr(s->switch_stmt.expr);
+        for (size_t i = 0; i < n; i++) {
+                c = s->switch_stmt.cases[i];
+                if (c->expr == NULL) {
+                        buf_push(case_jumps, 0);
+                        continue;
+                }
+                val = c->expr->const_val;
+                if (fits_int32(val)) {
+                        x64_alu_ri(ALU_CMP, op_size(type), RAX, val);
+                } else {
+                        x64_mov_ri(RCX, val);
+                        x64_alu_rr(ALU_CMP, op_size(type), RAX, RCX);
+                }
+                buf_push(case_jumps, x64_jcc(CC_E, 0));
+        }
+        no_match = x64_jmp(0);
+
+        cg_breaks = NULL;
+        depth = sym_enter();
+        for (size_t i = 0; i < n; i++) {
+                c = s->switch_stmt.cases[i];
+                if (c->expr == NULL) {
+                        x64_patch(no_match, x64_pos());
+                        has_default = 1;
+                } else {
+                        x64_patch(case_jumps[i], x64_pos());
+                }
+                if (c->stmt == NULL)
+                        continue;
+                cg_stmt(c->stmt);
+                if (i + 1 < n)
+                        buf_push(cg_breaks, x64_jmp(0));
+        }
+        sym_leave(depth);
+        cg_frame = frame;
+        if (!has_default)
+                buf_push(cg_breaks, no_match);
+        patch_here(cg_breaks);
+        buf_free(cg_breaks);
+        buf_free(case_jumps);
+        cg_breaks = breaks;
+}
+
+
+// Loops test their condition at the bottom, with a jump to it on entry,
+// so an iteration takes a single jump.
+static void cg_loop(Expr *init, Expr *cond, Expr *step, Stmt *body, char test_first)
+{
+        size_t *breaks = cg_breaks, *continues = cg_continues, *back = NULL;
+        size_t entry = 0, top;
+
+        if (init)
+                cg_expr(init);
+        if (test_first && cond && cond->is_const && !const_truth(cond))
+                return;
+        cg_breaks = cg_continues = NULL;
+        if (test_first && cond && !cond->is_const)
+                entry = x64_jmp(0);
+        top = x64_pos();
+        cg_stmt(body);
+        patch_here(cg_continues);
+        if (step)
+                cg_expr(step);
+        if (entry)
+                x64_patch(entry, x64_pos());
+        if (cond) {
+                cg_branch(cond, 1, &back);
+                for (size_t i = 0; i < buf__len(back); i++)
+                        x64_patch(back[i], top);
+        } else {
+                x64_jmp(top);
+        }
+        patch_here(cg_breaks);
+        buf_free(back);
+        buf_free(cg_breaks);
+        buf_free(cg_continues);
+        cg_breaks = breaks;
+        cg_continues = continues;
+}
+
+
+// Statements opening a scope give the frame space of its locals back
+// at its end.
+static void cg_stmt(Stmt *s)
+{
+        size_t depth, frame = cg_frame, *jumps = NULL, end;
+
+        if (s == NULL)
+                return;
+        switch (s->kind) {
+        case STMT_BREAK:
+                buf_push(cg_breaks, x64_jmp(0));
+                break;
+        case STMT_CONTINUE:
+                buf_push(cg_continues, x64_jmp(0));
+                break;
+        case STMT_RETURN:
+                if (s->expr) {
+                        cg_expr(s->expr);
+                        cg_convert(s->expr->type, cg_ret);
+                }
+                if (s != cg_tail_return)
+                        buf_push(cg_returns, x64_jmp(0));
+                break;
+        case STMT_EXPR:
+                cg_expr(s->expr);
+                break;
+        case STMT_IF:
+                if (s->if_stmt.cond->is_const) {
+                        // the branch not taken is checked but not generated
+                        cg_stmt(const_truth(s->if_stmt.cond) ? s->if_stmt.body : s->if_stmt.other);
+                        break;
+                }
+                cg_branch(s->if_stmt.cond, 0, &jumps);
+                cg_stmt(s->if_stmt.body);
+                if (s->if_stmt.other) {
+                        end = x64_jmp(0);
+                        patch_here(jumps);
+                        cg_stmt(s->if_stmt.other);
+                        x64_patch(end, x64_pos());
+                } else {
+                        patch_here(jumps);
+                }
+                buf_free(jumps);
+                break;
+        case STMT_WHILE:
+                cg_loop(NULL, s->while_stmt.cond, NULL, s->while_stmt.body, 1);
+                break;
+        case STMT_DO_WHILE:
+                cg_loop(NULL, s->while_stmt.cond, NULL, s->while_stmt.body, 0);
+                break;
+        case STMT_FOR:
+                depth = sym_enter();
+                cg_loop(s->for_stmt.init, s->for_stmt.cond, s->for_stmt.step,
+                        s->for_stmt.body, 1);
+                sym_leave(depth);
+                cg_frame = frame;
+                break;
+        case STMT_SWITCH:
+                cg_switch(s);
+                break;
+        case STMT_BLOCK:
+                depth = sym_enter();
+                for (size_t i = 0; i < s->block.num_stmt; i++)
+                        cg_stmt(s->block.stmt[i]);
+                sym_leave(depth);
+                cg_frame = frame;
+                break;
+        default:
+                assert(0);
+        }
+}
+
+
+static void cg_func(Sym *sym)
+{
+        FuncDecl *f = sym->decl->func.decl;
+        Stmt *body = sym->decl->func.body;
+        uint64_t start = trace_begin();
+        int ints = 0, floats = 0;
+        size_t frame_at, depth;
+        uint32_t frame;
+        Sym *param;
+        Type *type;
+
+        sym->val = x64_pos();
+        x64_push(RBP);
+        x64_mov_rr(8, RBP, RSP);
+        // sub rsp, imm32, the size is known at the end
+        x64_rr(8, 0x81, ALU_SUB, RSP);
+        frame_at = x64_pos();
+        x64_u32(0);
+
+        cg_ret = sym->type->func.ret;
+        cg_frame = cg_frame_max = 0;
+        cg_pushed = 0;
+        depth = sym_enter();
+        for (size_t i = 0; i < f->num_args; i++) {
+                type = sym->type->func.args[i];
+                param = sym_push(f->args[i], type);
+                param->val = cg_alloc(type);
+                if (is_aggregate(type))
+                        cg_unsupported(sym->decl->pos, "passing structs is");
+                else if (is_float_type(type) && floats < NUM_FLOAT_ARG_REGS)
+                        x64_sse_store(type->size, floats++, RBP, param->val);
+                else if (!is_float_type(type) && ints < NUM_INT_ARG_REGS)
+                        x64_store(val_size(type), int_arg_regs[ints++], RBP, param->val);
+                else    cg_unsupported(sym->decl->pos, "passing arguments on the stack is");
+        }
+        cg_tail_return = NULL;
+        if (body->block.num_stmt)
+                cg_tail_return = body->block.stmt[body->block.num_stmt - 1];
+        cg_stmt(body);
+        sym_leave(depth);
+        assert(cg_pushed == 0);
+
+        patch_here(cg_returns);
+        buf_free(cg_returns);
+        x64_leave();
+        x64_ret();
+        frame = ALIGN_UP(cg_frame_max, 16);
+        memcpy(x64_code + frame_at, &frame, 4);
+        generated_funcs++;
+        trace_end(start, "codegen", sym->name);
+}
+
+
+// writes the constant initializer of a global into the data block
+static void cg_global_init(Sym *sym)
+{
+        Expr *init = sym->decl->var.expr;
+        uint8_t *dest = cg_data + sym->val;
+        Type *type = sym->type;
+        double f;
+        float f32;
+        int64_t i;
+
+        if (init == NULL)
+                return;
+        if (!init->is_const || is_aggregate(type)) {
+                cg_unsupported(init->pos, "an initializer that is not an arithmetic constant is");
+                return;
+        }
+        if (is_float_type(type)) {
+                f = is_float_type(init->type) ? init->const_float : init->const_val;
+                f32 = f;
+                memcpy(dest, type->size == 4 ? (void *) &f32 : &f, type->size);
+        } else {
+                i = is_float_type(init->type) ? (int64_t) init->const_float : init->const_val;
+                memcpy(dest, &i, val_size(type)); // little endian
+        }
+}
+
+
+// Generates code for every function resolve_entry or resolve_all
+// reached, and check_resolved found free of errors, into x64_code.  A
+// function's code starts at the offset kept in its Sym.val.
+void codegen_resolved(void)
+{
+        size_t size = 0, pos;
+        Map strings = {0};
+        CodeFixup *fixup;
+        Sym *sym;
+
+        buf_free(x64_code);
+        buf_free(cg_fixups);
+        free(cg_data);
+        generated_funcs = 0;
+
+        for (size_t i = 0; i < buf__len(resolved_syms); i++) {
+                sym = resolved_syms[i];
+                if (sym->kind != SYM_VAR || sym->decl == NULL)
+                        continue;
+                size = ALIGN_UP(size, sym->type->align ? sym->type->align : 1);
+                sym->val = size;
+                size += sym->type->size;
+        }
+        cg_data_size = size;
+        cg_data = calloc(1, size ? size : 1);
+        for (size_t i = 0; i < buf__len(resolved_syms); i++) {
+                sym = resolved_syms[i];
+                if (sym->decl == NULL)
+                        continue;
+                if (sym->kind == SYM_VAR)
+                        cg_global_init(sym);
+                else if (sym->kind == SYM_FUNC)
+                        cg_func(sym);
+        }
+
+        // string literals follow the code, each once
+        for (size_t i = 0; i < buf__len(cg_fixups); i++) {
+                fixup = cg_fixups + i;
+                if (fixup->func) {
+                        x64_patch(fixup->at, fixup->func->val);
+                        continue;
+                }
+                pos = (uintptr_t) map_get(&strings, fixup->str);
+                if (pos == 0) {
+                        pos = x64_pos();
+                        for (const char *c = fixup->str; *c; c++)
+                                x64_u8(*c);
+                        x64_u8(0);
+                        map_put(&strings, fixup->str, (void *) (uintptr_t) pos);
+                }
+                x64_patch(fixup->at, pos);
+        }
+        buf_free(cg_fixups);
+        map_free(&strings);
+}
+
+
+// Copies the generated code into executable memory, NULL if the system
+// doesn't allow that.  Free it with unload_code.
+void *load_code(void)
+{
+        size_t size = buf__len(x64_code);
+        void *code;
+
+        code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (code == MAP_FAILED)
+                return NULL;
+        memcpy(code, x64_code, size);
+        if (mprotect(code, size, PROT_READ | PROT_EXEC)) {
+                munmap(code, size);
+                return NULL;
+        }
+        return code;
+}
+
+
+void unload_code(void *code)
+{
+        munmap(code, buf__len(x64_code));
+}
+
+
+#define codegen_func(code, type, name) \
+        ((type) ((uint8_t *) (code) + ((Sym *) map_get(&global_symbols_map, str_intern(name)))->val))
+
+void codegen_test()
+{
+        size_t errors = num_errors;
+        Decl **ast;
+        uint8_t *code;
+
+        num_errors = 0;
+        ast = parse_resolve_test(
+                "struct Vec { x: int; y: int; next: Vec* }\n"
+                "struct Big { a: char; b: int64_t; arr: int[8]; v: Vec }\n"
+                "enum Color { RED, GREEN = 5, BLUE }\n"
+                "const N = 10\n"
+                "var counter: int\n"
+                "var scale = 2.5\n"
+                "var table: int[16]\n"
+                "var big: Big\n"
+                "func fib(n: int): int {\n"
+                "        if (n < 2) {\n"
+                "                return n\n"
+                "        }\n"
+                "        return fib(n - 1) + fib(n - 2)\n"
+                "}\n"
+                "func sum_to(n: int): int64_t {\n"
+                "        total := cast(int64_t) 0\n"
+                "        for (i := 1; i <= n; i++) {\n"
+                "                total += i\n"
+                "        }\n"
+                "        return total\n"
+                "}\n"
+                "func collatz(n: int64_t): int {\n"
+                "        steps := 0\n"
+                "        while (n != 1) {\n"
+                "                if (n % 2 == 0) { n = n / 2 } else { n = 3 * n + 1 }\n"
+                "                steps++\n"
+                "        }\n"
+                "        return steps\n"
+                "}\n"
+                "func dot(a: Vec*, b: Vec*): int { return a.x * b.x + a.y * b.y }\n"
+                "func length(v: Vec*): int {\n"
+                "        n := 0\n"
+                "        for (; v; v = v.next) { n++ }\n"
+                "        return n\n"
+                "}\n"
+                "func fill(): int {\n"
+                "        for (i := 0; i < 16; i++) { table[i] = i * i }\n"
+                "        big.arr[3] = 7\n"
+                "        big.v.y = table[5]\n"
+                "        p := &big.v\n"
+                "        p.x = -3\n"
+                "        return big.arr[3] + p.y + big.v.x\n"
+                "}\n"
+                "func classify(c: int): int {\n"
+                "        switch (c) {\n"
+                "        case RED:\n"
+                "                return 1\n"
+                "        case GREEN:\n"
+                "        case BLUE:\n"
+                "                return 2\n"
+                "        default:\n"
+                "                break\n"
+                "        }\n"
+                "        return 0\n"
+                "}\n"
+                "func mix(a: double, b: int, c: float): double { return (a * b) + (c / 2) + scale }\n"
+                "func to_int(d: double): int { return cast(int) d }\n"
+                "func fcmp(a: double, b: double): int { return (a < b) + ((a == b) * 2) + ((a != b) * 4) }\n"
+                "func chars(s: char*): int {\n"
+                "        n := 0\n"
+                "        while (s[n]) { n++ }\n"
+                "        return n\n"
+                "}\n"
+                "func hello(): int { return chars(\"hello, world\") + chars(\"hello, world\") }\n"
+                "func logic(a: int, b: int): int {\n"
+                "        return (a && b) + ((a || b) * 2) + ((!a) * 4) + (a < b ? 8 : 16)\n"
+                "}\n"
+                "func bits(x: uint32_t): uint32_t { return ((x >> 28) | (x << 4)) ^ (~x & 0xff) }\n"
+                "func divs(a: int, b: int): int { return ((a / b) * 100) + (a % b) }\n"
+                "func udiv(a: uint32_t, b: uint32_t): uint32_t { return a / b }\n"
+                "func apply(f: func(int): int, x: int): int { return f(x) }\n"
+                "func twice(): int { return apply(fib, 10) + apply(fib, 11) }\n"
+                "func swap(a: int*, b: int*) { t := *a; *a = *b; *b = t }\n"
+                "func count_up(): int {\n"
+                "        counter = 0\n"
+                "        for (i := 0; i < N; i++) {\n"
+                "                counter += i\n"
+                "                if (i == 5) { break }\n"
+                "        }\n"
+                "        return counter\n"
+                "}\n"
+                "func evens(): int {\n"
+                "        s := 0\n"
+                "        i := 0\n"
+                "        do {\n"
+                "                i++\n"
+                "                if (i % 2) { continue }\n"
+                "                s += i\n"
+                "        } while (i < 10)\n"
+                "        return s\n"
+                "}\n"
+                "func copy(): int { a := big.v; a.x = 100; return a.x + big.v.x }\n"
+                "func steps(n: int): float {\n"
+                "        x := cast(float) 0\n"
+                "        for (i := 0; i < n; i++) { x += 1.25 }\n"
+                "        return x\n"
+                "}\n"
+                "func many(a: int, b: char, c: int64_t, d: double, e: uint8_t, f: int16_t): int64_t {\n"
+                "        return a + b + c + (cast(int64_t) d) + e + f\n"
+                "}\n"
+                "func neg(x: int64_t): int64_t { return -x * 2 }\n"
+                "func ptrs(): int64_t {\n"
+                "        p := &table[2]\n"
+                "        q := &table[10]\n"
+                "        return (q - p) + *(p + 1)\n"
+                "}\n"
+                "func wrap(c: char): int { x := c; x++; return x }\n"
+                "func consts(x: uint64_t): uint64_t {\n"
+                "        return ((cast(uint64_t) -1) / 2) + ((cast(uint32_t) 1) - 2) + x\n"
+                "}\n");
+        assert(num_errors == 0);
+        resolve_all();
+        check_resolved();
+        assert(num_errors == 0);
+        codegen_resolved();
+        assert(num_errors == 0 && buf__len(x64_code) > 0);
+        assert(*(double *) (cg_data + ((Sym *) map_get(&global_symbols_map,
+                str_intern("scale")))->val) == 2.5);
+
+        code = load_code();
+        if (code) {
+                {
+                        struct {int x, y; void *next;} a = {2, 3, NULL}, b = {4, 5, &a};
+                        int x = 1, y = 2;
+
+                        assert(codegen_func(code, int (*)(int), "fib")(20) == 6765);
+                        assert(codegen_func(code, int64_t (*)(int), "sum_to")(100000) == 5000050000);
+                        assert(codegen_func(code, int (*)(int64_t), "collatz")(27) == 111);
+                        assert(codegen_func(code, int (*)(void *, void *), "dot")(&a, &b) == 23);
+                        assert(codegen_func(code, int (*)(void *), "length")(&b) == 2);
+                        assert(codegen_func(code, int (*)(void *), "length")(NULL) == 0);
+                        assert(codegen_func(code, int (*)(void), "fill")() == 29);
+                        assert(codegen_func(code, int (*)(int), "classify")(0) == 1);
+                        assert(codegen_func(code, int (*)(int), "classify")(6) == 2);
+                        assert(codegen_func(code, int (*)(int), "classify")(1) == 0);
+                        assert(codegen_func(code, double (*)(double, int, float), "mix")(1.5, 3, 5) == 9.5);
+                        assert(codegen_func(code, int (*)(double), "to_int")(-7.9) == -7);
+                        assert(codegen_func(code, int (*)(double, double), "fcmp")(1, 2) == 5);
+                        assert(codegen_func(code, int (*)(double, double), "fcmp")(2, 2) == 2);
+                        assert(codegen_func(code, int (*)(double, double), "fcmp")(0.0 / 0.0, 2) == 4);
+                        assert(codegen_func(code, int (*)(void), "hello")() == 24);
+                        assert(codegen_func(code, int (*)(int, int), "logic")(0, 3) == 14);
+                        assert(codegen_func(code, int (*)(int, int), "logic")(2, 3) == 11);
+                        assert(codegen_func(code, int (*)(int, int), "logic")(3, 0) == 18);
+                        assert(codegen_func(code, uint32_t (*)(uint32_t), "bits")(0xf0000012) ==
+                                (((0xf0000012u >> 28) | (0xf0000012u << 4)) ^ (~0xf0000012u & 0xff)));
+                        assert(codegen_func(code, int (*)(int, int), "divs")(-17, 5) == -302);
+                        assert(codegen_func(code, uint32_t (*)(uint32_t, uint32_t), "udiv")(0xfffffff0, 16) ==
+                                0x0fffffff);
+                        assert(codegen_func(code, int (*)(void), "twice")() == 55 + 89);
+                        codegen_func(code, void (*)(int *, int *), "swap")(&x, &y);
+                        assert(x == 2 && y == 1);
+                        assert(codegen_func(code, int (*)(void), "count_up")() == 15);
+                        assert(codegen_func(code, int (*)(void), "evens")() == 30);
+                        assert(codegen_func(code, int (*)(void), "copy")() == 97);
+                        assert(codegen_func(code, float (*)(int), "steps")(3) == 3.75);
+                        assert(codegen_func(code, int64_t (*)(int, char, int64_t, double, uint8_t, int16_t),
+                                "many")(1, -2, 1ll << 40, 2.5, 200, -300) == (1ll << 40) - 99);
+                        assert(codegen_func(code, int64_t (*)(int64_t), "neg")(-21) == 42);
+                        assert(codegen_func(code, int64_t (*)(void), "ptrs")() == 17);
+                        assert(codegen_func(code, int (*)(char), "wrap")(127) == -128);
+                        assert(codegen_func(code, uint64_t (*)(uint64_t), "consts")(0) ==
+                                (UINT64_MAX / 2) + (uint32_t) -1);
+                }
+                unload_code(code);
+        }
+
+        ast_free();
+        buf_free(ast);
+        buf_free(x64_code);
+        buf_free(resolved_syms);
+        sym_reset_globals();
+        num_errors = errors;
+}
+
+#undef codegen_func
+
+#endif
@@ -1,70 +1,175 @@
 //#define BRAND_NEW_PARSER
 #include "config.h"
 
+#ifndef MAIN
 #define MAIN dump_ast
+#endif
 
 
 void regression_tests(void)
 {
         filename = "<anonymous>";
         buf_test();
+        arena_test();
+        map_test();
+        jobs_test();
+        trace_test();
         str_test();
         lex_test();
+        type_test();
+        sym_test();
 #ifndef BRAND_NEW_PARSER
         parser_test();
+        corpus_test();
+        resolve_test();
+        const_eval_test();
+        check_test();
+        x64_test();
+        codegen_test();
+        ast_cache_test();
+        driver_test();
 #endif
 }
 
 
-char *read_file(const char *name)
+#ifndef BRAND_NEW_PARSER
+// dump_ast [-j threads] [--time] [--trace out.json] [--cache dir]
+//      [--resolve] [--check] [--codegen] files or package directories...
+//
+// --resolve resolves what main reaches, or all of it without a main,
+// --check type checks that too, --codegen generates x86-64 code for it
+// if there were no errors
+int dump_ast(int argc, char **argv)
 {
-        FILE *stream = NULL;
-        char *content = NULL;
-        int c;
+        ParseJob *jobs = NULL;
+        int num_threads = num_cpus(), status = 0;
+        size_t num_cached = 0, errors;
+        char resolve = 0, check = 0, codegen = 0;
+        const char *trace_path = NULL;
+        uint64_t wall, start, t_list, t_files;
+        Decl **ast;
+
+        wall = nanotime();
+        for (int i = 1; i < argc; i++) {
+                if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+                        num_threads = atoi(argv[++i]);
+                else if (strcmp(argv[i], "--time") == 0)
+                        profiling = 1;
+                else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+                        trace_path = argv[++i];
+                else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+                        ast_cache_dir = argv[++i];
+                else if (strcmp(argv[i], "--resolve") == 0)
+                        resolve = 1;
+                else if (strcmp(argv[i], "--check") == 0)
+                        resolve = check = 1;
+                else if (strcmp(argv[i], "--codegen") == 0)
+                        resolve = check = codegen = 1;
+                else if (is_dir(argv[i]))
+                        status |= add_package(&jobs, argv[i]) != 0;
+                else    buf_push(jobs, (ParseJob) {.name = argv[i]});
+        }
+        if (jobs == NULL && status == 0)
+                buf_push(jobs, (ParseJob) {.name = "example.ion"});
+        t_list = nanotime() - wall;
+        if (trace_path)
+                start_tracing();
+
+        start = nanotime();
+        run_jobs(parse_job, jobs, buf__len(jobs), num_threads);
+        t_files = nanotime() - start;
+        for (size_t i = 0; i < buf__len(jobs); i++) {
+                if (jobs[i].src == NULL)
+                        status = 1;
+                num_cached += jobs[i].cached;
+        }
 
-        stream = fopen(name, "r");
-        if (stream == NULL) goto error;
+        start = profile_start();
+        ast = merge_decls(jobs, buf__len(jobs));
+        profile_end(PHASE_MERGE, start, 0, 0, 0);
+        // syntax errors of every file, whichever thread parsed it
+        status |= num_errors != 0;
+
+        if (resolve) {
+                start = profile_start();
+                errors = num_errors;
+                init_resolver();
+                resolve_decls(ast, buf__len(ast));
+                if (resolve_entry("main") == NULL)
+                        resolve_all();
+                status |= num_errors != errors;
+                profile_end(PHASE_RESOLVE, start, 0, 0, 0);
+        }
+        if (check) {
+                start = profile_start();
+                errors = num_errors;
+                check_resolved();
+                status |= num_errors != errors;
+                profile_end(PHASE_CHECK, start, 0, 0, checked_exprs);
+        }
+        if (codegen && status == 0) {
+                start = profile_start();
+                codegen_resolved();
+                status |= num_errors != 0;
+                profile_end(PHASE_CODEGEN, start, buf__len(x64_code), 0, generated_funcs);
+        }
 
-        while (c = fgetc(stream), c != EOF) {
-                if (errno) goto error;
-                buf_push(content, c);
+        start = profile_start();
+        print_ast(ast, buf__len(ast));
+        profile_end(PHASE_PRINT, start, 0, 0, 0);
+
+        if (profiling) {
+                fprintf(stderr, "time: %zu files (%zu cached), %zu decls, %d threads\n",
+                        buf__len(jobs), num_cached, buf__len(ast), num_threads);
+                fprintf(stderr, "time: list %.2f ms, files %.2f ms wall\n",
+                        t_list / 1e6, t_files / 1e6);
+                if (resolve)
+                        fprintf(stderr, "time: resolved %zu of %zu globals\n",
+                                buf__len(resolved_syms), buf__len(global_symbols));
+                if (codegen && status == 0)
+                        fprintf(stderr, "time: generated %zu bytes of code for %zu functions\n",
+                                buf__len(x64_code), generated_funcs);
+                print_profile(stderr, nanotime() - wall);
         }
-        if (errno) goto error;
-        return content;
-error:
-        perror("read_file");
-        return NULL;
-}
 
+        if (trace_path) {
+                status |= write_trace(trace_path) != 0;
+                free_trace();
+        }
 
+        buf_free(ast);
+        free_parse_jobs(jobs, buf__len(jobs));
+        buf_free(jobs);
+        return status;
+}
+#else
 int dump_ast(int argc, char **argv)
 {
         Decl **ast = NULL;
-        const char *name, *content;
+        const char *name;
+        Source *src;
 
         if (argc < 2)
                 name = "example.ion";
         else    name = argv[1];
 
-        content = read_file(name);
-        if (content == NULL)
+        src = load_source(name);
+        if (src == NULL)
                 return 1;
 
-        init_lex(name, content);
-#ifndef BRAND_NEW_PARSER
-        ast = recursive_descent_parser();
-#else
+        init_lex(src->name, src->text);
         recursive_descent_parser(&ast);
-#endif
 
-        print_ast(ast, buf_len(ast));
+        print_ast(ast, buf__len(ast));
         return 0;
 }
+#endif
 
 
 int main(int argc, char **argv)
 {
         regression_tests();
+        select_lex_simd(LEX_SIMD_AUTO);
         return MAIN(argc, argv);
 }
 
@@ -2,27 +2,63 @@
 #include <ctype.h>
 #include <errno.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "error_reporting.h"
+#include "hash.h"
 #include "stretchy_buffer.h"
+#include "arena.h"
+#include "jobs.h"
 #include "string_interning.h"
+#include "source.h"
+#include "srcpos.h"
+#include "timer.h"
+#include "trace.h"
+#include "profile.h"
 
-#include "tokens.h"
 #include "keywords.h"
+#include "tokens.h"
 #include "lex.h"
+#include "lex_simd.h"
+#include "token_buffer.h"
 
 #include "ast.h"
+#include "flat_ast.h"
 #ifndef BRAND_NEW_PARSER
 #include "parser.h"
 #else
 #include "parser_new.h"
 #endif
 
+#include "types.h"
+#include "symbols.h"
+#include "resolve.h"
+#include "const_eval.h"
+#include "check.h"
+#include "x64.h"
+#include "codegen.h"
+
+#ifndef BRAND_NEW_PARSER
+#include "ast_cache.h"
+#include "driver.h"
+#endif
+
 #include "ast_print.h"
+#include "corpus.h"
+#include "benchmarks.h"
 #include "lex_tests.h"
 #ifndef BRAND_NEW_PARSER
 #include "parser_tests.h"
@@ -0,0 +1,689 @@
+#ifndef ION_CONST_EVAL
+#define ION_CONST_EVAL
+
+// Evaluates constant expressions: literals, constants and enum values,
+// sizeof, casts to arithmetic types and the arithmetic, bitwise, logical
+// and comparison operators over them.  Values have the types the checker
+// gives the expressions, with C's promotions and usual arithmetic
+// conversions, and integers wrap to the size of their type.  Names are
+// looked up with sym_get, so expressions must have been resolved first.
+//
+// The resolver evaluates const declarations, enum values and array
+// lengths with this, and folds the expressions of function bodies with
+// fold_expr, replacing constant subexpressions by literals.
+
+typedef struct Val {
+        Type *type; // float_val if TYPE_FLOAT
+        union {
+                int64_t int_val;
+                double float_val;
+        };
+} Val;
+
+// what made the last evaluation fail, why is NULL where the resolver
+// reported it already
+static Expr *const_bad;
+static const char *const_why;
+
+
+static char not_const(Expr *e, const char *why)
+{
+        const_bad = e;
+        const_why = why;
+        return 0;
+}
+
+
+static void report_not_const(void)
+{
+        if (const_why == NULL)
+                return;
+        if (const_bad->kind == EXPR_NAME)
+                log_error_at(const_bad->pos, "%s is not a constant", const_bad->name);
+        else    log_error_at(const_bad->pos, "%s", const_why);
+}
+
+
+#define is_integer(t) ((t)->kind == TYPE_INT || (t)->kind == TYPE_CHAR || (t)->kind == TYPE_ENUM)
+
+
+static char is_arithmetic(Type *type)
+{
+        switch (type->kind) {
+        case TYPE_CHAR:
+        case TYPE_INT:
+        case TYPE_ENUM:
+        case TYPE_FLOAT:
+                return 1;
+        default:
+                return 0;
+        }
+}
+
+
+// integers smaller than int and enums compute as int
+static Type *promote(Type *type)
+{
+        if (type->kind == TYPE_ENUM || (is_integer(type) && type->size < type_int->size))
+                return type_int;
+        return type;
+}
+
+
+// the type both operands of arithmetic convert to
+static Type *arith_type(Type *a, Type *b)
+{
+        if (a->kind == TYPE_FLOAT || b->kind == TYPE_FLOAT) {
+                if (a->kind != TYPE_FLOAT)
+                        return b;
+                if (b->kind != TYPE_FLOAT)
+                        return a;
+                return a->size >= b->size ? a : b;
+        }
+        a = promote(a);
+        b = promote(b);
+        if (a == b || a->size != b->size)
+                return a->size >= b->size ? a : b;
+        return a->is_unsigned ? a : b;
+}
+
+
+// wraps to the size of an integer type
+static int64_t truncate_int(int64_t i, Type *type)
+{
+        int bits = type->size * 8;
+
+        if (bits >= 64)
+                return i;
+        if (type->is_unsigned)
+                return (uint64_t) i & ((1ull << bits) - 1);
+        return (int64_t) ((uint64_t) i << (64 - bits)) >> (64 - bits);
+}
+
+
+// typed like an integer literal, int if it fits, int64_t otherwise
+static void set_int_val(Val *v, int64_t i)
+{
+        v->type = i >= INT32_MIN && i <= INT32_MAX ? type_int : type_int64;
+        v->int_val = i;
+}
+
+
+static void set_val(Val *v, Type *type, int64_t i)
+{
+        v->type = type;
+        v->int_val = truncate_int(i, type);
+}
+
+
+static void set_float_val(Val *v, Type *type, double f)
+{
+        v->type = type;
+        v->float_val = type->size == 4 ? (float) f : f;
+}
+
+
+#define is_float_val(v) ((v)->type->kind == TYPE_FLOAT)
+#define val_as_float(v) (is_float_val(v) ? (v)->float_val : (v)->type->is_unsigned ? \
+        (double) (uint64_t) (v)->int_val : (double) (v)->int_val)
+#define val_truth(v) (is_float_val(v) ? (v)->float_val != 0 : (v)->int_val != 0)
+
+
+// converts v to an arithmetic type as C does, for casts and operands
+static char convert_val(Expr *e, Val *v, Type *type)
+{
+        if (type->kind == TYPE_FLOAT) {
+                set_float_val(v, type, val_as_float(v));
+                return 1;
+        }
+        if (is_float_val(v)) {
+                if (!(v->float_val > -9.3e18 && v->float_val < 9.3e18))
+                        return not_const(e, "float out of range of the integer type");
+                set_val(v, type, v->float_val);
+        } else {
+                set_val(v, type, v->int_val);
+        }
+        return 1;
+}
+
+
+char eval_const(Expr *e, Val *v);
+
+
+static char eval_name(Expr *e, Val *v)
+{
+        Sym *sym = sym_get(e->name);
+
+        if (sym == NULL || sym->state == SYM_RESOLVING)
+                return not_const(e, NULL);
+        if (sym->kind != SYM_CONST && sym->kind != SYM_ENUM_CONST)
+                return not_const(e, "not a constant");
+        if (sym->type == NULL)
+                return not_const(e, NULL);
+        v->type = sym->type;
+        if (is_float_val(v))
+                v->float_val = sym->float_val;
+        else    v->int_val = sym->val;
+        return 1;
+}
+
+
+static char eval_unary(Expr *e, Val *v)
+{
+        if (e->unary.is_postfix)
+                return not_const(e, "not a constant expression");
+        switch (e->unary.op) {
+        case TOKEN_ADD:
+        case TOKEN_SUB:
+        case TOKEN_NEG:
+        case TOKEN_NOT:
+                break;
+        default:
+                return not_const(e, "not a constant expression");
+        }
+        if (!eval_const(e->unary.expr, v))
+                return 0;
+        switch (e->unary.op) {
+        case TOKEN_ADD:
+        case TOKEN_SUB:
+                if (is_float_val(v))
+                        set_float_val(v, v->type, e->unary.op == TOKEN_SUB ? -v->float_val : v->float_val);
+                else if (e->unary.op == TOKEN_SUB)
+                        set_val(v, promote(v->type), -(uint64_t) v->int_val);
+                else    set_val(v, promote(v->type), v->int_val);
+                break;
+        case TOKEN_NEG:
+                if (is_float_val(v))
+                        return not_const(e, "~ of a float");
+                set_val(v, promote(v->type), ~v->int_val);
+                break;
+        default:
+                set_val(v, type_int, !val_truth(v));
+        }
+        return 1;
+}
+
+
+static char eval_float_binary(Expr *e, Type *type, double a, double b, Val *v)
+{
+        switch (e->binary.op) {
+        case TOKEN_ADD: set_float_val(v, type, a + b); break;
+        case TOKEN_SUB: set_float_val(v, type, a - b); break;
+        case TOKEN_MUL: set_float_val(v, type, a * b); break;
+        case TOKEN_DIV: set_float_val(v, type, a / b); break;
+        case TOKEN_EQ: set_val(v, type_int, a == b); break;
+        case TOKEN_NEQ: set_val(v, type_int, a != b); break;
+        case TOKEN_LT: set_val(v, type_int, a < b); break;
+        case TOKEN_GT: set_val(v, type_int, a > b); break;
+        case TOKEN_LTEQ: set_val(v, type_int, a <= b); break;
+        case TOKEN_GTEQ: set_val(v, type_int, a >= b); break;
+        default:
+                return not_const(e, "integer operator on a float");
+        }
+        return 1;
+}
+
+
+// a and b converted to type, which is int or bigger, unsigned ones
+// divide and compare as unsigned
+static char eval_int_binary(Expr *e, Type *type, int64_t a, int64_t b, Val *v)
+{
+        uint64_t ua = a, ub = b;
+        char is_unsigned = type->is_unsigned;
+
+        switch (e->binary.op) {
+        case TOKEN_ADD: set_val(v, type, ua + ub); break;
+        case TOKEN_SUB: set_val(v, type, ua - ub); break;
+        case TOKEN_MUL: set_val(v, type, ua * ub); break;
+        case TOKEN_DIV:
+        case TOKEN_MOD:
+                if (b == 0)
+                        return not_const(e, "division by zero");
+                if (is_unsigned) {
+                        set_val(v, type, e->binary.op == TOKEN_DIV ? ua / ub : ua % ub);
+                        break;
+                }
+                // the most negative value of the type by -1
+                if (b == -1 && a == (int64_t) (UINT64_MAX << (type->size * 8 - 1)))
+                        return not_const(e, "integer overflow in division");
+                set_val(v, type, e->binary.op == TOKEN_DIV ? a / b : a % b);
+                break;
+        case TOKEN_AND: set_val(v, type, a & b); break;
+        case TOKEN_OR: set_val(v, type, a | b); break;
+        case TOKEN_XOR: set_val(v, type, a ^ b); break;
+        case TOKEN_EQ: set_val(v, type_int, a == b); break;
+        case TOKEN_NEQ: set_val(v, type_int, a != b); break;
+        case TOKEN_LT: set_val(v, type_int, is_unsigned ? ua < ub : a < b); break;
+        case TOKEN_GT: set_val(v, type_int, is_unsigned ? ua > ub : a > b); break;
+        case TOKEN_LTEQ: set_val(v, type_int, is_unsigned ? ua <= ub : a <= b); break;
+        case TOKEN_GTEQ: set_val(v, type_int, is_unsigned ? ua >= ub : a >= b); break;
+        default:
+                return not_const(e, "not a constant expression");
+        }
+        return 1;
+}
+
+
+// the left operand is promoted on its own, the count only has to be
+// less than the bits of its type
+static char eval_shift(Expr *e, Val *left, Val *right, Val *v)
+{
+        Type *type = promote(left->type);
+        uint64_t n = right->int_val;
+
+        if (is_float_val(left) || is_float_val(right))
+                return not_const(e, "integer operator on a float");
+        if (n >= type->size * 8)
+                return not_const(e, "shift count out of range");
+        set_val(left, type, left->int_val);
+        if (e->binary.op == TOKEN_LSHIFT)
+                set_val(v, type, (uint64_t) left->int_val << n);
+        else if (type->is_unsigned)
+                set_val(v, type, (uint64_t) left->int_val >> n);
+        else    set_val(v, type, left->int_val >> n);
+        return 1;
+}
+
+
+static char eval_binary(Expr *e, Val *v)
+{
+        TokenKind op = e->binary.op;
+        Val left, right;
+        Type *type;
+
+        if (!eval_const(e->binary.left, &left) || !eval_const(e->binary.right, &right))
+                return 0;
+        if (op == TOKEN_LOGICAL_AND || op == TOKEN_LOGICAL_OR) {
+                set_val(v, type_int, op == TOKEN_LOGICAL_AND ?
+                        val_truth(&left) && val_truth(&right) :
+                        val_truth(&left) || val_truth(&right));
+                return 1;
+        }
+        if (op == TOKEN_LSHIFT || op == TOKEN_RSHIFT)
+                return eval_shift(e, &left, &right, v);
+        type = arith_type(left.type, right.type);
+        if (!convert_val(e, &left, type) || !convert_val(e, &right, type))
+                return 0;
+        if (type->kind == TYPE_FLOAT)
+                return eval_float_binary(e, type, left.float_val, right.float_val, v);
+        return eval_int_binary(e, type, left.int_val, right.int_val, v);
+}
+
+
+// both branches are evaluated for the type they convert to
+static char eval_ternary(Expr *e, Val *v)
+{
+        Val cond, other;
+
+        if (!eval_const(e->ternary.cond, &cond))
+                return 0;
+        if (!eval_const(e->ternary.expr, val_truth(&cond) ? v : &other) ||
+                !eval_const(e->ternary.or_expr, val_truth(&cond) ? &other : v))
+                        return 0;
+        return convert_val(e, v, arith_type(v->type, other.type));
+}
+
+
+static char eval_cast(Expr *e, Val *v)
+{
+        Type *type = e->cast.type->type;
+
+        if (!eval_const(e->cast.expr, v))
+                return 0;
+        if (type == NULL || !is_arithmetic(type))
+                return not_const(e, "cast to a non arithmetic type");
+        return convert_val(e, v, type);
+}
+
+
+// sizeof of an expression needs the type checker, except for names
+// with a known type
+static char eval_sizeof(Expr *e, Val *v)
+{
+        Type *type = NULL;
+        Sym *sym;
+
+        if (e->kind == EXPR_SIZEOF_TYPE) {
+                type = e->sizeof_type->type;
+        } else if (e->sizeof_expr->kind == EXPR_NAME) {
+                sym = sym_get(e->sizeof_expr->name);
+                if (sym && sym->kind != SYM_TYPE)
+                        type = sym->type;
+        }
+        if (type == NULL || type->kind == TYPE_INCOMPLETE || type->kind == TYPE_COMPLETING)
+                return not_const(e, "sizeof of an expression of unknown size");
+        set_val(v, type_size_t, type->size);
+        return 1;
+}
+
+
+// Returns 0 if e is not constant, then report_not_const tells why.
+char eval_const(Expr *e, Val *v)
+{
+        switch (e->kind) {
+        case EXPR_INT:
+                set_int_val(v, e->int_val);
+                return 1;
+        case EXPR_FLOAT:
+                set_float_val(v, type_double, e->float_val);
+                return 1;
+        case EXPR_NAME:
+                return eval_name(e, v);
+        case EXPR_UNARY:
+                return eval_unary(e, v);
+        case EXPR_BINARY:
+                return eval_binary(e, v);
+        case EXPR_TERNARY:
+                return eval_ternary(e, v);
+        case EXPR_CAST:
+                return eval_cast(e, v);
+        case EXPR_SIZEOF:
+        case EXPR_SIZEOF_TYPE:
+                return eval_sizeof(e, v);
+        default:
+                return not_const(e, "not a constant expression");
+        }
+}
+
+
+// for array lengths and enum values, reports errors
+char eval_int_const(Expr *e, int64_t *val)
+{
+        Val v;
+
+        if (!eval_const(e, &v)) {
+                report_not_const();
+                return 0;
+        }
+        if (is_float_val(&v)) {
+                log_error_at(e->pos, "expected an integer constant");
+                return 0;
+        }
+        *val = v.int_val;
+        return 1;
+}
+
+
+// the value and type of a const declaration, its type stays NULL if
+// it is not constant
+void eval_const_sym(Sym *sym, Expr *e)
+{
+        Val v;
+
+        if (!eval_const(e, &v)) {
+                report_not_const();
+                return;
+        }
+        sym->type = v.type;
+        if (is_float_val(&v))
+                sym->float_val = v.float_val;
+        else    sym->val = v.int_val;
+}
+
+
+static char is_assign_kind(TokenKind op)
+{
+        return op >= TOKEN_ASSIGN && op <= TOKEN_OR_ASSIGN;
+}
+
+
+#define is_literal(e) ((e)->kind == EXPR_INT || (e)->kind == EXPR_FLOAT)
+#define is_const_leaf(e) (is_literal(e) || (e)->kind == EXPR_NAME || \
+        (e)->kind == EXPR_SIZEOF || (e)->kind == EXPR_SIZEOF_TYPE)
+
+
+// The type the checker will give e if it is int, int64_t or double,
+// the types of literals, NULL otherwise or if it can't be told yet.
+static Type *fold_type(Expr *e)
+{
+        Type *l, *r, *type = NULL;
+        Sym *sym;
+
+        switch (e->kind) {
+        case EXPR_INT:
+                return e->int_val >= INT32_MIN && e->int_val <= INT32_MAX ? type_int : type_int64;
+        case EXPR_FLOAT:
+                return type_double;
+        case EXPR_NAME:
+                sym = sym_get(e->name);
+                if (sym && sym->kind != SYM_TYPE && sym->kind != SYM_FUNC)
+                        type = sym->type;
+                break;
+        case EXPR_CAST:
+                type = e->cast.type->type;
+                break;
+        case EXPR_UNARY:
+                if (e->unary.op == TOKEN_NOT)
+                        return type_int;
+                if (e->unary.op != TOKEN_AND && e->unary.op != TOKEN_MUL)
+                        type = fold_type(e->unary.expr);
+                break;
+        case EXPR_BINARY:
+                l = fold_type(e->binary.left);
+                r = fold_type(e->binary.right);
+                if (l == NULL || r == NULL || is_assign_kind(e->binary.op))
+                        return NULL;
+                if (e->binary.op >= TOKEN_EQ && e->binary.op <= TOKEN_LOGICAL_OR)
+                        return type_int;
+                if (e->binary.op == TOKEN_LSHIFT || e->binary.op == TOKEN_RSHIFT)
+                        return l;
+                if (l == type_double || r == type_double)
+                        return type_double;
+                return l == type_int64 || r == type_int64 ? type_int64 : type_int;
+        default:
+                break;
+        }
+        if (type == type_int || type == type_int64 || type == type_double)
+                return type;
+        return NULL;
+}
+
+
+// Replaces constant subexpressions by literals.  Children are folded
+// first and a node is only evaluated when its operands are literals or
+// names, so every node is looked at once.  A node is only folded into
+// a literal the type checker gives the type of its value, so an int
+// sum overflowing folds to the int it wraps to but cast(int64_t) 1 or
+// unsigned values stay.
+void fold_expr(Expr *e)
+{
+        char leaves = 1;
+        Expr *taken;
+        Type *type;
+        Val v;
+
+        if (e == NULL)
+                return;
+        switch (e->kind) {
+        case EXPR_CAST:
+                fold_expr(e->cast.expr);
+                leaves = is_const_leaf(e->cast.expr);
+                break;
+        case EXPR_CALL:
+                for (size_t i = 0; i < e->call.num_args; i++)
+                        fold_expr(e->call.args[i]);
+                return;
+        case EXPR_INDEX:
+                fold_expr(e->index.oexpr);
+                fold_expr(e->index.iexpr);
+                return;
+        case EXPR_FIELD:
+                fold_expr(e->field.expr);
+                return;
+        case EXPR_UNARY:
+                // operands of & ++ -- are places, not values
+                if (    e->unary.op == TOKEN_AND || e->unary.op == TOKEN_INC ||
+                        e->unary.op == TOKEN_DEC) {
+                                return;
+                }
+                fold_expr(e->unary.expr);
+                leaves = is_const_leaf(e->unary.expr);
+                break;
+        case EXPR_BINARY:
+                fold_expr(e->binary.right);
+                if (is_assign_kind(e->binary.op))
+                        return;
+                fold_expr(e->binary.left);
+                leaves = is_const_leaf(e->binary.left) && is_const_leaf(e->binary.right);
+                break;
+        case EXPR_TERNARY:
+                fold_expr(e->ternary.cond);
+                fold_expr(e->ternary.expr);
+                fold_expr(e->ternary.or_expr);
+                type = fold_type(e->ternary.expr);
+                if (!is_literal(e->ternary.cond) || type == NULL ||
+                        type != fold_type(e->ternary.or_expr))
+                                return;
+                if (e->ternary.cond->kind == EXPR_INT ?
+                        e->ternary.cond->int_val != 0 : e->ternary.cond->float_val != 0)
+                                taken = e->ternary.expr;
+                else            taken = e->ternary.or_expr;
+                *e = *taken;
+                return;
+        case EXPR_NAME:
+        case EXPR_SIZEOF:
+        case EXPR_SIZEOF_TYPE:
+                break;
+        default:
+                return;
+        }
+        if (!leaves || !eval_const(e, &v))
+                return;
+        if (v.type == type_double) {
+                e->kind = EXPR_FLOAT;
+                e->float_val = v.float_val;
+        } else if ((v.type == type_int || v.type == type_int64) &&
+                (v.int_val >= INT32_MIN && v.int_val <= INT32_MAX) == (v.type == type_int)) {
+                        e->kind = EXPR_INT;
+                        e->int_val = v.int_val;
+        }
+}
+
+
+// constant declarations and what function bodies fold to
+void const_eval_test()
+{
+        size_t errors = num_errors;
+        Decl **ast;
+        Stmt **body;
+        Sym *sym;
+
+        num_errors = 0;
+        ast = parse_resolve_test(
+                "const A = 1 << 4\n"
+                "const B = A * 3 + C\n"
+                "const C = cast(uint8_t) 300 + cast(int) -2.75\n"
+                "const D = 1.5 * A\n"
+                "const E = sizeof(:S) + sizeof(v)\n"
+                "const F = (A > 10 ? -1 : 1) % 7 + !0 + ~0 + 0xffffffff\n"
+                "const G = cast(char) 200\n"
+                "const U = (cast(uint32_t) 1) - 2\n"
+                "const U_DIV = (cast(uint64_t) -1) / 2\n"
+                "const U_MOD = (cast(uint32_t) -1) % 10\n"
+                "const U_SHR = (cast(uint64_t) -1) >> 60\n"
+                "const U_CMP = ((cast(uint64_t) -1) > 0) + ((cast(uint32_t) 1) > -1) * 2\n"
+                "const S_SHR = -16 >> 2\n"
+                "const BIG = 65536 * 65536\n"
+                "const SMALL = (cast(uint8_t) 200) + (cast(uint8_t) 100)\n"
+                "const F32 = (cast(float) 1.1) + 1\n"
+                "const MIXED = 1 ? 2 : 3.5\n"
+                "enum Color { RED = A, GREEN, BLUE = GREEN * 2 }\n"
+                "struct S { a: char; b: int[BLUE] }\n"
+                "var v: int64_t\n"
+                "func f(x: int, K: int): int {\n"
+                "        y := A + 2 * 3\n"
+                "        x = (1 ? x : 2) + K + 1.5 * 2\n"
+                "        return cast(char) 300 + (x + 1 * 2)\n"
+                "        z := cast(int64_t) 1\n"
+                "        w := 2000000000 + 2000000000\n"
+                "        u := cast(uint64_t) 2 * 3\n"
+                "}\n");
+        resolve_all();
+        assert(num_errors == 0);
+
+#define const_sym(name) ((Sym *) map_get(&global_symbols_map, str_intern(name)))
+        assert(const_sym("A")->val == 16 && const_sym("A")->type == type_int);
+        assert(const_sym("C")->val == 42);
+        assert(const_sym("B")->val == 90);
+        assert(const_sym("D")->type == type_double && const_sym("D")->float_val == 24);
+        assert(const_sym("GREEN")->val == 17 && const_sym("BLUE")->val == 34);
+        assert(const_sym("E")->val == 4 + 34 * 4 + 8);
+        assert(const_sym("F")->val == -1 + 1 - 1 + 0xffffffff);
+        assert(const_sym("F")->type == type_int64);
+        assert(const_sym("G")->val == -56 && const_sym("G")->type == type_char);
+        assert(const_sym("E")->type == type_size_t);
+
+        // typed and wrapped as C does, unsigned ones divide, shift and
+        // compare as unsigned
+        assert(const_sym("U")->val == 0xffffffff && const_sym("U")->type->is_unsigned);
+        assert(const_sym("U")->type->size == 4);
+        assert(const_sym("U_DIV")->val == INT64_MAX);
+        assert(const_sym("U_MOD")->val == 0xffffffffu % 10);
+        assert(const_sym("U_SHR")->val == 15);
+        assert(const_sym("U_CMP")->val == 1 && const_sym("U_CMP")->type == type_int);
+        assert(const_sym("S_SHR")->val == -4);
+        assert(const_sym("BIG")->val == 0 && const_sym("BIG")->type == type_int);
+        assert(const_sym("SMALL")->val == 300 && const_sym("SMALL")->type == type_int);
+        assert(const_sym("F32")->type == type_float && const_sym("F32")->float_val == 1.1f + 1.0f);
+        assert(const_sym("MIXED")->type == type_double && const_sym("MIXED")->float_val == 2);
+#undef const_sym
+
+        // y := 22, x = x + K + 3.0, return cast(char) (300 + (x + 2))
+        body = ast[buf_len(ast) - 1]->func.body->block.stmt;
+        assert(body[0]->expr->binary.right->kind == EXPR_INT);
+        assert(body[0]->expr->binary.right->int_val == 22);
+        assert(body[1]->expr->binary.right->binary.left->binary.left->kind == EXPR_NAME);
+        assert(body[1]->expr->binary.right->binary.left->binary.right->kind == EXPR_NAME);
+        assert(body[1]->expr->binary.right->binary.right->kind == EXPR_FLOAT);
+        assert(body[2]->expr->kind == EXPR_CAST);
+        assert(body[2]->expr->cast.expr->binary.right->binary.right->int_val == 2);
+
+        // folding keeps types, z is int64_t and w an int that wrapped
+        assert(body[3]->expr->binary.right->kind == EXPR_CAST);
+        assert(body[4]->expr->binary.right->kind == EXPR_INT);
+        assert(body[4]->expr->binary.right->int_val == (int32_t) 4000000000u);
+        assert(body[5]->expr->binary.right->kind == EXPR_CAST);
+
+        // errors
+        ast_free();
+        buf_free(ast);
+        ast = parse_resolve_test(
+                "const A = 1 / 0\n"
+                "const B = A + 1\n"
+                "const C = 1 << 64\n"
+                "var v = 1\n"
+                "const D = v\n"
+                "const E = 1.5 % 2\n"
+                "struct S { a: int[2.5] }\n"
+                "enum F { F0 = F1, F1 }\n"
+                "func f(): int { return 1 / 0 }\n");
+        quiet_errors = 1;
+        sym = resolve_entry("A");
+        assert(num_errors == 1 && sym->type == NULL);
+        resolve_entry("B");
+        assert(num_errors == 1);
+        resolve_entry("C");
+        assert(num_errors == 2);
+        resolve_entry("D");
+        assert(num_errors == 3);
+        resolve_entry("E");
+        assert(num_errors == 4);
+        resolve_entry("S");
+        assert(num_errors == 5);
+        resolve_entry("F0");
+        assert(num_errors == 6);
+        resolve_entry("f");
+        assert(num_errors == 6);
+        quiet_errors = 0;
+
+        ast_free();
+        buf_free(ast);
+        buf_free(resolved_syms);
+        sym_reset_globals();
+        num_errors = errors;
+}
+
+#undef is_literal
+#undef is_const_leaf
+
+#endif
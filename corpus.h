@@ -0,0 +1,338 @@
+#ifndef ION_CORPUS
+#define ION_CORPUS
+
+// Synthetic Ion programs for benchmarks.  The output only depends on
+// the shape, size and seed, so runs on different machines and
+// compiler versions see the same text.  Every shape repeats one kind
+// of unit until the text reaches the requested size:
+//
+//      mixed           structs, enums, constants and medium functions
+//      deep_expr       constants with expressions nested 200 deep
+//      switch          functions with a switch of 1000 cases
+//      structs         structs of 32 fields that point to each other
+//      long_func       functions of 2000 statements
+
+typedef enum CorpusShape {
+        CORPUS_MIXED,
+        CORPUS_DEEP_EXPR,
+        CORPUS_SWITCH,
+        CORPUS_STRUCTS,
+        CORPUS_LONG_FUNC,
+        NUM_CORPUS_SHAPES
+} CorpusShape;
+
+const char *corpus_shape_name[NUM_CORPUS_SHAPES] = {
+        [CORPUS_MIXED] = "mixed",
+        [CORPUS_DEEP_EXPR] = "deep_expr",
+        [CORPUS_SWITCH] = "switch",
+        [CORPUS_STRUCTS] = "structs",
+        [CORPUS_LONG_FUNC] = "long_func",
+};
+
+typedef struct Corpus {
+        char *text;
+        uint64_t rng;
+        size_t unit; // units generated so far, used for unique names
+} Corpus;
+
+#define corpus_put(c, ...) ((c)->text = buf_printf((c)->text, __VA_ARGS__))
+
+
+// xorshift64*
+static uint64_t corpus_rand(Corpus *c)
+{
+        c->rng ^= c->rng >> 12;
+        c->rng ^= c->rng << 25;
+        c->rng ^= c->rng >> 27;
+        return c->rng * 0x2545f4914f6cdd1dull;
+}
+
+#define corpus_pick(c, n) (corpus_rand(c) % (n))
+#define corpus_pick_str(c, arr) ((arr)[corpus_pick(c, sizeof(arr) / sizeof(*(arr)))])
+
+
+static void corpus_indent(Corpus *c, int level)
+{
+        corpus_put(c, "%*s", 8 * level, "");
+}
+
+
+static void gen_operand(Corpus *c)
+{
+        static const char *names[] = {
+                "a", "b", "n", "total", "count", "v.x", "v.next.y", "arr[i]", "p.len",
+        };
+
+        switch (corpus_pick(c, 5)) {
+        case 0:
+                corpus_put(c, "%llu", (unsigned long long) corpus_pick(c, 1000));
+                break;
+        case 1:
+                corpus_put(c, "0x%llx", (unsigned long long) corpus_pick(c, 1 << 20));
+                break;
+        case 2:
+                // the lexer takes a leading 0 for octal, so no 0.5
+                corpus_put(c, "%llu.%llu", (unsigned long long) corpus_pick(c, 99) + 1,
+                        (unsigned long long) corpus_pick(c, 100));
+                break;
+        default:
+                corpus_put(c, "%s", corpus_pick_str(c, names));
+        }
+}
+
+
+// One operand of every node is as deep as the node allows and the
+// others are shallow, so the text grows linearly with depth.
+static void gen_expr(Corpus *c, int depth)
+{
+        static const char *binary_ops[] = {
+                "+", "-", "*", "/", "%", "<<", ">>", "&", "|", "^",
+                "&&", "||", "==", "!=", "<", "<=", ">", ">=",
+        };
+        static const char *unary_ops[] = {"-", "!", "~", "*", "&"};
+
+        if (depth <= 0) {
+                gen_operand(c);
+                return;
+        }
+        switch (corpus_pick(c, 10)) {
+        case 0:
+                corpus_put(c, "%s(", corpus_pick_str(c, unary_ops));
+                gen_expr(c, depth - 1);
+                corpus_put(c, ")");
+                break;
+        case 1:
+                corpus_put(c, "f%llu(", (unsigned long long) corpus_pick(c, 16));
+                gen_expr(c, depth - 1);
+                corpus_put(c, ", ");
+                gen_operand(c);
+                corpus_put(c, ")");
+                break;
+        case 2:
+                corpus_put(c, "arr[");
+                gen_expr(c, depth - 1);
+                corpus_put(c, "]");
+                break;
+        case 3:
+                corpus_put(c, "(");
+                gen_operand(c);
+                corpus_put(c, " ? ");
+                gen_expr(c, depth - 1);
+                corpus_put(c, " : ");
+                gen_operand(c);
+                corpus_put(c, ")");
+                break;
+        case 4:
+                corpus_put(c, "cast(int) (");
+                gen_expr(c, depth - 1);
+                corpus_put(c, ")");
+                break;
+        default:
+                corpus_put(c, "(");
+                if (corpus_pick(c, 2)) {
+                        gen_expr(c, depth - 1);
+                        corpus_put(c, " %s ", corpus_pick_str(c, binary_ops));
+                        gen_operand(c);
+                } else {
+                        gen_operand(c);
+                        corpus_put(c, " %s ", corpus_pick_str(c, binary_ops));
+                        gen_expr(c, depth - 1);
+                }
+                corpus_put(c, ")");
+        }
+}
+
+
+static void gen_block(Corpus *c, int num_stmts, int depth, int level);
+
+
+static void gen_stmt(Corpus *c, int depth, int level)
+{
+        static const char *assign_ops[] = {"=", "+=", "-=", "*=", "|=", "^="};
+        int kind = corpus_pick(c, depth > 0 ? 12 : 6);
+
+        corpus_indent(c, level);
+        switch (kind) {
+        case 0:
+        case 1:
+                corpus_put(c, "t%zu := ", c->unit);
+                gen_expr(c, 3);
+                break;
+        case 2:
+        case 3:
+                corpus_put(c, "total %s ", corpus_pick_str(c, assign_ops));
+                gen_expr(c, 3);
+                break;
+        case 4:
+                corpus_put(c, "f%llu(", (unsigned long long) corpus_pick(c, 16));
+                gen_expr(c, 2);
+                corpus_put(c, ", count)");
+                break;
+        case 5:
+                corpus_put(c, "count++");
+                break;
+        case 6:
+        case 7:
+                corpus_put(c, "if (");
+                gen_expr(c, 2);
+                corpus_put(c, ") ");
+                gen_block(c, 3, depth - 1, level);
+                if (kind == 7) {
+                        corpus_put(c, " else ");
+                        gen_block(c, 2, depth - 1, level);
+                }
+                break;
+        case 8:
+                corpus_put(c, "while (count < %llu) ", (unsigned long long) corpus_pick(c, 100));
+                gen_block(c, 3, depth - 1, level);
+                break;
+        case 9:
+                corpus_put(c, "for (i := 0; i < n; i++) ");
+                gen_block(c, 3, depth - 1, level);
+                break;
+        case 10:
+                corpus_put(c, "do ");
+                gen_block(c, 2, depth - 1, level);
+                corpus_put(c, " while (");
+                gen_expr(c, 1);
+                corpus_put(c, ")");
+                break;
+        default:
+                corpus_put(c, "switch (count) {\n");
+                for (int i = 0; i < 3; i++) {
+                        corpus_indent(c, level);
+                        corpus_put(c, "case %d:\n", i);
+                        gen_stmt(c, 0, level + 1);
+                        corpus_put(c, "\n");
+                }
+                corpus_indent(c, level);
+                corpus_put(c, "default:\n");
+                corpus_indent(c, level + 1);
+                corpus_put(c, "break\n");
+                corpus_indent(c, level);
+                corpus_put(c, "}");
+        }
+}
+
+
+static void gen_block(Corpus *c, int num_stmts, int depth, int level)
+{
+        corpus_put(c, "{\n");
+        for (int i = 0; i < num_stmts; i++) {
+                gen_stmt(c, depth, level + 1);
+                corpus_put(c, "\n");
+        }
+        corpus_indent(c, level);
+        corpus_put(c, "}");
+}
+
+
+static void gen_func(Corpus *c, int num_stmts, int depth)
+{
+        corpus_put(c, "func fn%zu(v: Vec%zu*, arr: int*, n: int): int {\n", c->unit, c->unit);
+        corpus_put(c, "        total := 0\n");
+        corpus_put(c, "        count := 0\n");
+        for (int i = 0; i < num_stmts; i++) {
+                gen_stmt(c, depth, 1);
+                corpus_put(c, "\n");
+        }
+        corpus_put(c, "        return total\n}\n");
+}
+
+
+static void gen_struct(Corpus *c, int num_fields)
+{
+        static const char *types[] = {
+                "int", "float", "char*", "uint8_t[16]", "int const", "double",
+        };
+
+        corpus_put(c, "struct Vec%zu {\n", c->unit);
+        corpus_put(c, "        x: float\n        y: float\n");
+        corpus_put(c, "        next: Vec%zu*\n", c->unit);
+        for (int i = 3; i < num_fields; i++) {
+                if (c->unit > 0 && corpus_pick(c, 4) == 0)
+                        corpus_put(c, "        f%d: Vec%llu*\n", i,
+                                (unsigned long long) corpus_pick(c, c->unit));
+                else    corpus_put(c, "        f%d: %s\n", i, corpus_pick_str(c, types));
+        }
+        corpus_put(c, "}\n");
+}
+
+
+static void gen_unit(Corpus *c, CorpusShape shape)
+{
+        switch (shape) {
+        case CORPUS_MIXED:
+                gen_struct(c, 4);
+                corpus_put(c, "enum E%zu { A%zu = %zu, B%zu, C%zu }\n",
+                        c->unit, c->unit, c->unit, c->unit, c->unit);
+                corpus_put(c, "const LIMIT_%zu = ", c->unit);
+                gen_expr(c, 4);
+                corpus_put(c, "\n");
+                gen_func(c, 12, 2);
+                break;
+        case CORPUS_DEEP_EXPR:
+                corpus_put(c, "const DEEP_%zu = ", c->unit);
+                gen_expr(c, 200);
+                corpus_put(c, "\n");
+                break;
+        case CORPUS_SWITCH:
+                corpus_put(c, "func sw%zu(n: int): int {\n        switch (n) {\n", c->unit);
+                for (int i = 0; i < 1000; i++) {
+                        corpus_put(c, "        case %d:\n                return ", i);
+                        gen_expr(c, 2);
+                        corpus_put(c, "\n");
+                }
+                corpus_put(c, "        default:\n                return 0\n        }\n}\n");
+                break;
+        case CORPUS_STRUCTS:
+                gen_struct(c, 32);
+                break;
+        case CORPUS_LONG_FUNC:
+                gen_func(c, 2000, 1);
+                break;
+        default:
+                assert(0);
+        }
+}
+
+
+// at least size bytes of whole units, a stretchy buffer
+char *gen_ion_corpus(CorpusShape shape, size_t size, uint64_t seed)
+{
+        Corpus c = {.rng = hash_uint64(seed) | 1};
+
+        buf__fit(c.text, size + 4096);
+        while (buf__len(c.text) < size) {
+                gen_unit(&c, shape);
+                c.unit++;
+        }
+        return c.text;
+}
+
+
+// deterministic and free of syntax errors
+void corpus_test()
+{
+        size_t errors = num_errors;
+        Decl **ast;
+        char *a, *b;
+
+        for (CorpusShape shape = 0; shape < NUM_CORPUS_SHAPES; shape++) {
+                a = gen_ion_corpus(shape, 4096, 42);
+                init_lex(corpus_shape_name[shape], a);
+                ast = recursive_descent_parser();
+                assert(num_errors == errors && buf_len(ast) > 0);
+                buf_free(ast);
+                b = gen_ion_corpus(shape, 4096, 42);
+                assert(buf_len(a) >= 4096 && strcmp(a, b) == 0);
+                buf_free(b);
+                b = gen_ion_corpus(shape, 4096, 43);
+                assert(strcmp(a, b) != 0);
+                buf_free(b);
+                release_src_file(a);
+                buf_free(a);
+        }
+}
+
+#endif
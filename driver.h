@@ -0,0 +1,255 @@
+#ifndef ION_DRIVER
+#define ION_DRIVER
+
+// Parses several files at once.  Lexer state and the AST arena are
+// per thread, each file gets an arena of its own which is kept in
+// its ParseJob until free_parse_jobs.  So is num_errors, the errors of
+// each file are kept in its ParseJob too and added to the count of
+// the thread that merges the files.  With ast_cache_dir set, files
+// parsed before are loaded from the cache (see ast_cache.h) and files
+// parsed without errors are added to it.
+
+typedef struct ParseJob {
+        const char *name;
+        Source *src;
+        Decl **decls;
+        Arena arena;
+        size_t errors; // reported while parsing it
+        char loaded; // src was loaded here rather than passed in
+        char cached; // decls came from the AST cache
+} ParseJob;
+
+
+// With profiling or tracing on the file is lexed up front, like in
+// token buffer mode, so lexing and parsing can be timed apart.
+static Decl **parse_source(Source *src)
+{
+        uint64_t start;
+        size_t tokens;
+        Decl **decls;
+
+        if (!profiling && !tracing) {
+                init_lex(src->name, src->text);
+                return recursive_descent_parser();
+        }
+
+        start = nanotime();
+        filename = src->name;
+        fill_token_buffer(&lex_scratch, src->text);
+        tokens = buf_len(lex_scratch.kinds);
+        profile_end(PHASE_LEX, start, src->size, tokens, 0);
+
+        start = nanotime();
+        replay_tokens(&lex_scratch, src->name);
+        decls = recursive_descent_parser();
+        profile_end(PHASE_PARSE, start, src->size, tokens, ast_arena.num_allocs);
+        return decls;
+}
+
+
+static void parse_job(void *ctx, size_t i)
+{
+        ParseJob *job = (ParseJob *) ctx + i;
+        Arena saved = ast_arena;
+        uint64_t hash = 0, start, file_start = trace_begin();
+        size_t errors = num_errors;
+
+        if (job->src == NULL) {
+                start = profile_start();
+                job->src = load_source(job->name);
+                job->loaded = job->src != NULL;
+                profile_end(PHASE_LOAD, start, job->loaded ? job->src->size : 0, 0, 0);
+        }
+        if (job->src == NULL)
+                goto out;
+
+        ast_arena = (Arena) {0};
+        if (ast_cache_dir) {
+                start = profile_start();
+                hash = hash_text(job->src->text, job->src->size);
+                job->cached = load_ast_cache(job->src, hash, &job->decls);
+                profile_end(PHASE_CACHE, start, job->cached ? job->src->size : 0,
+                        0, ast_arena.num_allocs);
+        }
+        if (!job->cached) {
+                job->decls = parse_source(job->src);
+                if (ast_cache_dir && num_errors == errors) {
+                        start = profile_start();
+                        save_ast_cache(job->src, hash, job->decls);
+                        profile_end(PHASE_CACHE, start, 0, 0, 0);
+                }
+        }
+        job->arena = ast_arena;
+        ast_arena = saved;
+out:
+        // counted by merge_decls, on whichever thread that runs
+        job->errors = num_errors - errors;
+        num_errors = errors;
+        trace_end(file_start, "file", job->src ? job->src->name : job->name);
+}
+
+
+static int cmp_names(const void *a, const void *b)
+{
+        return strcmp(*(const char **) a, *(const char **) b);
+}
+
+
+// All .ion files of a directory make up one package, hidden files
+// are skipped.  Appends a job per file in name order, returns -1 if
+// the directory can't be read.
+int add_package(ParseJob **jobs_ptr, const char *dir)
+{
+        const char **names = NULL, *ext;
+        ParseJob *jobs = *jobs_ptr;
+        struct dirent *e;
+        char *path = NULL;
+        DIR *d;
+
+        d = opendir(dir);
+        if (d == NULL) {
+                perror(dir);
+                return -1;
+        }
+        buf_init(path);
+        while ((e = readdir(d)) != NULL) {
+                ext = strrchr(e->d_name, '.');
+                if (e->d_name[0] == '.' || ext == NULL || strcmp(ext, ".ion") != 0)
+                        continue;
+                buf_len(path) = 0;
+                path = buf_printf(path, "%s/%s", dir, e->d_name);
+                buf_push(names, str_intern(path));
+        }
+        closedir(d);
+
+        qsort(names, buf__len(names), sizeof(*names), cmp_names);
+        for (size_t i = 0; i < buf__len(names); i++)
+                buf_push(jobs, (ParseJob) {.name = names[i]});
+        *jobs_ptr = jobs;
+
+        buf_free(names);
+        buf_free(path);
+        return 0;
+}
+
+
+char is_dir(const char *path)
+{
+        struct stat st;
+        return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+
+// concatenates the declarations of all files in job order, and adds
+// the errors parsing them to this thread's num_errors
+Decl **merge_decls(ParseJob *jobs, size_t n)
+{
+        Decl **decls = NULL;
+        size_t len;
+
+        for (size_t i = 0; i < n; i++) {
+                num_errors += jobs[i].errors;
+                len = buf__len(jobs[i].decls);
+                if (len == 0)
+                        continue;
+                buf__fit(decls, len);
+                memcpy(decls + buf_len(decls), jobs[i].decls, len * sizeof(*decls));
+                buf_len(decls) += len;
+        }
+        return decls;
+}
+
+
+// files that fail to load contribute nothing and keep a NULL src
+Decl **parse_files(ParseJob *jobs, size_t n, int num_threads)
+{
+        run_jobs(parse_job, jobs, n, num_threads);
+        return merge_decls(jobs, n);
+}
+
+
+void free_parse_jobs(ParseJob *jobs, size_t n)
+{
+        for (size_t i = 0; i < n; i++) {
+                arena_free(&jobs[i].arena);
+                buf_free(jobs[i].decls);
+                if (jobs[i].loaded) {
+                        unload_source(jobs[i].src);
+                        jobs[i].src = NULL;
+                        jobs[i].loaded = 0;
+                }
+                jobs[i].cached = 0;
+                jobs[i].errors = 0;
+        }
+}
+
+
+static void quiet_parse_job(void *ctx, size_t i)
+{
+        quiet_errors = 1;
+        parse_job(ctx, i);
+        quiet_errors = 0;
+}
+
+
+// errors on worker threads reach the merging thread's count
+static void driver_errors_test(Source *srcs, size_t n)
+{
+        Source broken = {.name = "<driver_test>", .text = "func f(x: int): int { return (x + 1 }\n"};
+        ParseJob *jobs = calloc(n + 1, sizeof(ParseJob));
+        size_t errors = num_errors;
+        Decl **decls;
+
+        broken.size = strlen(broken.text);
+        for (size_t i = 0; i < n; i++)
+                jobs[i].src = srcs + i;
+        jobs[n / 2].src = &broken;
+        jobs[n].src = srcs + n / 2;
+        run_jobs(quiet_parse_job, jobs, n + 1, 8);
+        assert(num_errors == errors);
+        decls = merge_decls(jobs, n + 1);
+        assert(num_errors == errors + 1);
+        num_errors = errors;
+        buf_free(decls);
+        free_parse_jobs(jobs, n + 1);
+        free(jobs);
+}
+
+
+void driver_test()
+{
+        enum { NUM_FILES = 16, DECLS_PER_FILE = 50 };
+        Source srcs[NUM_FILES];
+        ParseJob jobs[NUM_FILES];
+        char *text, name[32];
+        Decl **decls;
+
+        for (int i = 0; i < NUM_FILES; i++) {
+                text = NULL;
+                for (int j = 0; j < DECLS_PER_FILE; j++)
+                        text = buf_printf(text, "func f%d_%d(x: int): int { return x * %d; }\n", i, j, j);
+                srcs[i] = (Source) {.name = "<driver_test>", .text = text, .size = buf_len(text)};
+        }
+
+        for (int threads = 1; threads <= 8; threads *= 2) {
+                memset(jobs, 0, sizeof(jobs));
+                for (int i = 0; i < NUM_FILES; i++)
+                        jobs[i].src = srcs + i;
+
+                decls = parse_files(jobs, NUM_FILES, threads);
+                assert(buf_len(decls) == NUM_FILES * DECLS_PER_FILE);
+                for (int i = 0; i < NUM_FILES * DECLS_PER_FILE; i++) {
+                        sprintf(name, "f%d_%d", i / DECLS_PER_FILE, i % DECLS_PER_FILE);
+                        assert(decls[i]->kind == DECL_FUNC);
+                        assert(decls[i]->name == str_intern(name));
+                }
+                buf_free(decls);
+                free_parse_jobs(jobs, NUM_FILES);
+        }
+        driver_errors_test(srcs, NUM_FILES);
+
+        for (int i = 0; i < NUM_FILES; i++)
+                buf_free(srcs[i].text);
+}
+
+#endif
@@ -2,8 +2,12 @@
 #define ERROR_REPORTING
 
 
-const char *filename;
-int line_number;
+// name given to the source being lexed, see srcpos.h for positions
+_Thread_local const char *filename;
+// errors reported by this thread so far
+_Thread_local size_t num_errors;
+// counts errors without printing them, for tests of error cases
+_Thread_local char quiet_errors;
 
 
 void error(const char *fmt, ...)
@@ -17,9 +21,13 @@ void error(const char *fmt, ...)
         va_end(args);
 }
 
-#define header(type) printf("%s:%d %s: ", filename, line_number, type)
-#define log_error(...) (header("error"), error(__VA_ARGS__))
-#define syntax_error(...) (header("error"), error(__VA_ARGS__))
+#define header(pos, type) (print_src_pos(pos), printf(" %s: ", type))
+// stdout is locked so lines from different threads don't interleave
+#define log_error_at(pos, ...) (num_errors++, quiet_errors ? (void) 0 : \
+        (flockfile(stdout), header(pos, "error"), error(__VA_ARGS__), \
+        funlockfile(stdout)))
+#define log_error(...) log_error_at(token.pos, __VA_ARGS__)
+#define syntax_error(...) log_error(__VA_ARGS__)
 #define fatal_error(...) (log_error(__VA_ARGS__), exit(1))
 
 #endif
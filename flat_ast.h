@@ -0,0 +1,664 @@
+#ifndef ION_FLAT_AST
+#define ION_FLAT_AST
+
+// A compact copy of the pointer AST.  Expressions, statements,
+// typespecs and declarations each live in their own array of 12 byte
+// nodes and refer to each other by 32-bit index, index 0 meaning none.
+// Nodes with more than two operands keep the rest in the shared extra
+// array, lists are stored there as a count followed by the items.
+// Names and string literals are referred to by index into strs.
+// The source position of every node is kept in a parallel array so
+// the nodes themselves stay small.  flatten_ast builds it from a
+// parsed pointer AST, unflatten_ast turns it back into one.
+//
+//      kind            a               b
+//      EXPR_NAME       str             -
+//      EXPR_INT        low 32 bits     high 32 bits
+//      EXPR_FLOAT      low 32 bits     high 32 bits
+//      EXPR_STR        str             -
+//      EXPR_CAST       typespec        expr
+//      EXPR_CALL       expr            extra: n, args...
+//      EXPR_INDEX      expr            expr
+//      EXPR_FIELD      expr            str
+//      EXPR_UNARY      expr            -               op, postfix in flags
+//      EXPR_BINARY     expr            expr            op
+//      EXPR_TERNARY    cond            extra: expr, or_expr
+//      EXPR_SIZEOF     expr            -
+//      EXPR_SIZEOF_TYPE typespec       -
+//
+//      TYPESPEC_NAME   str             -
+//      TYPESPEC_CONST  typespec        -
+//      TYPESPEC_PTR    typespec        -
+//      TYPESPEC_ARRAY  typespec        expr
+//      TYPESPEC_FUNCTION ret           extra: n, args...
+//
+//      STMT_RETURN     expr            -
+//      STMT_EXPR       expr            -
+//      STMT_IF         cond            extra: body, other
+//      STMT_WHILE      cond            stmt            also STMT_DO_WHILE
+//      STMT_FOR        extra: init, cond, step, body
+//      STMT_SWITCH     expr            extra: n, (expr, stmt)...
+//      STMT_BLOCK      extra: n, stmts...
+//
+//      DECL_TYPEDEF    str             typespec
+//      DECL_ENUM       str             extra: n, (str, expr)...
+//      DECL_STRUCT     str             extra: n, (str, typespec)...
+//      DECL_UNION      str             extra: n, (str, typespec)...
+//      DECL_CONST      str             extra: typespec, expr
+//      DECL_VAR        str             extra: typespec, expr
+//      DECL_FUNC       str             extra: ret, body, n, (str, typespec)...
+
+typedef uint32_t NodeRef;
+
+typedef struct FlatNode {
+        uint8_t kind;
+        uint8_t op;
+        uint16_t flags;
+        uint32_t a, b;
+} FlatNode;
+
+typedef struct FlatAst {
+        FlatNode *exprs;
+        FlatNode *stmts;
+        FlatNode *typespecs;
+        FlatNode *decls;
+        SrcPos *expr_pos;
+        SrcPos *stmt_pos;
+        SrcPos *typespec_pos;
+        SrcPos *decl_pos;
+        uint32_t *extra;
+        const char **strs;
+        Map str_index; // string -> index + 1
+} FlatAst;
+
+
+static NodeRef flat_push(FlatNode **nodes_ptr, SrcPos **pos_ptr,
+        FlatNode node, SrcPos pos)
+{
+        FlatNode *nodes = *nodes_ptr;
+        SrcPos *positions = *pos_ptr;
+
+        buf_push(nodes, node);
+        buf_push(positions, pos);
+        *nodes_ptr = nodes;
+        *pos_ptr = positions;
+        return buf_len(nodes) - 1;
+}
+
+
+static uint32_t flat_str(FlatAst *f, const char *str)
+{
+        uintptr_t index;
+
+        if (str == NULL)
+                return 0;
+
+        index = (uintptr_t) map_get(&f->str_index, str);
+        if (index == 0) {
+                buf_push(f->strs, str);
+                index = buf_len(f->strs);
+                map_put(&f->str_index, str, (void *) index);
+        }
+        return index - 1;
+}
+
+
+// reserves n extra slots, fill them in after converting the children
+// since converting may grow the array
+static uint32_t flat_extra(FlatAst *f, size_t n)
+{
+        uint32_t at = buf__len(f->extra);
+
+        buf__fit(f->extra, n);
+        memset(f->extra + at, 0, n * sizeof(uint32_t));
+        buf_len(f->extra) += n;
+        return at;
+}
+
+
+NodeRef flat_expr(FlatAst *f, Expr *e);
+NodeRef flat_stmt(FlatAst *f, Stmt *s);
+
+
+NodeRef flat_typespec(FlatAst *f, Typespec *t)
+{
+        FlatNode n = {0};
+        NodeRef ref;
+
+        if (t == NULL)
+                return 0;
+
+        n.kind = t->kind;
+        switch (t->kind) {
+        case TYPESPEC_NAME:
+                n.a = flat_str(f, t->name);
+                break;
+        case TYPESPEC_CONST:
+        case TYPESPEC_PTR:
+                n.a = flat_typespec(f, t->base);
+                break;
+        case TYPESPEC_ARRAY:
+                n.a = flat_typespec(f, t->array.base);
+                n.b = flat_expr(f, t->array.length);
+                break;
+        case TYPESPEC_FUNCTION:
+                n.a = flat_typespec(f, t->func.ret);
+                n.b = flat_extra(f, 1 + t->func.num_args);
+                f->extra[n.b] = t->func.num_args;
+                for (size_t i = 0; i < t->func.num_args; i++) {
+                        ref = flat_typespec(f, t->func.args[i]);
+                        f->extra[n.b + 1 + i] = ref;
+                }
+                break;
+        default:
+                assert(TYPESPEC_NONE);
+        }
+        return flat_push(&f->typespecs, &f->typespec_pos, n, t->pos);
+}
+
+
+NodeRef flat_expr(FlatAst *f, Expr *e)
+{
+        FlatNode n = {0};
+        NodeRef ref;
+        uint64_t bits;
+
+        if (e == NULL)
+                return 0;
+
+        n.kind = e->kind;
+        switch (e->kind) {
+        case EXPR_NAME:
+                n.a = flat_str(f, e->name);
+                break;
+        case EXPR_STR:
+                n.a = flat_str(f, e->str_val);
+                break;
+        case EXPR_INT:
+        case EXPR_FLOAT:
+                memcpy(&bits, &e->int_val, sizeof(bits));
+                n.a = bits;
+                n.b = bits >> 32;
+                break;
+        case EXPR_CAST:
+                n.a = flat_typespec(f, e->cast.type);
+                n.b = flat_expr(f, e->cast.expr);
+                break;
+        case EXPR_CALL:
+                n.a = flat_expr(f, e->call.expr);
+                n.b = flat_extra(f, 1 + e->call.num_args);
+                f->extra[n.b] = e->call.num_args;
+                for (size_t i = 0; i < e->call.num_args; i++) {
+                        ref = flat_expr(f, e->call.args[i]);
+                        f->extra[n.b + 1 + i] = ref;
+                }
+                break;
+        case EXPR_INDEX:
+                n.a = flat_expr(f, e->index.oexpr);
+                n.b = flat_expr(f, e->index.iexpr);
+                break;
+        case EXPR_FIELD:
+                n.a = flat_expr(f, e->field.expr);
+                n.b = flat_str(f, e->field.name);
+                break;
+        case EXPR_UNARY:
+                n.op = e->unary.op;
+                n.flags = e->unary.is_postfix;
+                n.a = flat_expr(f, e->unary.expr);
+                break;
+        case EXPR_BINARY:
+                n.op = e->binary.op;
+                n.a = flat_expr(f, e->binary.left);
+                n.b = flat_expr(f, e->binary.right);
+                break;
+        case EXPR_TERNARY:
+                n.a = flat_expr(f, e->ternary.cond);
+                n.b = flat_extra(f, 2);
+                ref = flat_expr(f, e->ternary.expr);
+                f->extra[n.b] = ref;
+                ref = flat_expr(f, e->ternary.or_expr);
+                f->extra[n.b + 1] = ref;
+                break;
+        case EXPR_SIZEOF:
+                n.a = flat_expr(f, e->sizeof_expr);
+                break;
+        case EXPR_SIZEOF_TYPE:
+                n.a = flat_typespec(f, e->sizeof_type);
+                break;
+        default:
+                assert(EXPR_NONE);
+        }
+        return flat_push(&f->exprs, &f->expr_pos, n, e->pos);
+}
+
+
+NodeRef flat_stmt(FlatAst *f, Stmt *s)
+{
+        FlatNode n = {0};
+        NodeRef ref;
+        SwitchCase *sc;
+
+        if (s == NULL)
+                return 0;
+
+        n.kind = s->kind;
+        switch (s->kind) {
+        case STMT_BREAK:
+        case STMT_CONTINUE:
+                break;
+        case STMT_RETURN:
+        case STMT_EXPR:
+                n.a = flat_expr(f, s->expr);
+                break;
+        case STMT_IF:
+                n.a = flat_expr(f, s->if_stmt.cond);
+                n.b = flat_extra(f, 2);
+                ref = flat_stmt(f, s->if_stmt.body);
+                f->extra[n.b] = ref;
+                ref = flat_stmt(f, s->if_stmt.other);
+                f->extra[n.b + 1] = ref;
+                break;
+        case STMT_WHILE:
+        case STMT_DO_WHILE:
+                n.a = flat_expr(f, s->while_stmt.cond);
+                n.b = flat_stmt(f, s->while_stmt.body);
+                break;
+        case STMT_FOR:
+                n.a = flat_extra(f, 4);
+                ref = flat_expr(f, s->for_stmt.init);
+                f->extra[n.a] = ref;
+                ref = flat_expr(f, s->for_stmt.cond);
+                f->extra[n.a + 1] = ref;
+                ref = flat_expr(f, s->for_stmt.step);
+                f->extra[n.a + 2] = ref;
+                ref = flat_stmt(f, s->for_stmt.body);
+                f->extra[n.a + 3] = ref;
+                break;
+        case STMT_SWITCH:
+                n.a = flat_expr(f, s->switch_stmt.expr);
+                n.b = flat_extra(f, 1 + 2 * s->switch_stmt.num_cases);
+                f->extra[n.b] = s->switch_stmt.num_cases;
+                for (size_t i = 0; i < s->switch_stmt.num_cases; i++) {
+                        sc = s->switch_stmt.cases[i];
+                        ref = flat_expr(f, sc->expr);
+                        f->extra[n.b + 1 + 2 * i] = ref;
+                        ref = flat_stmt(f, sc->stmt);
+                        f->extra[n.b + 2 + 2 * i] = ref;
+                }
+                break;
+        case STMT_BLOCK:
+                n.a = flat_extra(f, 1 + s->block.num_stmt);
+                f->extra[n.a] = s->block.num_stmt;
+                for (size_t i = 0; i < s->block.num_stmt; i++) {
+                        ref = flat_stmt(f, s->block.stmt[i]);
+                        f->extra[n.a + 1 + i] = ref;
+                }
+                break;
+        default:
+                assert(STMT_NONE);
+        }
+        return flat_push(&f->stmts, &f->stmt_pos, n, s->pos);
+}
+
+
+NodeRef flat_decl(FlatAst *f, Decl *d)
+{
+        FlatNode n = {0};
+        NodeRef ref;
+        BoxDecl *b;
+        FuncDecl *fd;
+
+        n.kind = d->kind;
+        n.a = flat_str(f, d->name);
+        switch (d->kind) {
+        case DECL_TYPEDEF:
+                n.b = flat_typespec(f, d->typespec);
+                break;
+        case DECL_ENUM:
+        case DECL_STRUCT:
+        case DECL_UNION:
+                b = d->box;
+                n.b = flat_extra(f, 1 + 2 * b->num_names);
+                f->extra[n.b] = b->num_names;
+                for (size_t i = 0; i < b->num_names; i++) {
+                        f->extra[n.b + 1 + 2 * i] = flat_str(f, b->names[i]);
+                        if (d->kind == DECL_ENUM)
+                                ref = flat_expr(f, b->exprs[i]);
+                        else    ref = flat_typespec(f, b->types[i]);
+                        f->extra[n.b + 2 + 2 * i] = ref;
+                }
+                break;
+        case DECL_CONST:
+        case DECL_VAR:
+                n.b = flat_extra(f, 2);
+                ref = flat_typespec(f, d->var.type);
+                f->extra[n.b] = ref;
+                ref = flat_expr(f, d->var.expr);
+                f->extra[n.b + 1] = ref;
+                break;
+        case DECL_FUNC:
+                fd = d->func.decl;
+                n.b = flat_extra(f, 3 + 2 * fd->num_args);
+                ref = flat_typespec(f, fd->ret);
+                f->extra[n.b] = ref;
+                ref = flat_stmt(f, d->func.body);
+                f->extra[n.b + 1] = ref;
+                f->extra[n.b + 2] = fd->num_args;
+                for (size_t i = 0; i < fd->num_args; i++) {
+                        f->extra[n.b + 3 + 2 * i] = flat_str(f, fd->args[i]);
+                        ref = flat_typespec(f, fd->types[i]);
+                        f->extra[n.b + 4 + 2 * i] = ref;
+                }
+                break;
+        default:
+                assert(DECL_NONE);
+        }
+        return flat_push(&f->decls, &f->decl_pos, n, d->pos);
+}
+
+
+// slot 0 of every array is the none node, strs[0] is NULL
+FlatAst flatten_ast(Decl **ast, size_t len)
+{
+        FlatAst f = {0};
+        FlatNode none = {0};
+
+        buf_push(f.strs, NULL);
+        flat_push(&f.exprs, &f.expr_pos, none, 0);
+        flat_push(&f.stmts, &f.stmt_pos, none, 0);
+        flat_push(&f.typespecs, &f.typespec_pos, none, 0);
+        flat_push(&f.decls, &f.decl_pos, none, 0);
+        for (size_t i = 0; i < len; i++)
+                flat_decl(&f, ast[i]);
+        return f;
+}
+
+
+// Back to the pointer AST, nodes are allocated in ast_arena.  Every
+// non-zero position is moved by delta, which is how a cached AST
+// stored with file relative positions gets rebased onto its file.
+
+typedef struct Unflatten {
+        FlatAst *f;
+        SrcPos delta;
+} Unflatten;
+
+#define unflat_pos(u, positions, ref) \
+        ((u)->f->positions[ref] ? (u)->f->positions[ref] + (u)->delta : 0)
+
+
+static void *unflat_list(size_t n, size_t elem_size)
+{
+        return n ? ast_alloc(n * elem_size) : NULL;
+}
+
+
+Expr *unflat_expr(Unflatten *u, NodeRef ref);
+Stmt *unflat_stmt(Unflatten *u, NodeRef ref);
+
+
+Typespec *unflat_typespec(Unflatten *u, NodeRef ref)
+{
+        FlatNode *n = u->f->typespecs + ref;
+        uint32_t *x = u->f->extra + n->b;
+        Typespec *t;
+
+        if (ref == 0)
+                return NULL;
+
+        t = new_typespec(unflat_pos(u, typespec_pos, ref), n->kind);
+        switch (n->kind) {
+        case TYPESPEC_NAME:
+                t->name = u->f->strs[n->a];
+                break;
+        case TYPESPEC_CONST:
+        case TYPESPEC_PTR:
+                t->base = unflat_typespec(u, n->a);
+                break;
+        case TYPESPEC_ARRAY:
+                t->array.base = unflat_typespec(u, n->a);
+                t->array.length = unflat_expr(u, n->b);
+                break;
+        case TYPESPEC_FUNCTION:
+                t->func.ret = unflat_typespec(u, n->a);
+                t->func.num_args = x[0];
+                t->func.args = unflat_list(x[0], sizeof(Typespec *));
+                for (size_t i = 0; i < x[0]; i++)
+                        t->func.args[i] = unflat_typespec(u, x[1 + i]);
+                break;
+        default:
+                assert(TYPESPEC_NONE);
+        }
+        return t;
+}
+
+
+Expr *unflat_expr(Unflatten *u, NodeRef ref)
+{
+        FlatNode *n = u->f->exprs + ref;
+        uint32_t *x = u->f->extra + n->b;
+        uint64_t bits;
+        Expr *e;
+
+        if (ref == 0)
+                return NULL;
+
+        e = new_expr(unflat_pos(u, expr_pos, ref), n->kind);
+        switch (n->kind) {
+        case EXPR_NAME:
+                e->name = u->f->strs[n->a];
+                break;
+        case EXPR_STR:
+                e->str_val = u->f->strs[n->a];
+                break;
+        case EXPR_INT:
+        case EXPR_FLOAT:
+                bits = (uint64_t) n->b << 32 | n->a;
+                memcpy(&e->int_val, &bits, sizeof(bits));
+                break;
+        case EXPR_CAST:
+                e->cast.type = unflat_typespec(u, n->a);
+                e->cast.expr = unflat_expr(u, n->b);
+                break;
+        case EXPR_CALL:
+                e->call.expr = unflat_expr(u, n->a);
+                e->call.num_args = x[0];
+                e->call.args = unflat_list(x[0], sizeof(Expr *));
+                for (size_t i = 0; i < x[0]; i++)
+                        e->call.args[i] = unflat_expr(u, x[1 + i]);
+                break;
+        case EXPR_INDEX:
+                e->index.oexpr = unflat_expr(u, n->a);
+                e->index.iexpr = unflat_expr(u, n->b);
+                break;
+        case EXPR_FIELD:
+                e->field.expr = unflat_expr(u, n->a);
+                e->field.name = u->f->strs[n->b];
+                break;
+        case EXPR_UNARY:
+                e->unary.op = n->op;
+                e->unary.is_postfix = n->flags;
+                e->unary.expr = unflat_expr(u, n->a);
+                break;
+        case EXPR_BINARY:
+                e->binary.op = n->op;
+                e->binary.left = unflat_expr(u, n->a);
+                e->binary.right = unflat_expr(u, n->b);
+                break;
+        case EXPR_TERNARY:
+                e->ternary.cond = unflat_expr(u, n->a);
+                e->ternary.expr = unflat_expr(u, x[0]);
+                e->ternary.or_expr = unflat_expr(u, x[1]);
+                break;
+        case EXPR_SIZEOF:
+                e->sizeof_expr = unflat_expr(u, n->a);
+                break;
+        case EXPR_SIZEOF_TYPE:
+                e->sizeof_type = unflat_typespec(u, n->a);
+                break;
+        default:
+                assert(EXPR_NONE);
+        }
+        return e;
+}
+
+
+Stmt *unflat_stmt(Unflatten *u, NodeRef ref)
+{
+        FlatNode *n = u->f->stmts + ref;
+        uint32_t *x;
+        SwitchCase *sc;
+        Stmt *s;
+
+        if (ref == 0)
+                return NULL;
+
+        s = new_stmt(unflat_pos(u, stmt_pos, ref), n->kind);
+        switch (n->kind) {
+        case STMT_BREAK:
+        case STMT_CONTINUE:
+                break;
+        case STMT_RETURN:
+        case STMT_EXPR:
+                s->expr = unflat_expr(u, n->a);
+                break;
+        case STMT_IF:
+                x = u->f->extra + n->b;
+                s->if_stmt.cond = unflat_expr(u, n->a);
+                s->if_stmt.body = unflat_stmt(u, x[0]);
+                s->if_stmt.other = unflat_stmt(u, x[1]);
+                break;
+        case STMT_WHILE:
+        case STMT_DO_WHILE:
+                s->while_stmt.cond = unflat_expr(u, n->a);
+                s->while_stmt.body = unflat_stmt(u, n->b);
+                break;
+        case STMT_FOR:
+                x = u->f->extra + n->a;
+                s->for_stmt.init = unflat_expr(u, x[0]);
+                s->for_stmt.cond = unflat_expr(u, x[1]);
+                s->for_stmt.step = unflat_expr(u, x[2]);
+                s->for_stmt.body = unflat_stmt(u, x[3]);
+                break;
+        case STMT_SWITCH:
+                x = u->f->extra + n->b;
+                s->switch_stmt.expr = unflat_expr(u, n->a);
+                s->switch_stmt.num_cases = x[0];
+                s->switch_stmt.cases = unflat_list(x[0], sizeof(SwitchCase *));
+                for (size_t i = 0; i < x[0]; i++) {
+                        sc = new_switch_case();
+                        sc->expr = unflat_expr(u, x[1 + 2 * i]);
+                        sc->stmt = unflat_stmt(u, x[2 + 2 * i]);
+                        s->switch_stmt.cases[i] = sc;
+                }
+                break;
+        case STMT_BLOCK:
+                x = u->f->extra + n->a;
+                s->block.num_stmt = x[0];
+                s->block.stmt = unflat_list(x[0], sizeof(Stmt *));
+                for (size_t i = 0; i < x[0]; i++)
+                        s->block.stmt[i] = unflat_stmt(u, x[1 + i]);
+                break;
+        default:
+                assert(STMT_NONE);
+        }
+        return s;
+}
+
+
+Decl *unflat_decl(Unflatten *u, NodeRef ref)
+{
+        FlatNode *n = u->f->decls + ref;
+        uint32_t *x = u->f->extra + n->b;
+        BoxDecl *b;
+        FuncDecl *fd;
+        Decl *d;
+
+        d = new_decl(unflat_pos(u, decl_pos, ref), n->kind, u->f->strs[n->a]);
+        switch (n->kind) {
+        case DECL_TYPEDEF:
+                d->typespec = unflat_typespec(u, n->b);
+                break;
+        case DECL_ENUM:
+        case DECL_STRUCT:
+        case DECL_UNION:
+                b = new_box_decl();
+                b->num_names = x[0];
+                b->names = unflat_list(x[0], sizeof(const char *));
+                b->types = unflat_list(x[0], sizeof(void *));
+                for (size_t i = 0; i < x[0]; i++) {
+                        b->names[i] = u->f->strs[x[1 + 2 * i]];
+                        if (n->kind == DECL_ENUM)
+                                b->exprs[i] = unflat_expr(u, x[2 + 2 * i]);
+                        else    b->types[i] = unflat_typespec(u, x[2 + 2 * i]);
+                }
+                d->box = b;
+                break;
+        case DECL_CONST:
+        case DECL_VAR:
+                d->var.type = unflat_typespec(u, x[0]);
+                d->var.expr = unflat_expr(u, x[1]);
+                break;
+        case DECL_FUNC:
+                fd = new_func_decl();
+                fd->ret = unflat_typespec(u, x[0]);
+                fd->num_args = x[2];
+                fd->args = unflat_list(x[2], sizeof(const char *));
+                fd->types = unflat_list(x[2], sizeof(Typespec *));
+                for (size_t i = 0; i < x[2]; i++) {
+                        fd->args[i] = u->f->strs[x[3 + 2 * i]];
+                        fd->types[i] = unflat_typespec(u, x[4 + 2 * i]);
+                }
+                d->func.decl = fd;
+                d->func.body = unflat_stmt(u, x[1]);
+                break;
+        default:
+                assert(DECL_NONE);
+        }
+        return d;
+}
+
+
+// decls 1 to num_decls - 1 in order, the arrays of f need not be
+// stretchy buffers
+Decl **unflatten_ast(FlatAst *f, size_t num_decls, SrcPos delta)
+{
+        Unflatten u = {f, delta};
+        Decl **ast = NULL;
+
+        buf__fit(ast, num_decls - 1);
+        for (NodeRef i = 1; i < num_decls; i++)
+                ast[buf_len(ast)++] = unflat_decl(&u, i);
+        return ast;
+}
+
+
+#define flat_bytes(b) (buf__len(b) * sizeof(*(b)))
+
+size_t flat_ast_bytes(FlatAst *f)
+{
+        return flat_bytes(f->exprs) + flat_bytes(f->stmts) +
+                flat_bytes(f->typespecs) + flat_bytes(f->decls) +
+                flat_bytes(f->expr_pos) + flat_bytes(f->stmt_pos) +
+                flat_bytes(f->typespec_pos) + flat_bytes(f->decl_pos) +
+                flat_bytes(f->extra) + flat_bytes(f->strs) +
+                f->str_index.cap * (sizeof(uint64_t) + sizeof(void *));
+}
+
+
+void flat_ast_free(FlatAst *f)
+{
+        buf_free(f->exprs);
+        buf_free(f->stmts);
+        buf_free(f->typespecs);
+        buf_free(f->decls);
+        buf_free(f->expr_pos);
+        buf_free(f->stmt_pos);
+        buf_free(f->typespec_pos);
+        buf_free(f->decl_pos);
+        buf_free(f->extra);
+        buf_free(f->strs);
+        map_free(&f->str_index);
+}
+
+#endif
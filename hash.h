@@ -0,0 +1,153 @@
+#ifndef HASH_FUNCTIONS
+#define HASH_FUNCTIONS
+
+
+// 64-bit FNV-1a, good enough for short identifiers
+uint64_t hash_bytes(const void *ptr, size_t len)
+{
+        const uint8_t *p = ptr;
+        uint64_t h = 0xcbf29ce484222325ull;
+        
+        for (size_t i = 0; i < len; i++) {
+                h ^= p[i];
+                h *= 0x100000001b3ull;
+        }
+        return h;
+}
+
+
+uint64_t hash_uint64(uint64_t x)
+{
+        x *= 0xff51afd7ed558ccdull;
+        x ^= x >> 32;
+        return x;
+}
+
+
+uint64_t hash_mix(uint64_t x, uint64_t y)
+{
+        return hash_uint64(x ^ hash_uint64(y));
+}
+
+#define hash_ptr(p) hash_uint64((uintptr_t) (p))
+
+
+// whole files, eight bytes per step
+uint64_t hash_text(const void *ptr, size_t len)
+{
+        const uint8_t *p = ptr;
+        uint64_t h = hash_uint64(len), word;
+        size_t i;
+
+        for (i = 0; i + 8 <= len; i += 8) {
+                memcpy(&word, p + i, 8);
+                h = hash_mix(h, word);
+        }
+        word = 0;
+        memcpy(&word, p + i, len - i);
+        return hash_mix(h, word);
+}
+
+
+typedef struct Map Map;
+
+// open addressing map from non-zero 64-bit keys (mostly interned
+// pointers) to pointers, cap is a power of two
+struct Map {
+        uint64_t *keys;
+        void **vals;
+        size_t len;
+        size_t cap;
+};
+
+
+void *map_get_uint64(Map *map, uint64_t key)
+{
+        size_t i, mask;
+        
+        if (map->len == 0)
+                return NULL;
+        assert(key);
+        mask = map->cap - 1;
+        for (i = hash_uint64(key) & mask; map->keys[i]; i = (i + 1) & mask) {
+                if (map->keys[i] == key)
+                        return map->vals[i];
+        }
+        return NULL;
+}
+
+
+void map_put_uint64(Map *map, uint64_t key, void *val);
+
+static void map_grow(Map *map, size_t new_cap)
+{
+        Map new_map = {0};
+        
+        if (new_cap < 16)
+                new_cap = 16;
+        new_map.keys = calloc(new_cap, sizeof(uint64_t));
+        new_map.vals = malloc(new_cap * sizeof(void *));
+        new_map.cap = new_cap;
+        
+        for (size_t i = 0; i < map->cap; i++) {
+                if (map->keys[i])
+                        map_put_uint64(&new_map, map->keys[i], map->vals[i]);
+        }
+        free(map->keys);
+        free(map->vals);
+        *map = new_map;
+}
+
+
+void map_put_uint64(Map *map, uint64_t key, void *val)
+{
+        size_t i, mask;
+        
+        assert(key);
+        if (2 * (map->len + 1) > map->cap)
+                map_grow(map, 2 * map->cap);
+        
+        mask = map->cap - 1;
+        for (i = hash_uint64(key) & mask; map->keys[i]; i = (i + 1) & mask) {
+                if (map->keys[i] == key) {
+                        map->vals[i] = val;
+                        return;
+                }
+        }
+        map->keys[i] = key;
+        map->vals[i] = val;
+        map->len++;
+}
+
+
+void map_free(Map *map)
+{
+        free(map->keys);
+        free(map->vals);
+        memset(map, 0, sizeof(Map));
+}
+
+#define map_get(map, key) map_get_uint64((map), (uintptr_t) (key))
+#define map_put(map, key, val) map_put_uint64((map), (uintptr_t) (key), (val))
+
+
+void map_test()
+{
+        Map map = {0};
+        enum { N = 1024 };
+        
+        assert(map_get(&map, &map) == NULL);
+        for (size_t i = 1; i < N; i++) {
+                map_put_uint64(&map, i, (void *) (i + 1));
+        }
+        assert(map.len == N - 1);
+        for (size_t i = 1; i < N; i++) {
+                assert(map_get_uint64(&map, i) == (void *) (i + 1));
+        }
+        map_put_uint64(&map, 1, NULL);
+        assert(map_get_uint64(&map, 1) == NULL && map.len == N - 1);
+        assert(map_get_uint64(&map, N) == NULL);
+        map_free(&map);
+}
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef ION_JOBS
+#define ION_JOBS
+
+// Runs fn(ctx, i) for every i in [0, n) on up to num_threads threads,
+// the calling thread is one of them.  Items are handed out one at a
+// time from a shared counter, so a few large files don't leave the
+// other threads idle.
+
+typedef void (*JobFunc)(void *ctx, size_t i);
+
+typedef struct JobQueue {
+        JobFunc fn;
+        void *ctx;
+        size_t n;
+        size_t next;
+} JobQueue;
+
+
+static void *job_worker(void *arg)
+{
+        JobQueue *q = arg;
+        size_t i;
+
+        while ((i = __atomic_fetch_add(&q->next, 1, __ATOMIC_RELAXED)) < q->n)
+                q->fn(q->ctx, i);
+        return NULL;
+}
+
+
+void run_jobs(JobFunc fn, void *ctx, size_t n, int num_threads)
+{
+        JobQueue q = {fn, ctx, n, 0};
+        pthread_t *threads = NULL, t;
+
+        if ((size_t) num_threads > n)
+                num_threads = n;
+
+        // if a thread can't be created the others pick up its share
+        for (int i = 1; i < num_threads; i++) {
+                if (pthread_create(&t, NULL, job_worker, &q) != 0)
+                        break;
+                buf_push(threads, t);
+        }
+        job_worker(&q);
+
+        for (size_t i = 0; i < buf__len(threads); i++)
+                pthread_join(threads[i], NULL);
+        buf_free(threads);
+}
+
+
+int num_cpus(void)
+{
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        return n > 0 ? n : 1;
+}
+
+
+static void jobs_test_square(void *ctx, size_t i)
+{
+        size_t *out = ctx;
+        out[i] = i * i;
+}
+
+
+void jobs_test()
+{
+        size_t out[100];
+
+        for (int threads = 1; threads <= 8; threads *= 2) {
+                memset(out, 0, sizeof(out));
+                run_jobs(jobs_test_square, out, 100, threads);
+                for (size_t i = 0; i < 100; i++)
+                        assert(out[i] == i * i);
+        }
+        run_jobs(jobs_test_square, out, 0, 4);
+}
+
+#endif
@@ -2,6 +2,14 @@
 #define ION_KEYWORDS
 
 
+enum Keyword {
+        NOT_KEYWORD,
+#define KEYWORD(name) KEYWORD_##name,
+#include "keywords.txt"
+#undef KEYWORD
+        NUM_KEYWORDS
+};
+
 void init_keywords();
 char is_keyword(const char *);
 
@@ -10,7 +18,7 @@ const char *name##_keyword;
 #include "keywords.txt"
 #undef KEYWORD
 
-const char **keywords;
+const char *keywords[NUM_KEYWORDS];
 
 
 void init_keywords()
@@ -19,10 +27,10 @@ void init_keywords()
         if (inited) {
                 return;
         }
-        keywords = buf_grow(NULL, 32, sizeof(char *));
 #define KEYWORD(name) \
         name##_keyword = str_intern(#name); \
-        buf__push(keywords, name##_keyword);
+        str__hdr(name##_keyword)->keyword = KEYWORD_##name; \
+        keywords[KEYWORD_##name] = name##_keyword;
 #include "keywords.txt"
 #undef KEYWORD
         assert(str_intern("func") == func_keyword);
@@ -30,14 +38,13 @@ void init_keywords()
 }
 
 
+// name must be interned, keyword ids are stored in the string header
+#define str_keyword(name) ((enum Keyword) str__hdr(name)->keyword)
+
+
 char is_keyword(const char *name)
 {
-        for (size_t i = 0; i < buf_len(keywords); i++) {
-                if (keywords[i] == name)
-                        return 1;
-        }
-        return 0;
+        return str_keyword(name) != NOT_KEYWORD;
 }
 
 #endif
-
@@ -1,23 +1,57 @@
 #ifndef ION_LEXING
 #define ION_LEXING
 
-char const *stream;
-struct Token token;
+// per thread, so several files can be lexed concurrently
+_Thread_local char const *stream;
+_Thread_local struct Token token;
+// token positions are lex_base plus the offset from lex_text
+_Thread_local const char *lex_text;
+_Thread_local SrcPos lex_base;
 void next_token();
+void start_lex(const char *content);
+static inline const char *skip_space(const char *);
+static inline const char *scan_ident(const char *);
+static inline const char *scan_str_body(const char *);
 
-#define init_stream(s) stream = s; next_token()
+#define init_stream(s) start_lex(s)
 
 
 void init_lex(const char *name, const char *content)
 {
         filename = name;
-        line_number = 1;
-        stream = content;
-        next_token();
+        start_lex(content);
 }
 
 
-uint8_t char_to_digit[] = {
+enum {
+        CHAR_IDENT = 1 << 0,
+        CHAR_DIGIT = 1 << 1,
+        CHAR_XDIGIT = 1 << 2,
+        CHAR_SPACE = 1 << 3,
+};
+
+// replaces the locale aware ctype.h calls in the hot loop, each entry
+// initialized once
+uint8_t char_class[256] = {
+        ['a' ... 'f'] = CHAR_IDENT | CHAR_XDIGIT,
+        ['g' ... 'z'] = CHAR_IDENT,
+        ['A' ... 'F'] = CHAR_IDENT | CHAR_XDIGIT,
+        ['G' ... 'Z'] = CHAR_IDENT,
+        ['_'] = CHAR_IDENT,
+        ['0' ... '9'] = CHAR_IDENT | CHAR_DIGIT | CHAR_XDIGIT,
+        [' '] = CHAR_SPACE,
+        ['\n'] = CHAR_SPACE,
+        ['\t'] = CHAR_SPACE,
+        ['\r'] = CHAR_SPACE,
+        ['\v'] = CHAR_SPACE,
+        ['\f'] = CHAR_SPACE,
+};
+
+#define is_char(c, class) (char_class[(uint8_t) (c)] & (class))
+#define is_exponent(c) ((c) == 'e' || (c) == 'E')
+
+
+uint8_t char_to_digit[256] = {
         ['0'] = 0,
         ['1'] = 1,
         ['2'] = 2,
@@ -36,7 +70,7 @@ uint8_t char_to_digit[] = {
         ['f'] = 15, ['F'] = 15,
 };
 
-uint8_t escaped_char[] = {
+uint8_t escaped_char[256] = {
         ['0'] = 0,
         ['"'] = '"',
         ['\''] = '\'',
@@ -60,8 +94,8 @@ void scan_int(char base)
         char digit;
         uint64_t val = 0;
         
-        while (isxdigit(*stream)) {
-                digit = char_to_digit[(int) *stream];
+        while (is_char(*stream, CHAR_XDIGIT)) {
+                digit = char_to_digit[(uint8_t) *stream];
                 
                 if (digit >= base) {
                         syntax_error(invalid_digit, digit);
@@ -80,18 +114,18 @@ void scan_float()
         double val;
         const char *s = stream;
         
-        while (isdigit(*s)) s++;
+        while (is_char(*s, CHAR_DIGIT)) s++;
         if (*s == '.') s++;
-        while (isdigit(*s)) s++;
+        while (is_char(*s, CHAR_DIGIT)) s++;
         
-        if (tolower(*s) == 'e') {
+        if (is_exponent(*s)) {
                 s++;
                 if (*s == '+' || *s == '-') s++;
                 
-                if (!isdigit(*s)) {
+                if (!is_char(*s, CHAR_DIGIT)) {
                         syntax_error("exponent has no digits");
                 }
-                while (isdigit(*s)) s++;
+                while (is_char(*s, CHAR_DIGIT)) s++;
         }
         
         val = strtod(stream, NULL);
@@ -102,6 +136,7 @@ void scan_float()
 
 void scan_str()
 {
+        const char *end;
         char *str = NULL;
         char c;
         
@@ -109,11 +144,19 @@ void scan_str()
         stream++;
         
         while (*stream && *stream != '"') {
+                end = scan_str_body(stream);
+                if (end != stream) {
+                        buf__fit(str, end - stream);
+                        memcpy(buf_end(str), stream, end - stream);
+                        buf_len(str) += end - stream;
+                        stream = end;
+                        continue;
+                }
                 c = *stream;
                 switch (c) {
                 case '\\':
                         stream++;
-                        c = escaped_char[(int) *stream];
+                        c = escaped_char[(uint8_t) *stream];
                         if (c == 0 && *stream != '0') {
                                 syntax_error(unknown_escape, *stream);
                         }
@@ -149,7 +192,7 @@ void scan_char()
         switch (*stream) {
         case '\\':
                 stream++;
-                c = escaped_char[(int) *stream];
+                c = escaped_char[(uint8_t) *stream];
                 if (c == 0 && *stream != '0') {
                         syntax_error(unknown_escape, *stream);
                 }
@@ -173,28 +216,34 @@ void scan_char()
 }
 
 
-void next_token()
+// lexes the next token from stream, the parser calls next_token
+// which may take it from a token buffer instead
+void lex_token()
 {
         char c, base;
         const char *str;
 repeat:
+        token.pos = lex_base + (stream - lex_text);
         switch (*stream) {
         case 0:
                 token.kind = TOKEN_EOF;
                 return;
         case '\n':
-                line_number++;
         case ' ':
-                stream++;
+        case '\t':
+        case '\r':
+        case '\v':
+        case '\f':
+                stream = skip_space(stream);
                 goto repeat;
         case '1'...'9':
                 base = 10;
                 str = stream;
-                while (isdigit(*str)) {
+                while (is_char(*str, CHAR_DIGIT)) {
                         str++;
                 }
                 c = *str;
-                if (c == '.' || tolower(c) == 'e') {
+                if (c == '.' || is_exponent(c)) {
                         goto _float;
                 }
 _int:
@@ -214,7 +263,7 @@ _float:
                 }
                 goto _int;
         case '.':
-                if (isdigit(stream[1])) {
+                if (is_char(stream[1], CHAR_DIGIT)) {
                         goto _float;
                 }
                 token.kind = TOKEN_DOT;
@@ -296,13 +345,12 @@ _float:
         case 'a'...'z':
         case 'A'...'Z':
         case '_':
-                str = stream++;
-                while (isalnum(*stream) || *stream == '_') {
-                        stream++;
-                }
+                str = stream;
+                stream = scan_ident(stream + 1);
                 
                 token.name = str_intern_slice(str, stream - str);
-                token.kind = is_keyword(token.name) ? TOKEN_KEYWORD : TOKEN_NAME;
+                token.keyword = str_keyword(token.name);
+                token.kind = token.keyword ? TOKEN_KEYWORD : TOKEN_NAME;
                 break;
         default:
                 c = *stream;
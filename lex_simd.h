@@ -0,0 +1,349 @@
+#ifndef ION_LEXING_SIMD
+#define ION_LEXING_SIMD
+
+// Vectorized scanners for the lexer hot loop.  Blocks are loaded from
+// aligned addresses, an aligned load never crosses a page boundary, so
+// reading past the NUL sentinel of the source text is harmless.  Bytes
+// before the start of the scan are masked off.
+
+enum LexSimd {
+        LEX_SIMD_AUTO,
+        LEX_SIMD_SCALAR,
+        LEX_SIMD_SSE2,
+        LEX_SIMD_AVX2,
+};
+
+const char *lex_simd_name[] = {
+        [LEX_SIMD_AUTO] = "auto",
+        [LEX_SIMD_SCALAR] = "scalar",
+        [LEX_SIMD_SSE2] = "sse2",
+        [LEX_SIMD_AVX2] = "avx2",
+};
+
+#define NO_ASAN __attribute__((no_sanitize_address))
+
+
+const char *skip_space_scalar(const char *s)
+{
+        while (is_char(*s, CHAR_SPACE))
+                s++;
+        return s;
+}
+
+
+const char *scan_ident_scalar(const char *s)
+{
+        while (is_char(*s, CHAR_IDENT))
+                s++;
+        return s;
+}
+
+
+const char *scan_str_body_scalar(const char *s)
+{
+        while (*s && *s != '"' && *s != '\\' && *s != '\n')
+                s++;
+        return s;
+}
+
+
+// offsets of every line start, the first line starts at 0
+uint32_t *index_lines_scalar(const char *text, size_t size)
+{
+        uint32_t *lines = NULL;
+
+        buf_push(lines, 0);
+        for (size_t i = 0; i < size; i++) {
+                if (text[i] == '\n')
+                        buf_push(lines, i + 1);
+        }
+        return lines;
+}
+
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+// lo <= v <= hi, unsigned
+#define sse2_in_range(v, lo, hi) _mm_and_si128( \
+        _mm_cmpeq_epi8(_mm_max_epu8((v), _mm_set1_epi8(lo)), (v)), \
+        _mm_cmpeq_epi8(_mm_min_epu8((v), _mm_set1_epi8(hi)), (v)))
+#define avx2_in_range(v, lo, hi) _mm256_and_si256( \
+        _mm256_cmpeq_epi8(_mm256_max_epu8((v), _mm256_set1_epi8(lo)), (v)), \
+        _mm256_cmpeq_epi8(_mm256_min_epu8((v), _mm256_set1_epi8(hi)), (v)))
+
+
+static inline __m128i sse2_space(__m128i v)
+{
+        return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                sse2_in_range(v, '\t', '\r'));
+}
+
+
+static inline __m128i sse2_ident(__m128i v)
+{
+        __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+
+        return _mm_or_si128(
+                _mm_or_si128(sse2_in_range(lower, 'a', 'z'),
+                        sse2_in_range(v, '0', '9')),
+                _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+}
+
+
+static inline __m128i sse2_str_stop(__m128i v)
+{
+        return _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_setzero_si128()),
+                        _mm_cmpeq_epi8(v, _mm_set1_epi8('"'))),
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\')),
+                        _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+}
+
+
+NO_ASAN const char *skip_space_sse2(const char *s)
+{
+        const char *p = (const char *) ((uintptr_t) s & ~15);
+        unsigned skip = s - p, stop;
+        __m128i v;
+
+        for (;; p += 16, skip = 0) {
+                v = _mm_load_si128((const __m128i *) p);
+                stop = ~_mm_movemask_epi8(sse2_space(v)) & 0xffff & (0xffff << skip);
+                if (stop)
+                        return p + __builtin_ctz(stop);
+        }
+}
+
+
+NO_ASAN const char *scan_ident_sse2(const char *s)
+{
+        const char *p = (const char *) ((uintptr_t) s & ~15);
+        unsigned skip = s - p, stop;
+        __m128i v;
+
+        for (;; p += 16, skip = 0) {
+                v = _mm_load_si128((const __m128i *) p);
+                stop = ~_mm_movemask_epi8(sse2_ident(v)) & 0xffff & (0xffff << skip);
+                if (stop)
+                        return p + __builtin_ctz(stop);
+        }
+}
+
+
+NO_ASAN const char *scan_str_body_sse2(const char *s)
+{
+        const char *p = (const char *) ((uintptr_t) s & ~15);
+        unsigned skip = s - p, stop;
+        __m128i v;
+
+        for (;; p += 16, skip = 0) {
+                v = _mm_load_si128((const __m128i *) p);
+                stop = _mm_movemask_epi8(sse2_str_stop(v)) & (0xffff << skip);
+                if (stop)
+                        return p + __builtin_ctz(stop);
+        }
+}
+
+
+uint32_t *index_lines_sse2(const char *text, size_t size)
+{
+        uint32_t *lines = NULL, mask;
+        size_t i;
+
+        buf_push(lines, 0);
+        for (i = 0; i + 16 <= size; i += 16) {
+                mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+                        _mm_loadu_si128((const __m128i *) (text + i)),
+                        _mm_set1_epi8('\n')));
+                for (; mask; mask &= mask - 1)
+                        buf_push(lines, i + __builtin_ctz(mask) + 1);
+        }
+        for (; i < size; i++) {
+                if (text[i] == '\n')
+                        buf_push(lines, i + 1);
+        }
+        return lines;
+}
+
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i avx2_space(__m256i v)
+{
+        return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                avx2_in_range(v, '\t', '\r'));
+}
+
+
+AVX2 static inline __m256i avx2_ident(__m256i v)
+{
+        __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+
+        return _mm256_or_si256(
+                _mm256_or_si256(avx2_in_range(lower, 'a', 'z'),
+                        avx2_in_range(v, '0', '9')),
+                _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+}
+
+
+AVX2 static inline __m256i avx2_str_stop(__m256i v)
+{
+        return _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()),
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))),
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')),
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+}
+
+
+AVX2 NO_ASAN const char *skip_space_avx2(const char *s)
+{
+        const char *p = (const char *) ((uintptr_t) s & ~31);
+        uint32_t skip = s - p, stop;
+        __m256i v;
+
+        for (;; p += 32, skip = 0) {
+                v = _mm256_load_si256((const __m256i *) p);
+                stop = ~_mm256_movemask_epi8(avx2_space(v)) & (~0u << skip);
+                if (stop)
+                        return p + __builtin_ctz(stop);
+        }
+}
+
+
+AVX2 NO_ASAN const char *scan_ident_avx2(const char *s)
+{
+        const char *p = (const char *) ((uintptr_t) s & ~31);
+        uint32_t skip = s - p, stop;
+        __m256i v;
+
+        for (;; p += 32, skip = 0) {
+                v = _mm256_load_si256((const __m256i *) p);
+                stop = ~_mm256_movemask_epi8(avx2_ident(v)) & (~0u << skip);
+                if (stop)
+                        return p + __builtin_ctz(stop);
+        }
+}
+
+
+AVX2 NO_ASAN const char *scan_str_body_avx2(const char *s)
+{
+        const char *p = (const char *) ((uintptr_t) s & ~31);
+        uint32_t skip = s - p, stop;
+        __m256i v;
+
+        for (;; p += 32, skip = 0) {
+                v = _mm256_load_si256((const __m256i *) p);
+                stop = _mm256_movemask_epi8(avx2_str_stop(v)) & (~0u << skip);
+                if (stop)
+                        return p + __builtin_ctz(stop);
+        }
+}
+
+
+AVX2 uint32_t *index_lines_avx2(const char *text, size_t size)
+{
+        uint32_t *lines = NULL, mask;
+        size_t i;
+
+        buf_push(lines, 0);
+        for (i = 0; i + 32 <= size; i += 32) {
+                mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                        _mm256_loadu_si256((const __m256i *) (text + i)),
+                        _mm256_set1_epi8('\n')));
+                for (; mask; mask &= mask - 1)
+                        buf_push(lines, i + __builtin_ctz(mask) + 1);
+        }
+        for (; i < size; i++) {
+                if (text[i] == '\n')
+                        buf_push(lines, i + 1);
+        }
+        return lines;
+}
+
+#endif
+
+
+const char *(*skip_space_impl)(const char *) = skip_space_scalar;
+const char *(*scan_ident_impl)(const char *) = scan_ident_scalar;
+const char *(*scan_str_body_impl)(const char *) = scan_str_body_scalar;
+uint32_t *(*index_lines_impl)(const char *, size_t) = index_lines_scalar;
+enum LexSimd lex_simd = LEX_SIMD_SCALAR;
+
+
+// returns the level actually selected, requests above what the
+// cpu supports fall back to the best available one
+enum LexSimd select_lex_simd(enum LexSimd level)
+{
+        enum LexSimd best = LEX_SIMD_SCALAR;
+
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        best = LEX_SIMD_SSE2;
+        if (__builtin_cpu_supports("avx2"))
+                best = LEX_SIMD_AVX2;
+#endif
+        if (level == LEX_SIMD_AUTO || level > best)
+                level = best;
+
+        switch (level) {
+#if defined(__x86_64__)
+        case LEX_SIMD_AVX2:
+                skip_space_impl = skip_space_avx2;
+                scan_ident_impl = scan_ident_avx2;
+                scan_str_body_impl = scan_str_body_avx2;
+                index_lines_impl = index_lines_avx2;
+                break;
+        case LEX_SIMD_SSE2:
+                skip_space_impl = skip_space_sse2;
+                scan_ident_impl = scan_ident_sse2;
+                scan_str_body_impl = scan_str_body_sse2;
+                index_lines_impl = index_lines_sse2;
+                break;
+#endif
+        default:
+                level = LEX_SIMD_SCALAR;
+                skip_space_impl = skip_space_scalar;
+                scan_ident_impl = scan_ident_scalar;
+                scan_str_body_impl = scan_str_body_scalar;
+                index_lines_impl = index_lines_scalar;
+        }
+        lex_simd = level;
+        return level;
+}
+
+
+// Most runs are a single space and most identifiers are short, those
+// are handled inline and only longer runs pay for the indirect call.
+
+static inline const char *skip_space(const char *s)
+{
+        if (*s == ' ' && !is_char(s[1], CHAR_SPACE))
+                return s + 1;
+        return skip_space_impl(s);
+}
+
+
+static inline const char *scan_ident(const char *s)
+{
+        for (int i = 0; i < 8; i++, s++) {
+                if (!is_char(*s, CHAR_IDENT))
+                        return s;
+        }
+        return scan_ident_impl(s);
+}
+
+
+static inline const char *scan_str_body(const char *s)
+{
+        return scan_str_body_impl(s);
+}
+
+
+uint32_t *index_lines(const char *text, size_t size)
+{
+        return index_lines_impl(text, size);
+}
+
+#endif
@@ -7,7 +7,8 @@
 #define assert_token_empty_str() assert(strlen(token.str_val) == 0 && match_token(TOKEN_STR))
 #define assert_token_str(x) assert(strcmp(token.str_val, (x)) == 0 && match_token(TOKEN_STR))
 #define assert_token_name(x) assert(strcmp(token.name, (x)) == 0 && match_token(TOKEN_NAME))
-#define assert_token_keyword(x) assert(token.name == (x) && match_token(TOKEN_KEYWORD))
+#define assert_token_keyword(x) assert(token.name == (x) && \
+        keywords[token.keyword] == (x) && match_token(TOKEN_KEYWORD))
 #define assert_token_eof() assert(token.kind == TOKEN_EOF)
 
 
@@ -155,17 +156,82 @@ void lex_keyword_tests()
 }
 
 
+void lex_whitespace_tests()
+{
+        init_stream("\tint\r\n\v x \f:=\t\t0x1F\r\n\t");
+        assert_token_name("int");
+        assert_token_name("x");
+        assert_token(TOKEN_COLON_ASSIGN);
+        assert_token_int(0x1F);
+        assert_token_eof();
+        assert(src_loc(token.pos).line == 3 && src_loc(token.pos).col == 2);
+}
+
+
+// runs and tokens crossing 16 and 32 byte blocks
+void lex_long_token_tests()
+{
+        SrcPos pos;
+        
+        init_stream("  \n\t  \n                                 \n   "
+                "a_very_long_identifier_name_spanning_blocks0123456789 "
+                "\"a string literal long enough to cross several blocks\\n\" "
+                "x\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n y");
+        assert_token_name("a_very_long_identifier_name_spanning_blocks0123456789");
+        assert_token_str("a string literal long enough to cross several blocks\n");
+        pos = token.pos;
+        assert_token_name("x");
+        assert(src_loc(pos).line == 4 && src_loc(pos).col == 115);
+        assert(src_loc(token.pos).line == 38 && src_loc(token.pos).col == 2);
+        assert_token_name("y");
+        assert_token_eof();
+}
+
+
+// text released and rewritten at the same address is a new file
+void lex_released_text_tests()
+{
+        char text[] = "a\nb";
+        SrcPos first;
+        
+        init_lex("<released>", text);
+        first = token.pos;
+        assert(src_loc(first).line == 1 && src_loc(first).col == 1);
+        release_src_file(text);
+        memcpy(text, "\n\na", 3);
+        init_lex("<released>", text);
+        assert(token.pos != first + 2);
+        assert(src_loc(token.pos).line == 3 && src_loc(token.pos).col == 1);
+        assert_token_name("a");
+        assert_token_eof();
+        release_src_file(text);
+        assert(src_loc(first).line == 1 && src_loc(first).col == 1);
+}
+
+
 void lex_test()
 {
         init_keywords();
+        token_buffer_test();
         
-        lex_integer_literal_tests();
-        lex_float_literal_tests();
-        lex_string_literal_tests();
-        lex_char_literal_tests();
-        lex_basic_token_tests();
-        lex_operator_tests();
-        lex_keyword_tests();
+        // every level, lexing directly and through a token buffer
+        for (enum LexSimd level = LEX_SIMD_SCALAR; level <= LEX_SIMD_AVX2; level++)
+        for (use_token_buffer = 0; use_token_buffer <= 1; use_token_buffer++) {
+                if (select_lex_simd(level) != level)
+                        continue;
+                lex_integer_literal_tests();
+                lex_float_literal_tests();
+                lex_string_literal_tests();
+                lex_char_literal_tests();
+                lex_basic_token_tests();
+                lex_operator_tests();
+                lex_keyword_tests();
+                lex_whitespace_tests();
+                lex_long_token_tests();
+        }
+        use_token_buffer = 0;
+        select_lex_simd(LEX_SIMD_SCALAR);
+        lex_released_text_tests();
 }
 
 #endif
@@ -26,9 +26,9 @@ Stmt *parse_statement(void);
 SwitchCase *parse_switch_case(void);
 
 Decl *parse_declaration(void);
-Decl *parse_enum_decl(const char *name);
-Decl *parse_func_decl(const char *name);
-Decl *parse_aggregate(const char *name, char is_struct);
+Decl *parse_enum_decl(SrcPos pos, const char *name);
+Decl *parse_func_decl(SrcPos pos, const char *name);
+Decl *parse_aggregate(SrcPos pos, const char *name, char is_struct);
 
 Decl **recursive_descent_parser(void);
 
@@ -42,9 +42,9 @@ char match_token(enum TokenKind kind)
         return 0;
 }
 
-char match_keyword(char const *keyword)
+char match_keyword(enum Keyword keyword)
 {
-        if (token.kind == TOKEN_KEYWORD && token.name == keyword) {
+        if (token.kind == TOKEN_KEYWORD && token.keyword == keyword) {
                 next_token();
                 return 1;
         }
@@ -59,14 +59,19 @@ char is_token(enum TokenKind kind)
         return 0;
 }
 
-char is_token_keyword(char const *keyword)
+char is_token_keyword(enum Keyword keyword)
 {
-        if (token.kind == TOKEN_KEYWORD && token.name == keyword) {
+        if (token.kind == TOKEN_KEYWORD && token.keyword == keyword) {
                 return 1;
         }
         return 0;
 }
 
+enum Keyword token_keyword()
+{
+        return token.kind == TOKEN_KEYWORD ? token.keyword : NOT_KEYWORD;
+}
+
 char expect_token(enum TokenKind kind)
 {
         if (match_token(kind)) {
@@ -82,6 +87,7 @@ char expect_token(enum TokenKind kind)
 
 Expr *parse_operand(void)
 {
+        SrcPos pos = token.pos;
         Expr *e;
         Typespec *t;
         
@@ -91,44 +97,44 @@ Expr *parse_operand(void)
                 return e;
         }
         if (is_token(TOKEN_NAME)) {
-                e = new_expr_name(token.name);
+                e = new_expr_name(pos, token.name);
                 next_token();
                 return e;
         }
         if (is_token(TOKEN_INT)) {
-                e = new_expr_int(token.int_val);
+                e = new_expr_int(pos, token.int_val);
                 next_token();
                 return e;
         }
         if (is_token(TOKEN_FLOAT)) {
-                e = new_expr_float(token.float_val);
+                e = new_expr_float(pos, token.float_val);
                 next_token();
                 return e;
         }
         if (is_token(TOKEN_STR)) {
-                e = new_expr_str(token.str_val);
+                e = new_expr_str(pos, token.str_val);
                 next_token();
                 return e;
         }
-        if (match_keyword(sizeof_keyword)) {
+        if (match_keyword(KEYWORD_sizeof)) {
                 expect_token(TOKEN_L_PAREN);
                 if (match_token(TOKEN_COLON)) {
                         goto sizeof_type;
                 }
                 e = parse_expr();
                 expect_token(TOKEN_R_PAREN);
-                return new_expr_sizeof(e);
+                return new_expr_sizeof(pos, e);
 sizeof_type:
                 t = parse_typespec();
                 expect_token(TOKEN_R_PAREN);
-                return new_expr_sizeof_type(t);
+                return new_expr_sizeof_type(pos, t);
         }
-        if (match_keyword(cast_keyword)) {
+        if (match_keyword(KEYWORD_cast)) {
                 expect_token(TOKEN_L_PAREN);
                 t = parse_typespec();
                 expect_token(TOKEN_R_PAREN);
                 e = parse_expr();
-                return new_expr_cast(t, e);
+                return new_expr_cast(pos, t, e);
         }
         
         if (is_token(TOKEN_EOF)) {
@@ -254,32 +260,34 @@ Expr **parse_expr_list(void)
 
 Expr *parse_postfix(Expr *expr)
 {
+        SrcPos pos = token.pos;
         Expr **args;
         
         if (is_token(TOKEN_INC) || is_token(TOKEN_DEC)) {
                 TokenKind op = token.kind;
                 next_token();
-                return new_expr_postfix(op, expr);
+                return new_expr_postfix(pos, op, expr);
         }
         if (match_token(TOKEN_DOT)) {
                 const char *name = token.name;
                 expect_token(TOKEN_NAME);
-                return new_expr_field(expr, name);
+                return new_expr_field(pos, expr, name);
         }
         if (match_token(TOKEN_L_BRACE)) {
                 Expr *index = parse_expr();
                 expect_token(TOKEN_R_BRACE);
-                return new_expr_index(expr, index);
+                return new_expr_index(pos, expr, index);
         }
         expect_token(TOKEN_L_PAREN);
         args = parse_expr_list();
         expect_token(TOKEN_R_PAREN);
-        return new_expr_call(expr, args, buf_len(args));
+        return new_expr_call(pos, expr, args, buf_len(args));
 }
 
 
 Expr *parse_unary(void)
 {
+        SrcPos pos = token.pos;
         TokenKind op;
         Expr *e;
         
@@ -287,7 +295,7 @@ Expr *parse_unary(void)
                 op = token.kind;
                 next_token();
                 e = parse_unary();
-                return new_expr_unary(op, e);
+                return new_expr_unary(pos, op, e);
         }
         e = parse_operand();
         
@@ -301,6 +309,7 @@ Expr *parse_unary(void)
 Expr *parse_binary(char q)
 {
         TokenKind op;
+        SrcPos pos;
         Expr *e, *r;
         char p;
         
@@ -308,16 +317,17 @@ Expr *parse_binary(char q)
         
         while (is_binary_op()) {
                 op = token.kind;
+                pos = token.pos;
                 next_token();
                 p = op_precedence(op);
                 
                 if (q <= p) {
                         q = p;
-                        e = new_expr_binary(op, e, parse_unary());
+                        e = new_expr_binary(pos, op, e, parse_unary());
                         continue;
                 }
                 r = parse_binary(HIGHEST_PRECEDENCE);
-                e->binary.right = new_expr_binary(op, e->binary.right, r);
+                e->binary.right = new_expr_binary(pos, op, e->binary.right, r);
         }
         return e;
 }
@@ -327,15 +337,18 @@ Expr *parse_expr(void)
 {
         Expr *e = parse_binary(HIGHEST_PRECEDENCE);
 
+        SrcPos pos = token.pos;
+
         if (is_assign_op()) {
                 TokenKind op = token.kind;
                 next_token();
-                e = new_expr_binary(op, e, parse_expr());
+                e = new_expr_binary(pos, op, e, parse_expr());
         }
+        pos = token.pos;
         if (match_token(TOKEN_QUESTION)) {
                 Expr *then = parse_binary(HIGHEST_PRECEDENCE);
                 expect_token(TOKEN_COLON);
-                e = new_expr_ternary(e, then, parse_expr());
+                e = new_expr_ternary(pos, e, then, parse_expr());
         }
         return e;
 }
@@ -343,7 +356,7 @@ Expr *parse_expr(void)
 
 char is_type_modifier()
 {
-        if (is_token_keyword(const_keyword) ||
+        if (is_token_keyword(KEYWORD_const) ||
                 is_token(TOKEN_MUL) ||
                 is_token(TOKEN_L_BRACE)) {
                         return TRUE;
@@ -370,6 +383,7 @@ Typespec **parse_typespec_list(void)
 
 Typespec *parse_basetype(void)
 {
+        SrcPos pos = token.pos;
         Typespec *t;
         Typespec **args;
         
@@ -379,11 +393,11 @@ Typespec *parse_basetype(void)
                 return t;
         }
         if (is_token(TOKEN_NAME)) {
-                t = new_typespec_name(token.name);
+                t = new_typespec_name(pos, token.name);
                 next_token();
                 return t;
         }
-        if (match_keyword(func_keyword)) {
+        if (match_keyword(KEYWORD_func)) {
                 expect_token(TOKEN_L_PAREN);
                 args = parse_typespec_list();
                 expect_token(TOKEN_R_PAREN);
@@ -391,7 +405,7 @@ Typespec *parse_basetype(void)
                 if (match_token(TOKEN_COLON)) {
                         t = parse_typespec();
                 }
-                return new_typespec_function(args, buf_len(args), t);
+                return new_typespec_function(pos, args, buf_len(args), t);
         }
         
         fatal_error(unexpected_token, token_kind(token.kind), "type");
@@ -401,11 +415,13 @@ Typespec *parse_basetype(void)
 
 Typespec *parse_typespec_modifier(Typespec *base)
 {
-        if (match_keyword(const_keyword)) {
-                return new_typespec_const(base);
+        SrcPos pos = token.pos;
+
+        if (match_keyword(KEYWORD_const)) {
+                return new_typespec_const(pos, base);
         }
         if (match_token(TOKEN_MUL)) {
-                return new_typespec_ptr(base);
+                return new_typespec_ptr(pos, base);
         }
         if (match_token(TOKEN_L_BRACE)) {
                 Expr *length = NULL;
@@ -413,7 +429,7 @@ Typespec *parse_typespec_modifier(Typespec *base)
                         length = parse_expr();
                 }
                 expect_token(TOKEN_R_BRACE);
-                return new_typespec_array(base, length);
+                return new_typespec_array(pos, base, length);
         }
         
         syntax_error(unexpected_token, token_kind(token.kind), "type modifier");
@@ -445,53 +461,56 @@ char is_assign_op()
 
 Stmt *parse_statement(void)
 {
-        Expr *e;
+        SrcPos pos = token.pos;
+        Expr *e, *init, *cond, *step;
+        SwitchCase **cases = NULL;
         Stmt *s;
         
-        if (match_keyword(break_keyword)) {
-                return new_stmt_break();
-        }
-        if (match_keyword(continue_keyword)) {
-                return new_stmt_continue();
-        }
-        if (match_keyword(return_keyword)) {
+        switch (token_keyword()) {
+        case KEYWORD_break:
+                next_token();
+                return new_stmt_break(pos);
+        case KEYWORD_continue:
+                next_token();
+                return new_stmt_continue(pos);
+        case KEYWORD_return:
+                next_token();
                 if (is_token(TOKEN_SEMICOLON)) {
-                        return new_stmt_return(NULL);
+                        return new_stmt_return(pos, NULL);
                 }
                 e = parse_expr();
-                return new_stmt_return(e);
-        }
-        if (match_keyword(if_keyword)) {
+                return new_stmt_return(pos, e);
+        case KEYWORD_if:
+                next_token();
                 expect_token(TOKEN_L_PAREN);
                 e = parse_expr();
                 expect_token(TOKEN_R_PAREN);
                 s = parse_statement();
-                if (!is_token_keyword(else_keyword)) {
-                        return new_stmt_if(e, s, NULL);
+                if (!is_token_keyword(KEYWORD_else)) {
+                        return new_stmt_if(pos, e, s, NULL);
                 }
-                match_keyword(else_keyword);
-                return new_stmt_if(e, s, parse_statement());
-        }
-        if (match_keyword(while_keyword)) {
+                match_keyword(KEYWORD_else);
+                return new_stmt_if(pos, e, s, parse_statement());
+        case KEYWORD_while:
+                next_token();
                 expect_token(TOKEN_L_PAREN);
                 e = parse_expr();
                 expect_token(TOKEN_R_PAREN);
                 s = parse_statement();
-                return new_stmt_while(e, s);
-        }
-        if (match_keyword(do_keyword)) {
+                return new_stmt_while(pos, e, s);
+        case KEYWORD_do:
+                next_token();
                 s = parse_statement();
-                if (!is_token_keyword(while_keyword)) {
+                if (!is_token_keyword(KEYWORD_while)) {
                         syntax_error("Expected while keyword");
                 }
-                match_keyword(while_keyword);
+                match_keyword(KEYWORD_while);
                 expect_token(TOKEN_L_PAREN);
                 e = parse_expr();
                 expect_token(TOKEN_R_PAREN);
-                return new_stmt_do_while(s, e);
-        }
-        if (match_keyword(for_keyword)) {
-                Expr *init, *cond, *step;
+                return new_stmt_do_while(pos, s, e);
+        case KEYWORD_for:
+                next_token();
                 expect_token(TOKEN_L_PAREN);
                 init = NULL;
                 if (!is_token(TOKEN_SEMICOLON)) {
@@ -509,10 +528,9 @@ Stmt *parse_statement(void)
                 }
                 expect_token(TOKEN_R_PAREN);
                 s = parse_statement();
-                return new_stmt_for(init, cond, step, s);
-        }
-        if (match_keyword(switch_keyword)) {
-                SwitchCase **cases = NULL;
+                return new_stmt_for(pos, init, cond, step, s);
+        case KEYWORD_switch:
+                next_token();
                 expect_token(TOKEN_L_PAREN);
                 e = parse_expr();
                 expect_token(TOKEN_R_PAREN);
@@ -522,10 +540,13 @@ Stmt *parse_statement(void)
                 }
                 expect_token(TOKEN_R_BRACKET);
                 if (cases == NULL) {
-                        return new_stmt_switch(e, NULL, 0);
+                        return new_stmt_switch(pos, e, NULL, 0);
                 }
-                return new_stmt_switch(e, cases, buf_len(cases));
+                return new_stmt_switch(pos, e, cases, buf_len(cases));
+        default:
+                break;
         }
+
         if (match_token(TOKEN_L_BRACKET)) {
                 Stmt **statements = NULL;
                 while (!is_token(TOKEN_R_BRACKET)) {
@@ -534,16 +555,16 @@ Stmt *parse_statement(void)
                 }
                 expect_token(TOKEN_R_BRACKET);
                 if (statements == NULL) {
-                        return new_stmt_block(NULL, 0);
+                        return new_stmt_block(pos, NULL, 0);
                 }
-                return new_stmt_block(statements, buf_len(statements));
+                return new_stmt_block(pos, statements, buf_len(statements));
         }
         if (match_token(TOKEN_SEMICOLON)) {
-                return new_stmt_block(NULL, 0);
+                return new_stmt_block(pos, NULL, 0);
         }
         
         e = parse_expr();
-        return new_stmt_expr(e);
+        return new_stmt_expr(pos, e);
 }
 
 
@@ -553,19 +574,19 @@ SwitchCase *parse_switch_case(void)
         Stmt **stmts = NULL;
         
         sc->expr = NULL;
-        if (    !is_token_keyword(case_keyword) &&
-                !is_token_keyword(default_keyword)) {
+        if (    !is_token_keyword(KEYWORD_case) &&
+                !is_token_keyword(KEYWORD_default)) {
                         syntax_error("Expected case or default keywords");
         }
-        if (match_keyword(case_keyword)) {
+        if (match_keyword(KEYWORD_case)) {
                 sc->expr = parse_expr();
         } else {
-                match_keyword(default_keyword);
+                match_keyword(KEYWORD_default);
         }
         expect_token(TOKEN_COLON);
         
-        while ( !is_token_keyword(case_keyword) &&
-                !is_token_keyword(default_keyword) &&
+        while ( !is_token_keyword(KEYWORD_case) &&
+                !is_token_keyword(KEYWORD_default) &&
                 !is_token(TOKEN_R_BRACKET)) {
                         buf_push(stmts, parse_statement());
                         match_token(TOKEN_SEMICOLON);
@@ -577,7 +598,7 @@ SwitchCase *parse_switch_case(void)
         if (buf_len(stmts) == 1) {
                 sc->stmt = stmts[0];
         } else {
-                sc->stmt = new_stmt_block(stmts, buf_len(stmts));
+                sc->stmt = new_stmt_block(stmts[0]->pos, stmts, buf_len(stmts));
         }
         return sc;
 }
@@ -585,69 +606,74 @@ SwitchCase *parse_switch_case(void)
 
 Decl *parse_declaration(void)
 {
+        SrcPos pos = token.pos;
         const char *name;
+        uint64_t start;
+        Decl *decl;
         Typespec *type;
+        Expr *expr;
+        char is_struct;
         
-        if (match_keyword(typedef_keyword)) {
+        switch (token_keyword()) {
+        case KEYWORD_typedef:
+                next_token();
                 name = token.name;
                 expect_token(TOKEN_NAME);
                 expect_token(TOKEN_ASSIGN);
                 type = parse_typespec();
-                return new_decl_typedef(name, type);
-        }
-        if (match_keyword(enum_keyword)) {
+                return new_decl_typedef(pos, name, type);
+        case KEYWORD_enum:
+                next_token();
                 name = token.name;
                 expect_token(TOKEN_NAME);
                 expect_token(TOKEN_L_BRACKET);
-                return parse_enum_decl(name);
-        }
-        if (    is_token_keyword(struct_keyword) ||
-                is_token_keyword(union_keyword))
-        {
-                char is_struct = is_token_keyword(struct_keyword);
+                return parse_enum_decl(pos, name);
+        case KEYWORD_struct:
+        case KEYWORD_union:
+                is_struct = is_token_keyword(KEYWORD_struct);
                 next_token();
                 name = token.name;
                 expect_token(TOKEN_NAME);
-                return parse_aggregate(name, is_struct);
-        }
-        if (match_keyword(const_keyword)) {
-                Expr *expr;
-                
+                return parse_aggregate(pos, name, is_struct);
+        case KEYWORD_const:
+                next_token();
                 name = token.name;
                 expect_token(TOKEN_NAME);
                 expect_token(TOKEN_ASSIGN);
                 expr = parse_expr();
-                return new_decl_const(name, NULL, expr);
-        }
-        if (match_keyword(var_keyword)) {
-                Expr *expr;
-                
+                return new_decl_const(pos, name, NULL, expr);
+        case KEYWORD_var:
+                next_token();
                 name = token.name;
                 expect_token(TOKEN_NAME);
                 if (match_token(TOKEN_ASSIGN)) {
                         expr = parse_expr();
-                        return new_decl_var(name, NULL, expr);
+                        return new_decl_var(pos, name, NULL, expr);
                 }
                 expect_token(TOKEN_COLON);
                 type = parse_typespec();
                 if (!match_token(TOKEN_ASSIGN)) {
-                        return new_decl_var(name, type, NULL);
+                        return new_decl_var(pos, name, type, NULL);
                 }
                 expr = parse_expr();
-                return new_decl_var(name, type, expr);
-        }
-        if (match_keyword(func_keyword)) {
+                return new_decl_var(pos, name, type, expr);
+        case KEYWORD_func:
+                next_token();
                 name = token.name;
                 expect_token(TOKEN_NAME);
                 expect_token(TOKEN_L_PAREN);
-                return parse_func_decl(name);
+                start = trace_begin();
+                decl = parse_func_decl(pos, name);
+                trace_end(start, "parse_func_decl", name);
+                return decl;
+        default:
+                syntax_error("Expected declaration got %s", token_kind(token.kind));
+                return NULL;
         }
-        syntax_error("Expected declaration got %s", token_kind(token.kind));
-        return NULL;
 }
 
 
-Decl *parse_enum_decl(const char *name)
+Decl *parse_enum_decl(SrcPos pos, const char *name)
 {
         BoxDecl *box = new_box_decl();
         
@@ -670,14 +696,15 @@ Decl *parse_enum_decl(const char *name)
                 box->num_names = buf_len(box->names);
                 assert(box->num_names == buf_len(box->exprs));
         }
-        return new_decl_enum(name, box);
+        return new_decl_enum(pos, name, box);
 }
 
 
-Decl *parse_func_decl(const char *name)
+Decl *parse_func_decl(SrcPos pos, const char *name)
 {
         FuncDecl *decl = NULL;
         Stmt **stmt = NULL;
+        SrcPos body_pos;
         Stmt *body;
         
         decl = new_func_decl();
@@ -705,6 +732,7 @@ Decl *parse_func_decl(const char *name)
         if (match_token(TOKEN_COLON)) {
                 decl->ret = parse_typespec();
         }
+        body_pos = token.pos;
         expect_token(TOKEN_L_BRACKET);
         while (!is_token(TOKEN_R_BRACKET)) {
                 buf_push(stmt, parse_statement());
@@ -712,12 +740,12 @@ Decl *parse_func_decl(const char *name)
         }
         expect_token(TOKEN_R_BRACKET);
         
-        body = new_stmt_block(stmt, buf__len(stmt));
-        return new_decl_func(name, decl, body);
+        body = new_stmt_block(body_pos, stmt, buf__len(stmt));
+        return new_decl_func(pos, name, decl, body);
 }
 
 
-Decl *parse_aggregate(const char *name, char is_struct)
+Decl *parse_aggregate(SrcPos pos, const char *name, char is_struct)
 {
         BoxDecl *box = new_box_decl();
         
@@ -743,17 +771,20 @@ Decl *parse_aggregate(const char *name, char is_struct)
                 assert(box->num_names == buf_len(box->types));
         }
         if (is_struct)
-                return new_decl_struct(name, box);
-        else    return new_decl_union(name, box);
+                return new_decl_struct(pos, name, box);
+        else    return new_decl_union(pos, name, box);
 }
 
 
 Decl **recursive_descent_parser(void)
 {
         Decl *decl, **ast = NULL;
+        uint64_t start;
 
         while (!is_token(TOKEN_EOF)) {
+                start = trace_begin();
                 decl = parse_declaration();
+                trace_end(start, "parse_declaration", decl ? decl->name : NULL);
                 if (decl == NULL) break;
                 buf_push(ast, decl);
         }
@@ -202,6 +202,88 @@ void parser_declaration_tests()
 }
 
 
+// the flat AST has to print exactly like the tree it came from
+void parser_flat_ast_tests()
+{
+        const char *source =
+                "typedef ptr = void *\n"
+                "typedef cb = (func(int, char *): int[4])[2]\n"
+                "enum e { A = 0, B, C = A + 2 }\n"
+                "struct S { i: int; j: int const; t: T*; a: uint8_t[3] }\n"
+                "union T { int_val: int; float_val: double; str_val: char const * }\n"
+                "const MAX_EXPRS = 1024\n"
+                "var j: int\n"
+                "var f = 2.5\n"
+                "var big = 0x123456789abcdef\n"
+                "var len: size_t = MAX_EXPRS\n"
+                "func chill_out() {}\n"
+                "func f(a: int, b: char*): int {\n"
+                "        switch (a) { case 1: return 2; default: b++ }\n"
+                "        do { a-- } while (a > 0 && !b)\n"
+                "        while (1) { break; continue }\n"
+                "        for (;;) {}\n"
+                "        for (i := 0; i < a; i++) if (b[i]) print(\"yes\", i) else { return; }\n"
+                "        x := cast(int) 3 + sizeof(x) * sizeof(:int*)\n"
+                "        p.next.val = -~x\n"
+                "        return a ? b : c\n"
+                "}\n";
+        char *expected;
+        Decl **ast, **back;
+        FlatAst flat;
+
+        init_stream(source);
+        ast = recursive_descent_parser();
+        print_ast(ast, buf_len(ast));
+        expected = print_buf;
+        print_buf = NULL;
+        buf_init(print_buf);
+
+        flat = flatten_ast(ast, buf_len(ast));
+        assert(buf_len(flat.decls) == buf_len(ast) + 1);
+        print_flat_ast(&flat);
+        test_print_buf(expected);
+
+        // and back again
+        back = unflatten_ast(&flat, buf_len(flat.decls), 0);
+        assert(buf_len(back) == buf_len(ast));
+        for (size_t i = 0; i < buf_len(ast); i++)
+                assert(back[i]->pos == ast[i]->pos && back[i]->name == ast[i]->name);
+        print_ast(back, buf_len(back));
+        test_print_buf(expected);
+
+        flat_ast_free(&flat);
+        buf_free(back);
+        buf_free(expected);
+        buf_free(ast);
+}
+
+
+#define assert_src_loc(pos, l, c) assert(src_loc(pos).line == (l) && \
+        src_loc(pos).col == (c))
+
+void parser_position_tests()
+{
+        Decl **ast;
+        Stmt *ret;
+
+        init_stream("var x = 1\n"
+                "func f(a: int): int {\n"
+                "        return a +  2\n"
+                "}\n");
+        ast = recursive_descent_parser();
+        assert(buf_len(ast) == 2);
+        assert_src_loc(ast[0]->pos, 1, 1);
+        assert_src_loc(ast[0]->var.expr->pos, 1, 9);
+        assert_src_loc(ast[1]->pos, 2, 1);
+        assert_src_loc(ast[1]->func.decl->ret->pos, 2, 17);
+        ret = ast[1]->func.body->block.stmt[0];
+        assert_src_loc(ret->pos, 3, 9);
+        assert_src_loc(ret->expr->pos, 3, 18);
+        assert_src_loc(ret->expr->binary.right->pos, 3, 21);
+        buf_free(ast);
+}
+
+
 void parser_test()
 {
         use_print_buf = YES;
@@ -209,10 +291,15 @@ void parser_test()
         
         init_keywords();
         
-        parser_expression_tests();
-        parser_typespec_tests();
-        parser_statement_tests();
-        parser_declaration_tests();
+        for (use_token_buffer = 0; use_token_buffer <= 1; use_token_buffer++) {
+                parser_expression_tests();
+                parser_typespec_tests();
+                parser_statement_tests();
+                parser_declaration_tests();
+                parser_flat_ast_tests();
+                parser_position_tests();
+        }
+        use_token_buffer = 0;
         
         use_print_buf = NO;
 }
@@ -0,0 +1,119 @@
+#ifndef ION_PROFILE
+#define ION_PROFILE
+
+// Per phase totals for the --time report.  Phases run per file on
+// any thread add their time and counts under a lock once per file, so
+// their time is summed over threads, the wall time of the stages that
+// contain them is measured separately by the caller.  Phases are also
+// recorded as trace zones when tracing.  With both off profile_start
+// is a single branch and profile_end returns right away.
+
+enum Phase {
+        PHASE_LOAD,
+        PHASE_LEX,
+        PHASE_PARSE,
+        PHASE_CACHE,
+        PHASE_MERGE,
+        PHASE_RESOLVE,
+        PHASE_CHECK,
+        PHASE_CODEGEN,
+        PHASE_PRINT,
+        NUM_PHASES
+};
+
+const char *phase_name[NUM_PHASES] = {
+        [PHASE_LOAD] = "load",
+        [PHASE_LEX] = "lex",
+        [PHASE_PARSE] = "parse",
+        [PHASE_CACHE] = "cache",
+        [PHASE_MERGE] = "merge",
+        [PHASE_RESOLVE] = "resolve",
+        [PHASE_CHECK] = "check",
+        [PHASE_CODEGEN] = "codegen",
+        [PHASE_PRINT] = "print",
+};
+
+typedef struct PhaseStats {
+        uint64_t ns;
+        size_t calls;
+        size_t bytes; // of source text
+        size_t tokens;
+        size_t nodes; // arena allocations, child lists included
+} PhaseStats;
+
+char profiling;
+PhaseStats phase_stats[NUM_PHASES];
+static pthread_mutex_t phase_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define profile_start() (profiling || tracing ? nanotime() : 0)
+
+
+void profile_end(enum Phase phase, uint64_t start, size_t bytes,
+        size_t tokens, size_t nodes)
+{
+        PhaseStats *s = phase_stats + phase;
+        uint64_t end, ns;
+
+        if (!profiling && !tracing)
+                return;
+        end = nanotime();
+        trace_event(phase_name[phase], NULL, start, end);
+        if (!profiling)
+                return;
+        ns = end - start;
+        pthread_mutex_lock(&phase_stats_lock);
+        s->ns += ns;
+        s->calls++;
+        s->bytes += bytes;
+        s->tokens += tokens;
+        s->nodes += nodes;
+        pthread_mutex_unlock(&phase_stats_lock);
+}
+
+
+// in bytes, 0 where unknown
+size_t peak_rss(void)
+{
+        struct rusage usage;
+
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+                return 0;
+        return (size_t) usage.ru_maxrss * 1024;
+}
+
+
+// rates are per second of phase time, so per thread
+void print_profile(FILE *out, uint64_t wall)
+{
+        PhaseStats *s;
+        double sec;
+
+        fprintf(out, "time: %-7s %9s %6s %9s %9s %10s\n",
+                "phase", "ms", "calls", "MB/s", "Mtok/s", "nodes");
+        for (int i = 0; i < NUM_PHASES; i++) {
+                s = phase_stats + i;
+                if (s->calls == 0)
+                        continue;
+                sec = s->ns / 1e9;
+                fprintf(out, "time: %-7s %9.2f %6zu", phase_name[i], s->ns / 1e6, s->calls);
+                if (s->bytes && sec > 0)
+                        fprintf(out, " %9.1f", s->bytes / sec / 1e6);
+                else    fprintf(out, " %9s", "-");
+                if (s->tokens && sec > 0)
+                        fprintf(out, " %9.2f", s->tokens / sec / 1e6);
+                else    fprintf(out, " %9s", "-");
+                if (s->nodes)
+                        fprintf(out, " %10zu\n", s->nodes);
+                else    fprintf(out, " %10s\n", "-");
+        }
+        fprintf(out, "time: wall %.2f ms, peak rss %.1f MB\n",
+                wall / 1e6, peak_rss() / 1e6);
+}
+
+
+void reset_profile(void)
+{
+        memset(phase_stats, 0, sizeof(phase_stats));
+}
+
+#endif
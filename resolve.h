@@ -0,0 +1,671 @@
+#ifndef ION_RESOLVE
+#define ION_RESOLVE
+
+// Resolves names to symbols and typespecs to types.  All declarations
+// of a package are entered as unresolved symbols first, so order in
+// the source doesn't matter, then resolution starts at the entry points
+// and follows only what they reference:
+//
+//      a global is resolved the first time a name refers to it,
+//      a struct or union is completed only where it is used by value,
+//      a function body is resolved once its function is referenced.
+//
+// Declarations that nothing reaches cost no more than entering their
+// name.  A symbol is SYM_RESOLVING while its declaration is looked at
+// and a struct TYPE_COMPLETING while its fields are, meeting either
+// again is a cycle.  Bodies are queued rather than resolved right away
+// and pointers don't need complete types, so recursive functions and
+// linked structs are fine.
+//
+// Completing a struct or union lays it out, see set_bucket.  Constants,
+// enum values and array lengths are evaluated as they are resolved and
+// function bodies are folded, see const_eval.h.
+
+Type *type_none; // of expressions that failed to resolve
+Type *type_void;
+Type *type_char;
+Type *type_int;
+Type *type_int64;
+Type *type_float;
+Type *type_double;
+Type *type_size_t;
+
+static struct {
+        const char *name;
+        enum TypeKind kind;
+        size_t size;
+        char is_unsigned;
+        Type **global;
+        Type *type;
+} builtin_types[] = {
+        {"void", TYPE_VOID, 0, 0, &type_void, NULL},
+        {"char", TYPE_CHAR, 1, 0, &type_char, NULL},
+        {"int", TYPE_INT, 4, 0, &type_int, NULL},
+        {"float", TYPE_FLOAT, 4, 0, &type_float, NULL},
+        {"double", TYPE_FLOAT, 8, 0, &type_double, NULL},
+        {"int8_t", TYPE_INT, 1, 0, NULL, NULL},
+        {"int16_t", TYPE_INT, 2, 0, NULL, NULL},
+        {"int32_t", TYPE_INT, 4, 0, NULL, NULL},
+        {"int64_t", TYPE_INT, 8, 0, &type_int64, NULL},
+        {"uint8_t", TYPE_INT, 1, 1, NULL, NULL},
+        {"uint16_t", TYPE_INT, 2, 1, NULL, NULL},
+        {"uint32_t", TYPE_INT, 4, 1, NULL, NULL},
+        {"uint64_t", TYPE_INT, 8, 1, NULL, NULL},
+        {"size_t", TYPE_INT, 8, 1, &type_size_t, NULL},
+};
+
+Sym **resolved_syms; // in the order they were resolved, dependencies first
+static Sym **pending_bodies; // functions whose bodies are still to do
+
+void resolve_expr(Expr *e);
+
+// see const_eval.h
+char eval_int_const(Expr *e, int64_t *val);
+void eval_const_sym(Sym *sym, Expr *e);
+void fold_expr(Expr *e);
+
+
+// Forgets all global symbols and enters the builtin types.  The types
+// themselves are made once, so the type caches stay valid.
+void init_resolver(void)
+{
+        size_t n = sizeof(builtin_types) / sizeof(*builtin_types);
+        Type *type;
+
+        sym_reset_globals();
+        buf_free(resolved_syms);
+        buf_free(pending_bodies);
+        if (type_none == NULL) {
+                type_none = new_type(TYPE_NONE, 0, 1);
+                for (size_t i = 0; i < n; i++) {
+                        type = new_type(builtin_types[i].kind, builtin_types[i].size,
+                                builtin_types[i].size ? builtin_types[i].size : 1);
+                        type->is_unsigned = builtin_types[i].is_unsigned;
+                        builtin_types[i].type = type;
+                        if (builtin_types[i].global)
+                                *builtin_types[i].global = type;
+                }
+        }
+        for (size_t i = 0; i < n; i++) {
+                type = builtin_types[i].type;
+                type->symbol = sym_global_type(str_intern(builtin_types[i].name), type);
+        }
+}
+
+
+// enters the declarations of a package, none are resolved yet
+void resolve_decls(Decl **decls, size_t num_decls)
+{
+        for (size_t i = 0; i < num_decls; i++)
+                sym_global_decl(decls[i]);
+}
+
+
+Sym *resolve_name(const char *name, SrcPos pos);
+
+
+static char resolve_int_const(Expr *e, int64_t *val)
+{
+        resolve_expr(e);
+        return eval_int_const(e, val);
+}
+
+
+Type *resolve_typespec(Typespec *t);
+
+
+static Type *resolve_typespec_once(Typespec *t)
+{
+        Type **args = NULL, *type, *ret;
+        int64_t length = 0;
+        Sym *sym;
+
+        switch (t->kind) {
+        case TYPESPEC_NAME:
+                sym = resolve_name(t->name, t->pos);
+                if (sym == NULL)
+                        return type_none;
+                if (sym->kind != SYM_TYPE) {
+                        log_error_at(t->pos, "%s is not a type", t->name);
+                        return type_none;
+                }
+                return sym->type;
+        case TYPESPEC_CONST:
+                // const is not part of types yet
+                return resolve_typespec(t->base);
+        case TYPESPEC_PTR:
+                return type_ptr(resolve_typespec(t->base));
+        case TYPESPEC_ARRAY:
+                type = resolve_typespec(t->array.base);
+                if (t->array.length && resolve_int_const(t->array.length, &length) &&
+                        length < 0) {
+                                log_error_at(t->array.length->pos, "negative array length");
+                                length = 0;
+                }
+                return type_array(type, length);
+        case TYPESPEC_FUNCTION:
+                for (size_t i = 0; i < t->func.num_args; i++)
+                        buf_push(args, resolve_typespec(t->func.args[i]));
+                ret = t->func.ret ? resolve_typespec(t->func.ret) : type_void;
+                type = type_func(args, t->func.num_args, ret);
+                if (type->func.args != args)
+                        buf_free(args);
+                return type;
+        default:
+                assert(0);
+                return type_none;
+        }
+}
+
+
+// The type is kept in the typespec, for sizeof and the type checker.
+Type *resolve_typespec(Typespec *t)
+{
+        if (t->type == NULL)
+                t->type = resolve_typespec_once(t);
+        return t->type;
+}
+
+
+void complete_type(Type *type, SrcPos pos);
+
+
+// fields name global types only, even when completed from a body
+static void complete_bucket(Type *type)
+{
+        Decl *decl = type->symbol->decl;
+        BoxDecl *box = decl->box;
+        Type **types = NULL, *field;
+        uint64_t start = trace_begin();
+        Scope *locals = sym_hide_locals();
+
+        type->kind = TYPE_COMPLETING;
+        for (size_t i = 0; i < box->num_names; i++) {
+                field = resolve_typespec(box->types[i]);
+                complete_type(field, box->types[i]->pos);
+                if (field->kind == TYPE_VOID)
+                        log_error_at(box->types[i]->pos, "field %s of type void",
+                                box->names[i]);
+                buf_push(types, field);
+        }
+        set_bucket(type, decl->kind == DECL_STRUCT ? TYPE_STRUCT : TYPE_UNION,
+                box->names, types, box->num_names);
+        for (size_t i = 0; i < box->num_names; i++) {
+                if (field_index(type, box->names[i]) != i)
+                        log_error_at(box->types[i]->pos, "%s redeclared in %s",
+                                box->names[i], type->symbol->name);
+        }
+        sym_show_locals(locals);
+        buf_push(resolved_syms, type->symbol);
+        trace_end(start, "complete", type->symbol->name);
+}
+
+
+// Completes a type used by value at pos.  Arrays get their size here,
+// as their element may have been incomplete when they were made.
+void complete_type(Type *type, SrcPos pos)
+{
+        switch (type->kind) {
+        case TYPE_INCOMPLETE:
+                complete_bucket(type);
+                break;
+        case TYPE_COMPLETING:
+                log_error_at(pos, "%s contains itself", type->symbol->name);
+                break;
+        case TYPE_ARRAY:
+                complete_type(type->array.type, pos);
+                type->size = type->array.type->size * type->array.length;
+                type->align = type->array.type->align;
+                break;
+        default:
+                break;
+        }
+}
+
+
+static Type *resolve_func_type(Decl *decl)
+{
+        FuncDecl *f = decl->func.decl;
+        Type **args = NULL, *ret, *type;
+
+        for (size_t i = 0; i < f->num_args; i++)
+                buf_push(args, resolve_typespec(f->types[i]));
+        ret = f->ret ? resolve_typespec(f->ret) : type_void;
+        type = type_func(args, f->num_args, ret);
+        if (type->func.args != args)
+                buf_free(args);
+        return type;
+}
+
+
+// An implicit value is one more than the one before.  The unresolved
+// implicit members before it are resolved first, in order, each from
+// the one before it, so a long enum is one pass and not a recursion
+// per member.
+static void resolve_enum_const(Sym *sym)
+{
+        BoxDecl *box = sym->decl->box;
+        size_t i = sym->val, j;
+        Sym *prev;
+
+        sym->type = type_int;
+        sym->val = 0;
+        if (box->exprs[i]) {
+                resolve_int_const(box->exprs[i], &sym->val);
+                return;
+        }
+        if (i == 0)
+                return;
+        for (j = i - 1; j > 0 && box->exprs[j] == NULL; j--) {
+                prev = sym_get(box->names[j - 1]);
+                if (prev == NULL || prev->decl != sym->decl || prev->state != SYM_UNRESOLVED)
+                        break;
+        }
+        for (; j < i - 1; j++)
+                resolve_name(box->names[j], sym->decl->pos);
+        prev = resolve_name(box->names[i - 1], sym->decl->pos);
+        if (prev)
+                sym->val = prev->val + 1;
+}
+
+
+static void resolve_var(Sym *sym)
+{
+        Decl *decl = sym->decl;
+
+        // the type of an untyped one is left to the type checker
+        if (decl->var.type) {
+                sym->type = resolve_typespec(decl->var.type);
+                complete_type(sym->type, decl->var.type->pos);
+        }
+        resolve_expr(decl->var.expr);
+        fold_expr(decl->var.expr);
+}
+
+
+void resolve_sym(Sym *sym)
+{
+        Decl *decl = sym->decl;
+        Scope *locals;
+
+        if (sym->state != SYM_UNRESOLVED)
+                return;
+        sym->state = SYM_RESOLVING;
+        locals = sym_hide_locals();
+        switch (sym->kind) {
+        case SYM_TYPE:
+                if (decl->kind == DECL_ENUM) {
+                        sym->type = new_type(TYPE_ENUM, 4, 4);
+                        sym->type->symbol = sym;
+                } else {
+                        sym->type = resolve_typespec(decl->typespec);
+                }
+                break;
+        case SYM_ENUM_CONST:
+                resolve_enum_const(sym);
+                break;
+        case SYM_CONST:
+                resolve_expr(decl->var.expr);
+                eval_const_sym(sym, decl->var.expr);
+                break;
+        case SYM_VAR:
+                resolve_var(sym);
+                break;
+        case SYM_FUNC:
+                sym->type = resolve_func_type(decl);
+                buf_push(pending_bodies, sym);
+                break;
+        default:
+                assert(0);
+        }
+        sym_show_locals(locals);
+        sym->state = SYM_RESOLVED;
+        buf_push(resolved_syms, sym);
+}
+
+
+// NULL if the name is undeclared or its declaration depends on itself
+Sym *resolve_name(const char *name, SrcPos pos)
+{
+        Sym *sym = sym_get(name);
+
+        if (sym == NULL) {
+                log_error_at(pos, "%s undeclared", name);
+                return NULL;
+        }
+        if (sym->state == SYM_RESOLVING) {
+                log_error_at(pos, "%s depends on itself", name);
+                return NULL;
+        }
+        resolve_sym(sym);
+        return sym;
+}
+
+
+// Field names are left to the type checker, it knows the struct.
+void resolve_expr(Expr *e)
+{
+        Expr *left;
+
+        if (e == NULL)
+                return;
+        switch (e->kind) {
+        case EXPR_NAME:
+                resolve_name(e->name, e->pos);
+                break;
+        case EXPR_INT:
+        case EXPR_FLOAT:
+        case EXPR_STR:
+                break;
+        case EXPR_CAST:
+                resolve_typespec(e->cast.type);
+                resolve_expr(e->cast.expr);
+                break;
+        case EXPR_CALL:
+                resolve_expr(e->call.expr);
+                for (size_t i = 0; i < e->call.num_args; i++)
+                        resolve_expr(e->call.args[i]);
+                break;
+        case EXPR_INDEX:
+                resolve_expr(e->index.oexpr);
+                resolve_expr(e->index.iexpr);
+                break;
+        case EXPR_FIELD:
+                resolve_expr(e->field.expr);
+                break;
+        case EXPR_UNARY:
+                resolve_expr(e->unary.expr);
+                break;
+        case EXPR_BINARY:
+                resolve_expr(e->binary.right);
+                left = e->binary.left;
+                if (e->binary.op != TOKEN_COLON_ASSIGN) {
+                        resolve_expr(left);
+                } else if (left->kind != EXPR_NAME) {
+                        log_error_at(left->pos, "expected a name before :=");
+                } else if (buf__len(local_scopes) == 0) {
+                        log_error_at(left->pos, ":= outside of a function");
+                } else {
+                        // typed by the type checker
+                        sym_push(left->name, NULL);
+                }
+                break;
+        case EXPR_TERNARY:
+                resolve_expr(e->ternary.cond);
+                resolve_expr(e->ternary.expr);
+                resolve_expr(e->ternary.or_expr);
+                break;
+        case EXPR_SIZEOF:
+                resolve_expr(e->sizeof_expr);
+                break;
+        case EXPR_SIZEOF_TYPE:
+                complete_type(resolve_typespec(e->sizeof_type), e->pos);
+                break;
+        default:
+                assert(0);
+        }
+}
+
+
+// folded while the locals it sees are in scope
+static void resolve_body_expr(Expr *e)
+{
+        resolve_expr(e);
+        fold_expr(e);
+}
+
+
+static void resolve_stmt(Stmt *s)
+{
+        SwitchCase *c;
+        size_t depth;
+
+        if (s == NULL)
+                return;
+        switch (s->kind) {
+        case STMT_BREAK:
+        case STMT_CONTINUE:
+                break;
+        case STMT_RETURN:
+        case STMT_EXPR:
+                resolve_body_expr(s->expr);
+                break;
+        case STMT_IF:
+                resolve_body_expr(s->if_stmt.cond);
+                resolve_stmt(s->if_stmt.body);
+                resolve_stmt(s->if_stmt.other);
+                break;
+        case STMT_WHILE:
+        case STMT_DO_WHILE:
+                resolve_body_expr(s->while_stmt.cond);
+                resolve_stmt(s->while_stmt.body);
+                break;
+        case STMT_FOR:
+                depth = sym_enter();
+                resolve_body_expr(s->for_stmt.init);
+                resolve_body_expr(s->for_stmt.cond);
+                resolve_body_expr(s->for_stmt.step);
+                resolve_stmt(s->for_stmt.body);
+                sym_leave(depth);
+                break;
+        case STMT_SWITCH:
+                resolve_body_expr(s->switch_stmt.expr);
+                depth = sym_enter();
+                for (size_t i = 0; i < s->switch_stmt.num_cases; i++) {
+                        c = s->switch_stmt.cases[i];
+                        resolve_body_expr(c->expr);
+                        resolve_stmt(c->stmt);
+                }
+                sym_leave(depth);
+                break;
+        case STMT_BLOCK:
+                depth = sym_enter();
+                for (size_t i = 0; i < s->block.num_stmt; i++)
+                        resolve_stmt(s->block.stmt[i]);
+                sym_leave(depth);
+                break;
+        default:
+                assert(0);
+        }
+}
+
+
+static void resolve_func_body(Sym *sym)
+{
+        FuncDecl *f = sym->decl->func.decl;
+        Type *type = sym->type;
+        uint64_t start = trace_begin();
+        size_t depth;
+
+        complete_type(type->func.ret, f->ret ? f->ret->pos : sym->decl->pos);
+        depth = sym_enter();
+        for (size_t i = 0; i < f->num_args; i++) {
+                complete_type(type->func.args[i], f->types[i]->pos);
+                sym_push(f->args[i], type->func.args[i]);
+        }
+        resolve_stmt(sym->decl->func.body);
+        sym_leave(depth);
+        trace_end(start, "resolve body", sym->name);
+}
+
+
+// bodies may reference more functions, which queue more bodies
+static void resolve_pending_bodies(void)
+{
+        for (size_t i = 0; i < buf__len(pending_bodies); i++)
+                resolve_func_body(pending_bodies[i]);
+        buf_free(pending_bodies);
+}
+
+
+// Resolves a global and everything reachable from it, NULL if there
+// is no such global.
+Sym *resolve_entry(const char *name)
+{
+        Sym *sym = map_get(&global_symbols_map, str_intern(name));
+
+        if (sym == NULL)
+                return NULL;
+        resolve_sym(sym);
+        if (sym->kind == SYM_TYPE)
+                complete_type(sym->type, sym->decl ? sym->decl->pos : 0);
+        resolve_pending_bodies();
+        return sym;
+}
+
+
+// every global is an entry point, for libraries and for checking all
+// of a package
+void resolve_all(void)
+{
+        Sym *sym;
+
+        for (size_t i = 0; i < buf__len(global_symbols); i++) {
+                sym = global_symbols[i];
+                resolve_sym(sym);
+                if (sym->kind == SYM_TYPE)
+                        complete_type(sym->type, sym->decl ? sym->decl->pos : 0);
+        }
+        resolve_pending_bodies();
+}
+
+
+static Decl **parse_resolve_test(const char *source)
+{
+        Decl **ast;
+
+        init_lex("<resolve_test>", source);
+        ast = recursive_descent_parser();
+        assert(num_errors == 0);
+        init_resolver();
+        resolve_decls(ast, buf_len(ast));
+        return ast;
+}
+
+
+#define global_sym(name) ((Sym *) map_get(&global_symbols_map, str_intern(name)))
+
+
+void resolve_test()
+{
+        size_t errors = num_errors;
+        char *source = NULL;
+        Decl **ast;
+        Sym *sym;
+
+        num_errors = 0;
+
+        // only what main reaches, declared in any order
+        ast = parse_resolve_test(
+                "func main(): int { return len(vec) + A.x }\n"
+                "var vec: Vec*\n"
+                "func len(v: Vec*): int { return v.n + helper(v.next) }\n"
+                "func helper(v: Vec*): int { return len(v) }\n"
+                "struct Vec { next: Vec*; n: int; data: uint8_t[16] }\n"
+                "var A: Point\n"
+                "struct Point { x: int; y: int }\n"
+                "struct Unused { u: Unused }\n"
+                "func unused(): Missing { return undeclared }\n"
+                "enum E { E0, E1 = 5, E2 }\n"
+                "union U { p: Point[3]; c: char[9] }\n");
+        sym = resolve_entry("main");
+        assert(num_errors == 0 && sym && sym->type->kind == TYPE_FUNC);
+        assert(sym->type->func.ret == type_int && sym->type->func.num_args == 0);
+        assert(global_sym("len")->state == SYM_RESOLVED);
+        assert(global_sym("helper")->state == SYM_RESOLVED);
+        assert(global_sym("Vec")->type->kind == TYPE_INCOMPLETE);
+        assert(global_sym("Point")->type->kind == TYPE_STRUCT);
+        assert(global_sym("Point")->type->bucket.types[1] == type_int);
+        assert(global_sym("A")->type == global_sym("Point")->type);
+        assert(global_sym("unused")->state == SYM_UNRESOLVED);
+        assert(global_sym("Unused")->type->kind == TYPE_INCOMPLETE);
+        assert(global_sym("E2")->state == SYM_UNRESOLVED);
+
+        // Vec is only used through pointers so far
+        assert(resolve_entry("E2")->val == 6);
+        assert(global_sym("E1")->val == 5 && global_sym("E0")->state == SYM_UNRESOLVED);
+        assert(resolve_entry("Vec")->type->kind == TYPE_STRUCT);
+        assert(global_sym("Vec")->type->bucket.types[0] == type_ptr(global_sym("Vec")->type));
+        assert(global_sym("Vec")->type->bucket.types[2] == type_array(
+                global_sym("uint8_t")->type, 16));
+        assert(global_sym("Vec")->type->bucket.offsets[2] == 12);
+        assert(global_sym("Vec")->type->size == 32);
+        assert(resolve_entry("U")->type->size == 24 && global_sym("U")->type->align == 4);
+        assert(resolve_entry("nothing") == NULL);
+        assert(num_errors == 0);
+
+        // locals shadow globals only in their scope, and globals
+        // resolved from inside a body don't see the body's locals
+        ast_free();
+        buf_free(ast);
+        ast = parse_resolve_test(
+                "var K = n\n"
+                "var n = 1\n"
+                "struct P { n: N }\n"
+                "typedef N = int\n"
+                "func f(N: int, p: P): int {\n"
+                "        n := N\n"
+                "        for (i := 0; i < n; i++) { k := K; n += k }\n"
+                "        return n + i\n"
+                "}\n");
+        quiet_errors = 1;
+        resolve_entry("f");
+        quiet_errors = 0;
+        assert(num_errors == 1); // i after the for
+        assert(global_sym("P")->type->bucket.types[0] == type_int);
+        assert(global_sym("n")->state == SYM_RESOLVED);
+
+        // cycles
+        ast_free();
+        buf_free(ast);
+        num_errors = 0;
+        ast = parse_resolve_test(
+                "struct A { b: B }\n"
+                "struct B { a: A[2] }\n"
+                "struct C { c: C* }\n"
+                "const X = Y\n"
+                "const Y = X\n"
+                "typedef T = U*\n"
+                "typedef U = T\n"
+                "func g(): A { return h() }\n"
+                "func h(): A { return g() }\n");
+        quiet_errors = 1;
+        resolve_entry("C");
+        assert(num_errors == 0 && global_sym("C")->type->kind == TYPE_STRUCT);
+        resolve_entry("A");
+        assert(num_errors == 1);
+        resolve_entry("T");
+        assert(num_errors == 2);
+        resolve_entry("X");
+        assert(num_errors == 3);
+        resolve_entry("g");
+        assert(num_errors == 3);
+        quiet_errors = 0;
+
+        // long enums resolve in a pass, not a recursion per member
+        ast_free();
+        buf_free(ast);
+        num_errors = 0;
+        buf_init(source);
+        source = buf_printf(source, "enum Long { L0 = 7");
+        for (int i = 1; i < 100000; i++)
+                source = buf_printf(source, i == 50000 ? ", L%d = -1" : ", L%d", i);
+        source = buf_printf(source, " }\n");
+        ast = parse_resolve_test(source);
+        assert(resolve_entry("L99999")->val == 49998);
+        assert(global_sym("L49999")->state == SYM_UNRESOLVED);
+        assert(resolve_entry("L49999")->val == 7 + 49999);
+        assert(resolve_entry("L1")->val == 8 && num_errors == 0);
+        release_src_file(source);
+        buf_free(source);
+
+        ast_free();
+        buf_free(ast);
+        buf_free(resolved_syms);
+        sym_reset_globals();
+        num_errors = errors;
+}
+
+#undef global_sym
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef SOURCE_FILES
+#define SOURCE_FILES
+
+
+typedef struct Source Source;
+
+struct Source {
+        const char *name;
+        const char *text; // always NUL terminated
+        size_t size;
+        size_t mapped; // length of the mapping, 0 if text is malloced
+};
+
+
+// 0 with errno set if the file ends before size bytes, as when it
+// shrank since its size was taken
+void release_src_file(const char *text); // see srcpos.h
+
+
+static char read_all(int fd, char *buf, size_t size)
+{
+        ssize_t n;
+        
+        while (size) {
+                n = read(fd, buf, size);
+                if (n == 0)
+                        errno = EIO;
+                if (n <= 0)
+                        return 0;
+                buf += n;
+                size -= n;
+        }
+        return 1;
+}
+
+
+// pipes and other files of unknown size
+static char *read_stream(int fd, size_t *size)
+{
+        size_t len = 0, cap = 64 * 1024;
+        char *buf = malloc(cap);
+        ssize_t n;
+        
+        while ((n = read(fd, buf + len, cap - len - 1)) > 0) {
+                len += n;
+                if (cap - len == 1)
+                        buf = realloc(buf, cap *= 2);
+        }
+        if (n < 0) {
+                free(buf);
+                return NULL;
+        }
+        buf[len] = 0;
+        *size = len;
+        return buf;
+}
+
+
+// Map the file read-only, followed by an anonymous zero page.  The
+// kernel zero fills the tail of the last file page and the extra page
+// covers files ending exactly on a page boundary, so the text is always
+// NUL terminated without copying it.
+static char *map_file(int fd, size_t size, size_t *mapped)
+{
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t len = ALIGN_UP(size, page) + page;
+        char *base, *text;
+        
+        base = mmap(NULL, len, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED)
+                return NULL;
+        text = mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+        if (text == MAP_FAILED) {
+                munmap(base, len);
+                return NULL;
+        }
+        madvise(text, size, MADV_SEQUENTIAL);
+        *mapped = len;
+        return text;
+}
+
+
+Source *load_source(const char *name)
+{
+        Source *src = NULL;
+        struct stat st;
+        char *text;
+        int fd;
+        
+        fd = open(name, O_RDONLY);
+        if (fd < 0 || fstat(fd, &st) < 0)
+                goto error;
+        
+        src = calloc(1, sizeof(Source));
+        src->name = name;
+        
+        if (!S_ISREG(st.st_mode)) {
+                text = read_stream(fd, &src->size);
+                if (text == NULL)
+                        goto error;
+                src->text = text;
+                goto done;
+        }
+        
+        src->size = st.st_size;
+        if (src->size) {
+                text = map_file(fd, src->size, &src->mapped);
+                if (text) {
+                        src->text = text;
+                        goto done;
+                }
+        }
+        
+        // fallback, a single read into a right-sized buffer
+        text = malloc(src->size + 1);
+        if (!read_all(fd, text, src->size)) {
+                free(text);
+                goto error;
+        }
+        text[src->size] = 0;
+        src->text = text;
+done:
+        close(fd);
+        return src;
+error:
+        perror(name);
+        if (fd >= 0)
+                close(fd);
+        free(src);
+        return NULL;
+}
+
+
+void unload_source(Source *src)
+{
+        release_src_file(src->text);
+        if (src->mapped)
+                munmap((void *) src->text, src->mapped);
+        else    free((void *) src->text);
+        free(src);
+}
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef ION_SOURCE_POSITIONS
+#define ION_SOURCE_POSITIONS
+
+// Every source lexed gets a range of one global 32-bit position space,
+// a position is the base of its file plus a byte offset, 0 means no
+// position.  Lines and columns are only worked out when a position is
+// printed, from a per-file index of line starts built on first use.
+
+typedef uint32_t SrcPos;
+
+typedef struct SrcFile {
+        const char *name;
+        const char *text;
+        SrcPos base;
+        uint32_t size;
+        uint32_t *lines; // offsets of line starts
+} SrcFile;
+
+typedef struct SrcLoc {
+        const char *name;
+        int line;
+        int col;
+} SrcLoc;
+
+// ordered by base, files are only ever added with increasing bases
+static SrcFile **src_files;
+static Map src_files_by_text;
+static SrcPos next_src_base = 1;
+static pthread_mutex_t src_files_lock = PTHREAD_MUTEX_INITIALIZER;
+
+uint32_t *index_lines(const char *text, size_t size); // see lex_simd.h
+
+
+// positions run up to and including base + size, the EOF token
+SrcPos add_src_file(const char *name, const char *text, size_t size)
+{
+        SrcFile *file;
+        SrcPos base;
+
+        pthread_mutex_lock(&src_files_lock);
+        file = map_get(&src_files_by_text, text);
+        if (file && file->name == name && file->size == size) {
+                pthread_mutex_unlock(&src_files_lock);
+                return file->base;
+        }
+        if (size >= UINT32_MAX - next_src_base) {
+                printf("%s: error: out of source positions\n", name);
+                exit(1);
+        }
+
+        file = calloc(1, sizeof(SrcFile));
+        file->name = name;
+        file->text = text;
+        file->size = size;
+        file->base = next_src_base;
+        next_src_base += size + 1;
+        buf_push(src_files, file);
+        map_put(&src_files_by_text, text, file);
+        base = file->base;
+        pthread_mutex_unlock(&src_files_lock);
+        return base;
+}
+
+
+// Forgets text when its memory is freed, so other text at the same
+// address later gets a file of its own.  Positions in the file keep
+// their name, but lines only if they were indexed before.
+void release_src_file(const char *text)
+{
+        SrcFile *file;
+
+        pthread_mutex_lock(&src_files_lock);
+        file = map_get(&src_files_by_text, text);
+        if (file) {
+                file->text = NULL;
+                map_put(&src_files_by_text, text, NULL);
+        }
+        pthread_mutex_unlock(&src_files_lock);
+}
+
+
+SrcLoc src_loc(SrcPos pos)
+{
+        SrcLoc loc = {"<unknown>", 0, 0};
+        size_t lo = 0, hi, mid;
+        uint32_t offset, *lines;
+        SrcFile *file;
+
+        if (pos == 0)
+                return loc;
+
+        // other threads may be adding files, and moving src_files
+        pthread_mutex_lock(&src_files_lock);
+        hi = buf__len(src_files);
+        if (hi == 0) {
+                pthread_mutex_unlock(&src_files_lock);
+                return loc;
+        }
+        while (hi - lo > 1) {
+                mid = (lo + hi) / 2;
+                if (src_files[mid]->base <= pos)
+                        lo = mid;
+                else    hi = mid;
+        }
+        file = src_files[lo];
+        if (file->lines == NULL && file->text)
+                file->lines = index_lines(file->text, file->size);
+        lines = file->lines;
+        pthread_mutex_unlock(&src_files_lock);
+        loc.name = file->name;
+        if (lines == NULL)
+                return loc;
+
+        // last line start at or before offset
+        offset = pos - file->base;
+        lo = 0;
+        hi = buf_len(lines);
+        while (hi - lo > 1) {
+                mid = (lo + hi) / 2;
+                if (lines[mid] <= offset)
+                        lo = mid;
+                else    hi = mid;
+        }
+        loc.line = lo + 1;
+        loc.col = offset - lines[lo] + 1;
+        return loc;
+}
+
+
+void print_src_pos(SrcPos pos)
+{
+        SrcLoc loc = src_loc(pos);
+        printf("%s:%d:%d", loc.name, loc.line, loc.col);
+}
+
+#endif
@@ -25,6 +25,7 @@ struct sbuf {
 #define buf_pop(b) (b[--buf_len(b)])
 #define buf_top(b) (b[buf_len(b) - 1])
 #define buf_end(b) (b + buf_len(b))
+#define buf_free(b) ((b) ? (free(buf__hdr(b)), (b) = NULL) : 0)
 
 
 void *buf_grow(const void *buf, size_t len, size_t elem_size)
@@ -32,8 +33,9 @@ void *buf_grow(const void *buf, size_t len, size_t elem_size)
         size_t new_cap, new_size;
         struct sbuf *hdr;
         
-        new_cap = buf__cap(buf) ? 2 * buf_cap(buf) : len;
-        assert(len <= new_cap);
+        new_cap = 2 * buf__cap(buf);
+        if (new_cap < len)
+                new_cap = len;
         new_size = BUF_HEADER_SIZE + new_cap * elem_size;
         
         if (buf) {
@@ -53,8 +55,9 @@ char *buf_printf(char *buf, const char *fmt, ...)
         size_t cap, n;
         
         va_start(args, fmt);
-        cap = buf_cap(buf) - buf_len(buf);
+        cap = buf__cap(buf) - buf__len(buf);
         n = 1 + vsnprintf(NULL, 0, fmt, args);
+        va_end(args);
         
         if (n > cap) {
                 buf__fit(buf, n);
@@ -85,11 +88,11 @@ void buf_test()
         
         char *str = NULL;
         buf_init(str);
-        buf_printf(str, "One:");
-        buf_printf(str, " %d.14", 3);
+        str = buf_printf(str, "One:");
+        str = buf_printf(str, " %d.14", 3);
         assert_str_cmp(str, "One: 3.14");
         
-        buf_printf(str, "Hex: 0x%x", 0x7fff);
+        str = buf_printf(str, "Hex: 0x%x", 0x7fff);
         assert_str_cmp(str, "One: 3.14Hex: 0x7fff");
 }
 
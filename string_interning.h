@@ -3,30 +3,171 @@
 
 
 struct _string {
-        size_t len;
+        uint64_t hash;
         const char *str;
 };
 
-static struct _string *table = NULL;
+// interned bytes live in the arena of their shard, right after
+// their length and keyword id (see keywords.h)
+struct _interned {
+        uint32_t len;
+        uint32_t keyword;
+        char str[];
+};
 
+#define str__hdr(s) ((struct _interned *) ((s) - offsetof(struct _interned, str)))
+#define str_len(s) str__hdr(s)->len
 
-const char *str_intern_slice(const char *str, size_t len)
+enum {
+        MIN_INTERN_TABLE_SIZE = 64, // per shard
+        INTERN_MIGRATE_STEP = 4, // old buckets moved per call, at least 2
+        INTERN_SHARDS = 64,
+        INTERN_CACHE_SIZE = 1024,
+};
+
+// The table is split into shards by the top bits of the hash, each
+// with its own lock and arena, so threads interning different names
+// rarely wait on each other.  Within a shard it's open addressing
+// with linear probing on the low bits, size is a power of two.
+//
+// Growing doesn't rehash at once: the old table is kept, read only,
+// and every call into the shard moves a few of its buckets to the new
+// one until none are left.  Names not moved yet are found by probing
+// the old table after the new one.
+struct _shard {
+        pthread_mutex_t lock;
+        struct _string *table, *old;
+        size_t size, used;
+        size_t old_size, migrated; // buckets of old moved so far
+        Arena arena;
+} __attribute__((aligned(64)));
+
+static struct _shard shards[INTERN_SHARDS] = {
+        [0 ... INTERN_SHARDS - 1] = {.lock = PTHREAD_MUTEX_INITIALIZER},
+};
+
+// Per thread direct mapped cache of recent lookups in front of the
+// shards, it only ever holds canonical pointers.
+static _Thread_local struct _string intern_cache[INTERN_CACHE_SIZE];
+char use_intern_cache = 1;
+
+#define str__shard(hash) (shards + ((hash) >> 58))
+
+
+static void str_table_insert(struct _shard *shard, struct _string s)
+{
+        size_t mask = shard->size - 1, i;
+
+        for (i = s.hash & mask; shard->table[i].str; i = (i + 1) & mask)
+                ;
+        shard->table[i] = s;
+}
+
+
+// Moves up to n buckets of the old table into the new one, frees the
+// old table once all are.  The new table is at least twice the old and
+// grows again only after size / 4 more names, so moving 2 buckets per
+// insert is enough to finish first.
+static void str_table_migrate(struct _shard *shard, size_t n)
+{
+        struct _string *s;
+
+        for (; n && shard->migrated < shard->old_size; n--) {
+                s = shard->old + shard->migrated++;
+                if (s->str)
+                        str_table_insert(shard, *s);
+        }
+        if (shard->old && shard->migrated == shard->old_size) {
+                free(shard->old);
+                shard->old = NULL;
+                shard->old_size = shard->migrated = 0;
+        }
+}
+
+
+static void str_table_grow(struct _shard *shard)
+{
+        str_table_migrate(shard, shard->old_size);
+        shard->old = shard->table;
+        shard->old_size = shard->size;
+        shard->migrated = 0;
+        shard->size = shard->size ? 2 * shard->size : MIN_INTERN_TABLE_SIZE;
+        shard->table = calloc(shard->size, sizeof(struct _string));
+}
+
+
+static struct _string *str_table_find(struct _string *table, size_t size,
+        uint64_t hash, const char *str, size_t len, size_t *end)
 {
+        size_t mask = size - 1, i;
         struct _string *s;
-        
-        if (table == NULL)
-                goto push;
-        
-        for (int i = 0; i < buf_len(table); i++) {
+
+        for (i = hash & mask; table[i].str; i = (i + 1) & mask) {
                 s = table + i;
-                if (s->len == len && strncmp(s->str, str, len) == 0)
-                        return s->str;
+                if (s->hash == hash && str_len(s->str) == len &&
+                        memcmp(s->str, str, len) == 0)
+                                return s;
         }
-        
-push:
-        str = strndup(str, len);
-        buf_push(table, ((struct _string) {len, str}));
-        return str;
+        *end = i;
+        return NULL;
+}
+
+
+static const char *str_intern_shard(struct _shard *shard, uint64_t hash,
+        const char *str, size_t len)
+{
+        struct _interned *in;
+        struct _string *s;
+        const char *result;
+        size_t i, unused;
+
+        pthread_mutex_lock(&shard->lock);
+
+        // keep load factor at most 1/2, counting names not moved yet
+        if (2 * (shard->used + 1) > shard->size)
+                str_table_grow(shard);
+        str_table_migrate(shard, INTERN_MIGRATE_STEP);
+
+        s = str_table_find(shard->table, shard->size, hash, str, len, &i);
+        if (s == NULL && shard->old)
+                s = str_table_find(shard->old, shard->old_size, hash, str, len, &unused);
+        if (s)
+                goto found;
+
+        in = arena_alloc(&shard->arena, sizeof(struct _interned) + len + 1);
+        in->len = len;
+        in->keyword = 0;
+        memcpy(in->str, str, len);
+        in->str[len] = 0;
+
+        s = shard->table + i;
+        s->hash = hash;
+        s->str = in->str;
+        shard->used++;
+found:
+        // the table may be regrown by another thread once unlocked
+        result = s->str;
+        pthread_mutex_unlock(&shard->lock);
+        return result;
+}
+
+
+const char *str_intern_slice(const char *str, size_t len)
+{
+        uint64_t hash = hash_bytes(str, len);
+        struct _string *c;
+
+        if (!use_intern_cache)
+                return str_intern_shard(str__shard(hash), hash, str, len);
+
+        c = intern_cache + (hash & (INTERN_CACHE_SIZE - 1));
+        if (c->str && c->hash == hash && str_len(c->str) == len &&
+                memcmp(c->str, str, len) == 0)
+                        return c->str;
+
+        c->hash = hash;
+        c->str = str_intern_shard(str__shard(hash), hash, str, len);
+        return c->str;
 }
 
 
@@ -36,6 +177,49 @@ const char *str_intern(const char *str)
 }
 
 
+double str_load_factor(void)
+{
+        size_t size = 0, used = 0;
+
+        for (int i = 0; i < INTERN_SHARDS; i++) {
+                pthread_mutex_lock(&shards[i].lock);
+                size += shards[i].size;
+                used += shards[i].used;
+                pthread_mutex_unlock(&shards[i].lock);
+        }
+        return size ? (double) used / size : 0;
+}
+
+
+enum { STR_TEST_NAMES = 4096 };
+static const char *str_test_ptrs[8][STR_TEST_NAMES];
+
+
+// every thread interns the same names in a different order
+static void str_test_job(void *ctx, size_t t)
+{
+        char name[32];
+        size_t j;
+
+        (void) ctx;
+        for (size_t i = 0; i < STR_TEST_NAMES; i++) {
+                j = (i * 7919 + t * 1021) % STR_TEST_NAMES;
+                sprintf(name, "threaded_%zu", j);
+                str_test_ptrs[t][j] = str_intern(name);
+        }
+}
+
+
+static void str_threads_test(void)
+{
+        run_jobs(str_test_job, NULL, 8, 8);
+        for (size_t t = 1; t < 8; t++) {
+                for (size_t i = 0; i < STR_TEST_NAMES; i++)
+                        assert(str_test_ptrs[t][i] == str_test_ptrs[0][i]);
+        }
+}
+
+
 void str_test()
 {
         const char *px, *py, *pz;
@@ -48,7 +232,35 @@ void str_test()
         assert(px == py);
         pz = str_intern(z);
         assert(pz != px);
+
+        // survive a few table resizes
+        char name[16];
+        const char *first = str_intern("name0");
+        for (int i = 0; i < 4 * INTERN_SHARDS * MIN_INTERN_TABLE_SIZE; i++) {
+                sprintf(name, "name%d", i);
+                str_intern(name);
+        }
+        assert(str_intern("name0") == first);
+
+        // names not moved out of an old table yet aren't added twice
+        double load = str_load_factor();
+        use_intern_cache = 0;
+        for (int i = 0; i < 4 * INTERN_SHARDS * MIN_INTERN_TABLE_SIZE; i++) {
+                sprintf(name, "name%d", i);
+                assert(strcmp(str_intern(name), name) == 0);
+        }
+        use_intern_cache = 1;
+        assert(str_load_factor() == load);
+        assert(str_intern_slice("hello!!", 6) == pz);
+        assert(str_len(pz) == 6);
+
+        // same pointers with and without the front cache
+        use_intern_cache = 0;
+        assert(str_intern("name0") == first);
+        assert(str_intern("hello") == px);
+        use_intern_cache = 1;
+
+        str_threads_test();
 }
 
 #endif
-
@@ -21,26 +21,40 @@ struct Sym {
         enum SymKind kind;
         enum SymState state;
         const char *name;
-        union {
-                Decl *decl;
-                Type *type;
-                int64_t val;
+        Decl *decl; // NULL for builtins and locals
+        Type *type; // NULL while unknown
+        union { // of constants, float_val if their type is TYPE_FLOAT
+                int64_t val; // an enum constant's index until resolved
+                double float_val;
         };
 };
 
 
+Sym **global_symbols; // in declaration order
+Map global_symbols_map; // interned name -> Sym *
+
+
+// Locals live in fixed size chunks which are never moved, so Sym
+// pointers stay valid until their scope is left.  Scopes growing past
+// LOCAL_INDEX_THRESHOLD symbols get a name -> Sym * index.
+
 enum {
-        MAX_LOCAL_SYMBOLS = 32
+        LOCAL_CHUNK_SIZE = 256,
+        LOCAL_INDEX_THRESHOLD = 16
+};
+
+typedef struct Scope Scope;
+
+struct Scope {
+        size_t start;
+        Map index;
 };
 
-Sym **global_symbols;
-Sym local_symbols[MAX_LOCAL_SYMBOLS];
+Sym **local_chunks;
+size_t num_local_symbols;
+Scope *local_scopes;
 
-Sym *local_sym_stack_top = local_symbols;
-#define PUSH(symbol) *local_sym_stack_top++ = symbol
-#define STACK_SIZE() (local_sym_stack_top - local_symbols)
-#define STACK_BOUNDARY() local_symbols + MAX_LOCAL_SYMBOLS
-#define STACK_OVERFLOW() local_sym_stack_top == STACK_BOUNDARY()
+#define local_sym(i) (local_chunks[(i) / LOCAL_CHUNK_SIZE] + (i) % LOCAL_CHUNK_SIZE)
 
 
 void *sym_alloc(int size)
@@ -74,9 +88,11 @@ Sym *new_sym_type(const char *name, Type *type)
 }
 
 
-Sym *new_sym_enum_const(const char *name, Decl *decl)
+Sym *new_sym_enum_const(const char *name, Decl *decl, size_t index)
 {
-        return new_sym(SYM_ENUM_CONST, name, decl);
+        Sym *s = new_sym(SYM_ENUM_CONST, name, decl);
+        s->val = index;
+        return s;
 }
 
 
@@ -118,10 +134,29 @@ Sym *new_sym_from_decl(Decl *decl)
 }
 
 
+void sym_global_put(Sym *symbol)
+{
+        if (map_get(&global_symbols_map, symbol->name)) {
+                log_error_at(symbol->decl ? symbol->decl->pos : 0,
+                        "%s redeclared", symbol->name);
+                return;
+        }
+        map_put(&global_symbols_map, symbol->name, symbol);
+        buf_push(global_symbols, symbol);
+}
+
+
+void sym_reset_globals(void)
+{
+        buf_free(global_symbols);
+        map_free(&global_symbols_map);
+}
+
+
 Sym *sym_global_type(const char *name, Type *type)
 {
         Sym *symbol = new_sym_type(name, type);
-        buf_push(global_symbols, symbol);
+        sym_global_put(symbol);
         return symbol;
 }
 
@@ -133,68 +168,150 @@ Sym *sym_global_decl(Decl *decl)
         const char **names;
         
         symbol = new_sym_from_decl(decl);
-        buf_push(global_symbols, symbol);
+        sym_global_put(symbol);
         if (decl->kind != DECL_ENUM) {
                 return symbol;
         }
-        num_names = decl->enum_decl.num_names;
-        names = decl->enum_decl.names;
+        num_names = decl->box->num_names;
+        names = decl->box->names;
         
         for (size_t i = 0; i < num_names; i++) {
-                enum_const = new_sym_enum_const(names[i], decl);
-                buf_push(global_symbols, enum_const);
+                enum_const = new_sym_enum_const(names[i], decl, i);
+                sym_global_put(enum_const);
         }
         return symbol;
 }
 
 
-Sym *sym_enter()
+size_t sym_enter(void)
 {
-        return local_sym_stack_top;
+        Scope scope = {num_local_symbols, {0}};
+        
+        buf_push(local_scopes, scope);
+        return buf_len(local_scopes) - 1;
 }
 
 
-void sym_leave(Sym *top)
+void sym_leave(size_t depth)
 {
-        local_sym_stack_top = top;
+        Scope *scope;
+        
+        while (buf__len(local_scopes) > depth) {
+                scope = &buf_pop(local_scopes);
+                num_local_symbols = scope->start;
+                map_free(&scope->index);
+        }
 }
 
 
-void sym_push(const char *name, Type *type)
+Sym *sym_push(const char *name, Type *type)
 {
-        Sym symbol;
+        Scope *scope;
+        Sym *symbol;
+        size_t n;
+        
+        assert(buf__len(local_scopes));
+        if (num_local_symbols == buf__len(local_chunks) * LOCAL_CHUNK_SIZE) {
+                buf_push(local_chunks, malloc(LOCAL_CHUNK_SIZE * sizeof(Sym)));
+        }
+        symbol = local_sym(num_local_symbols);
+        num_local_symbols++;
+        symbol->kind = SYM_VAR;
+        symbol->state = SYM_RESOLVED;
+        symbol->name = name;
+        symbol->decl = NULL;
+        symbol->type = type;
+        symbol->val = 0;
         
-        if (STACK_OVERFLOW()) {
-                fatal_error("Local symbols stack overflow");
+        scope = &buf_top(local_scopes);
+        n = num_local_symbols - scope->start;
+        if (n > LOCAL_INDEX_THRESHOLD) {
+                map_put(&scope->index, name, symbol);
+        } else if (n == LOCAL_INDEX_THRESHOLD) {
+                for (size_t i = scope->start; i < num_local_symbols; i++) {
+                        map_put(&scope->index, local_sym(i)->name, local_sym(i));
+                }
         }
-        symbol.kind = SYM_VAR;
-        symbol.state = SYM_RESOLVED;
-        symbol.name = name;
-        symbol.type = type;
-        PUSH(symbol);
+        return symbol;
 }
 
 
 Sym *sym_get(const char *name)
 {
+        Scope *scope;
         Sym *symbol;
+        size_t end = num_local_symbols;
         
-        for (size_t i = STACK_SIZE(); i > 0; i--) {
-                symbol = local_symbols + i - 1;
-                if (symbol->name == name)
-                        return symbol;
+        for (size_t i = buf__len(local_scopes); i > 0; i--) {
+                scope = local_scopes + i - 1;
+                if (scope->index.len) {
+                        symbol = map_get(&scope->index, name);
+                        if (symbol)
+                                return symbol;
+                } else {
+                        for (size_t j = end; j > scope->start; j--) {
+                                symbol = local_sym(j - 1);
+                                if (symbol->name == name)
+                                        return symbol;
+                        }
+                }
+                end = scope->start;
         }
-        for (size_t i = 0; i < buf_len(global_symbols); i++) {
-                symbol = global_symbols[i];
-                if (symbol->name == name)
-                        return symbol;
+        return map_get(&global_symbols_map, name);
+}
+
+
+// Makes sym_get see only globals until sym_show_locals, for global
+// declarations looked at while in a function.
+Scope *sym_hide_locals(void)
+{
+        Scope *scopes = local_scopes;
+
+        local_scopes = NULL;
+        return scopes;
+}
+
+
+void sym_show_locals(Scope *scopes)
+{
+        assert(local_scopes == NULL);
+        local_scopes = scopes;
+}
+
+
+void sym_test()
+{
+        const char *x = str_intern("x"), *y = str_intern("y");
+        Sym *gx, *sym;
+        size_t depth;
+        char name[32];
+        
+        gx = sym_global_type(x, NULL);
+        assert(sym_get(x) == gx);
+        assert(sym_get(y) == NULL);
+        
+        depth = sym_enter();
+        sym = sym_push(x, NULL);
+        assert(sym_get(x) == sym && sym->kind == SYM_VAR);
+        
+        // enough locals for several chunks and an indexed scope
+        sym_enter();
+        for (int i = 0; i < 4 * LOCAL_CHUNK_SIZE; i++) {
+                sprintf(name, "local%d", i);
+                sym_push(str_intern(name), NULL);
         }
-        return NULL;
+        assert(sym_get(x) == sym);
+        assert(sym_get(str_intern("local7"))->name == str_intern("local7"));
+        assert(sym_get(y) == NULL);
+        assert(sym_push(y, NULL) == sym_get(y));
+        
+        sym_leave(depth);
+        assert(sym_get(x) == gx);
+        assert(sym_get(str_intern("local7")) == NULL);
+        
+        sym_reset_globals();
+        assert(sym_get(x) == NULL);
 }
 
-#undef STACK_OVERFLOW
-#undef STACK_BOUNDARY
-#undef STACK_SIZE
-#undef PUSH
 #endif
 
@@ -0,0 +1,13 @@
+#ifndef MONOTONIC_TIMER
+#define MONOTONIC_TIMER
+
+
+uint64_t nanotime(void)
+{
+        struct timespec ts;
+        
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+#endif
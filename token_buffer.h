@@ -0,0 +1,211 @@
+#ifndef ION_TOKEN_BUFFER
+#define ION_TOKEN_BUFFER
+
+// A whole file lexed up front into parallel arrays, one entry per
+// token.  Names, strings and numbers keep their value in values,
+// payload is its index there, 0 for tokens without one.  The buffer
+// is read only once built, any number of parses can replay it.
+typedef struct TokenBuffer {
+        uint8_t *kinds;
+        SrcPos *positions;
+        uint32_t *payloads;
+        uint64_t *values;
+        const char *text;
+} TokenBuffer;
+
+// the buffer being replayed, NULL when lexing from stream
+_Thread_local TokenBuffer *token_buffer;
+_Thread_local size_t token_pos;
+
+// when set init_lex lexes the whole text first, into a buffer kept
+// per thread and reused
+_Thread_local char use_token_buffer;
+_Thread_local TokenBuffer lex_scratch;
+
+
+static char token_has_value(enum TokenKind kind)
+{
+        return kind == TOKEN_NAME || kind == TOKEN_KEYWORD || kind == TOKEN_INT ||
+                kind == TOKEN_FLOAT || kind == TOKEN_STR;
+}
+
+
+void clear_token_buffer(TokenBuffer *tb)
+{
+        if (tb->kinds == NULL)
+                return;
+        buf_len(tb->kinds) = 0;
+        buf_len(tb->positions) = 0;
+        buf_len(tb->payloads) = 0;
+        buf_len(tb->values) = 0;
+}
+
+
+void free_token_buffer(TokenBuffer *tb)
+{
+        buf_free(tb->kinds);
+        buf_free(tb->positions);
+        buf_free(tb->payloads);
+        buf_free(tb->values);
+}
+
+
+static void token_buffer_fit(TokenBuffer *tb, size_t n)
+{
+        buf__fit(tb->kinds, n);
+        buf__fit(tb->positions, n);
+        buf__fit(tb->payloads, n);
+        buf__fit(tb->values, n);
+}
+
+
+// lexes text up to and including the EOF token
+void fill_token_buffer(TokenBuffer *tb, const char *text)
+{
+        size_t n = 0, num_values = 1, cap, size = strlen(text);
+
+        // about one token per 4 bytes of source, grown as needed
+        clear_token_buffer(tb);
+        token_buffer_fit(tb, size / 4 + 16);
+        tb->values[0] = 0;
+        tb->text = text;
+        token_buffer = NULL;
+        stream = lex_text = text;
+        lex_base = add_src_file(filename, text, size);
+
+        cap = buf_cap(tb->kinds);
+        do {
+                if (n == cap) {
+                        buf_len(tb->kinds) = n;
+                        buf_len(tb->positions) = n;
+                        buf_len(tb->payloads) = n;
+                        buf_len(tb->values) = num_values;
+                        token_buffer_fit(tb, n);
+                        cap = buf_cap(tb->kinds);
+                }
+                lex_token();
+                tb->payloads[n] = 0;
+                if (token_has_value(token.kind)) {
+                        tb->payloads[n] = num_values;
+                        tb->values[num_values++] = token.int_val;
+                }
+                tb->kinds[n] = token.kind;
+                tb->positions[n] = token.pos;
+                n++;
+        } while (token.kind != TOKEN_EOF);
+
+        buf_len(tb->kinds) = n;
+        buf_len(tb->positions) = n;
+        buf_len(tb->payloads) = n;
+        buf_len(tb->values) = num_values;
+}
+
+
+TokenBuffer lex_all(const char *name, const char *text)
+{
+        TokenBuffer tb = {0};
+
+        filename = name;
+        fill_token_buffer(&tb, text);
+        return tb;
+}
+
+
+static void load_token(TokenBuffer *tb, size_t i, struct Token *t)
+{
+        t->kind = tb->kinds[i];
+        t->pos = tb->positions[i];
+        t->int_val = tb->values[tb->payloads[i]];
+        t->keyword = t->kind == TOKEN_KEYWORD ? str_keyword(t->name) : NOT_KEYWORD;
+}
+
+
+// makes tb the token source of this thread, starting from its first token
+void replay_tokens(TokenBuffer *tb, const char *name)
+{
+        filename = name;
+        token_buffer = tb;
+        token_pos = 0;
+        load_token(tb, 0, &token);
+}
+
+
+void next_token()
+{
+        TokenBuffer *tb = token_buffer;
+
+        if (tb == NULL) {
+                lex_token();
+                return;
+        }
+        // stays on the final EOF
+        if (token_pos + 1 < buf_len(tb->kinds))
+                token_pos++;
+        load_token(tb, token_pos, &token);
+}
+
+
+// the token n ahead of the current one, only with a token buffer
+struct Token peek_token(size_t n)
+{
+        TokenBuffer *tb = token_buffer;
+        struct Token t;
+        size_t i;
+
+        assert(tb);
+        i = token_pos + n;
+        if (i >= buf_len(tb->kinds))
+                i = buf_len(tb->kinds) - 1;
+        load_token(tb, i, &t);
+        return t;
+}
+
+
+void start_lex(const char *content)
+{
+        if (use_token_buffer) {
+                fill_token_buffer(&lex_scratch, content);
+                replay_tokens(&lex_scratch, filename);
+                return;
+        }
+        token_buffer = NULL;
+        stream = lex_text = content;
+        lex_base = add_src_file(filename, content, strlen(content));
+        lex_token();
+}
+
+
+void token_buffer_test()
+{
+        TokenBuffer tb;
+        struct Token t;
+
+        tb = lex_all("<token_buffer_test>", "x := foo(1,\n 2.5) \"s\"");
+        assert(buf_len(tb.kinds) == 10);
+        assert(tb.kinds[9] == TOKEN_EOF);
+        assert(tb.positions[3] - tb.positions[2] == 3);
+        assert(src_loc(tb.positions[6]).line == 2 && src_loc(tb.positions[6]).col == 2);
+
+        // two replays of the same buffer see the same tokens
+        for (int i = 0; i < 2; i++) {
+                replay_tokens(&tb, "<token_buffer_test>");
+                assert(token.kind == TOKEN_NAME && token.name == str_intern("x"));
+                t = peek_token(4);
+                assert(t.kind == TOKEN_INT && t.int_val == 1);
+                assert(peek_token(100).kind == TOKEN_EOF);
+                for (int j = 0; j < 6; j++)
+                        next_token();
+                assert(token.kind == TOKEN_FLOAT && token.float_val == 2.5);
+                assert(src_loc(token.pos).line == 2);
+                next_token();
+                next_token();
+                assert(token.kind == TOKEN_STR && strcmp(token.str_val, "s") == 0);
+                next_token();
+                next_token();
+                assert(token.kind == TOKEN_EOF);
+        }
+        token_buffer = NULL;
+        free_token_buffer(&tb);
+}
+
+#endif
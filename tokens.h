@@ -69,16 +69,13 @@ enum TokenKind {
 
 struct Token {
         enum TokenKind kind;
+        enum Keyword keyword;
+        SrcPos pos;
         union {
                 uint64_t int_val;
                 double float_val;
                 const char *str_val;
                 const char *name; // alias for str_val, who cares?
-                
-                struct {
-                        const char *start;
-                        size_t length;
-                };
         };
 };
 
@@ -0,0 +1,198 @@
+#ifndef ION_TRACE
+#define ION_TRACE
+
+// Zones of time recorded as Chrome trace events, viewable in Perfetto
+// or chrome://tracing.  Every thread writes only into its own ring of
+// events, so recording takes no locks.  A thread's ring is allocated on
+// its first event and pushed onto a global list with a compare and
+// swap.  When a ring is full the oldest events are overwritten.
+// write_trace must run after the threads that recorded have been
+// joined.
+//
+//      uint64_t start = trace_begin();
+//      ...
+//      trace_end(start, "zone name", detail);
+//
+// Zone names must be string literals, details NULL or strings that
+// live until write_trace, like interned names.
+
+typedef struct TraceEvent {
+        const char *name;
+        const char *detail;
+        uint64_t start, end;
+} TraceEvent;
+
+enum {
+        TRACE_RING_SIZE = 1 << 18, // events per thread
+};
+
+typedef struct TraceRing {
+        struct TraceRing *next;
+        uint64_t count; // events ever recorded, the ring keeps the last ones
+        int tid;
+        char is_main;
+        TraceEvent events[TRACE_RING_SIZE];
+} TraceRing;
+
+char tracing;
+static TraceRing *trace_rings;
+static int trace_next_tid;
+static _Thread_local TraceRing *trace_ring;
+static uint64_t trace_epoch;
+static pthread_t trace_main_thread;
+
+#define trace_begin() (tracing ? nanotime() : 0)
+
+
+static TraceRing *new_trace_ring(void)
+{
+        TraceRing *ring = calloc(1, sizeof(TraceRing));
+
+        ring->tid = __atomic_fetch_add(&trace_next_tid, 1, __ATOMIC_RELAXED);
+        ring->is_main = pthread_equal(pthread_self(), trace_main_thread);
+        ring->next = __atomic_load_n(&trace_rings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&trace_rings, &ring->next, ring, 1,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+                        ;
+        return ring;
+}
+
+
+void trace_event(const char *name, const char *detail, uint64_t start, uint64_t end)
+{
+        TraceRing *ring = trace_ring;
+        TraceEvent *e;
+
+        if (!tracing)
+                return;
+        if (ring == NULL)
+                ring = trace_ring = new_trace_ring();
+        e = ring->events + (ring->count & (TRACE_RING_SIZE - 1));
+        e->name = name;
+        e->detail = detail;
+        e->start = start;
+        e->end = end;
+        ring->count++;
+}
+
+
+void trace_end(uint64_t start, const char *name, const char *detail)
+{
+        if (tracing)
+                trace_event(name, detail, start, nanotime());
+}
+
+
+void start_tracing(void)
+{
+        trace_epoch = nanotime();
+        trace_main_thread = pthread_self();
+        tracing = 1;
+}
+
+
+static void write_json_str(FILE *out, const char *s)
+{
+        fputc('"', out);
+        for (; *s; s++) {
+                if (*s == '"' || *s == '\\')
+                        fprintf(out, "\\%c", *s);
+                else if ((unsigned char) *s < 0x20)
+                        fprintf(out, "\\u%04x", *s);
+                else    fputc(*s, out);
+        }
+        fputc('"', out);
+}
+
+
+// returns 0 on success, events of all threads are written in the
+// order they ended, which is what trace viewers expect per thread
+int write_trace(const char *path)
+{
+        TraceRing *ring;
+        TraceEvent *e;
+        uint64_t first, dropped = 0;
+        const char *sep = "";
+        FILE *out;
+
+        out = fopen(path, "w");
+        if (out == NULL) {
+                perror(path);
+                return -1;
+        }
+        fprintf(out, "{\"traceEvents\":[\n");
+        for (ring = trace_rings; ring; ring = ring->next) {
+                fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                        "\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+                        sep, ring->tid, ring->is_main ? "main" : "worker", ring->tid);
+                sep = ",\n";
+                first = 0;
+                if (ring->count > TRACE_RING_SIZE) {
+                        first = ring->count - TRACE_RING_SIZE;
+                        dropped += first;
+                }
+                for (uint64_t i = first; i < ring->count; i++) {
+                        e = ring->events + (i & (TRACE_RING_SIZE - 1));
+                        fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                                "\"ts\":%.3f,\"dur\":%.3f", sep, e->name, ring->tid,
+                                (e->start - trace_epoch) / 1e3, (e->end - e->start) / 1e3);
+                        if (e->detail) {
+                                fprintf(out, ",\"args\":{\"detail\":");
+                                write_json_str(out, e->detail);
+                                fputc('}', out);
+                        }
+                        fputc('}', out);
+                }
+        }
+        fprintf(out, "\n],\"displayTimeUnit\":\"ms\"}\n");
+        if (dropped)
+                fprintf(stderr, "trace: %llu oldest events dropped\n",
+                        (unsigned long long) dropped);
+        return fclose(out) == 0 ? 0 : -1;
+}
+
+
+void free_trace(void)
+{
+        TraceRing *ring, *next;
+
+        for (ring = trace_rings; ring; ring = next) {
+                next = ring->next;
+                free(ring);
+        }
+        trace_rings = NULL;
+        trace_ring = NULL;
+        trace_next_tid = 0;
+        tracing = 0;
+}
+
+
+static void trace_test_job(void *ctx, size_t i)
+{
+        uint64_t start = trace_begin();
+
+        (void) ctx;
+        trace_end(start, "trace_test", i % 2 ? "odd \"one\"" : NULL);
+}
+
+
+void trace_test()
+{
+        size_t events = 0;
+
+        // not recording unless started
+        trace_end(trace_begin(), "trace_test", NULL);
+        assert(trace_rings == NULL);
+
+        start_tracing();
+        run_jobs(trace_test_job, NULL, 64, 4);
+        for (TraceRing *ring = trace_rings; ring; ring = ring->next) {
+                for (uint64_t i = 0; i < ring->count; i++)
+                        assert(ring->events[i].end >= ring->events[i].start);
+                events += ring->count;
+        }
+        assert(events == 64);
+        free_trace();
+}
+
+#endif
@@ -26,8 +26,9 @@ struct Type {
         enum TypeKind kind;
         size_t size;
         size_t align;
+        char is_unsigned; // of integer types
+        Sym *symbol; // of named types, kept when a struct is completed
         union {
-                Sym *symbol;
                 Type *elem;
                 
                 struct {
@@ -38,7 +39,9 @@ struct Type {
                 struct {
                         const char **fields;
                         Type **types;
+                        size_t *offsets;
                         size_t num_fields;
+                        Map index; // name -> index + 1, for many fields
                 } bucket;
                 
                 struct {
@@ -52,10 +55,20 @@ struct Type {
 
 const size_t PTR_SIZE = 8;
 const size_t PTR_ALIGN = 8;
+const size_t NO_FIELD = -1;
 
-Type **cached_ptr_types; // The whole idea about caching types
-Type **cached_array_types; // is to compare types by pointers
-Type **cached_function_types;
+enum {
+        FIELD_INDEX_THRESHOLD = 16
+};
+
+// The whole idea about caching types is to compare types by pointers.
+// Pointer types are keyed by their element, array and function types by
+// a hash of their components, mapping to a stretchy buffer of candidates.
+Map cached_ptr_types;
+Map cached_array_types;
+Map cached_function_types;
+
+#define type_cache_key(h) ((h) ? (h) : 1)
 
 
 void *type_alloc(size_t size)
@@ -97,16 +110,72 @@ Type *new_array(Type *type, size_t length)
 }
 
 
-Type *new_bucket(const char **fields, Type **types, size_t num_fields)
+// Lays out a struct or union the way C does: fields at offsets aligned
+// for them, in order for structs and all at 0 for unions, the size
+// rounded up to the largest alignment.  Field types must be complete.
+// Offsets are kept in a stretchy buffer, buckets with many fields get
+// an index by name.
+void set_bucket(Type *b, enum TypeKind kind, const char **fields, Type **types,
+        size_t num_fields)
 {
-        Type *b = type_alloc(sizeof(Type));
+        size_t offset = 0, size = 0, align = 1, *offsets = NULL;
+        Type *field;
+
+        assert(kind == TYPE_STRUCT || kind == TYPE_UNION);
+        buf__fit(offsets, num_fields);
+        for (size_t i = 0; i < num_fields; i++) {
+                field = types[i];
+                if (field->align > align)
+                        align = field->align;
+                if (kind == TYPE_STRUCT) {
+                        offset = ALIGN_UP(offset, field->align ? field->align : 1);
+                        buf_push(offsets, offset);
+                        offset += field->size;
+                        size = offset;
+                } else {
+                        buf_push(offsets, 0);
+                        if (field->size > size)
+                                size = field->size;
+                }
+        }
+        b->kind = kind;
+        b->size = ALIGN_UP(size, align);
+        b->align = align;
         b->bucket.fields = fields;
         b->bucket.types = types;
+        b->bucket.offsets = offsets;
         b->bucket.num_fields = num_fields;
+        b->bucket.index = (Map) {0};
+        if (num_fields < FIELD_INDEX_THRESHOLD)
+                return;
+        // the first of fields named alike wins, as with the linear search
+        for (size_t i = num_fields; i > 0; i--)
+                map_put(&b->bucket.index, fields[i - 1], (void *) (uintptr_t) i);
+}
+
+
+Type *new_bucket(enum TypeKind kind, const char **fields, Type **types,
+        size_t num_fields)
+{
+        Type *b = type_alloc(sizeof(Type));
+        set_bucket(b, kind, fields, types, num_fields);
         return b;
 }
 
 
+// index of the field with the interned name, NO_FIELD if there is none
+size_t field_index(Type *b, const char *name)
+{
+        if (b->bucket.index.len)
+                return (uintptr_t) map_get(&b->bucket.index, name) - 1;
+        for (size_t i = 0; i < b->bucket.num_fields; i++) {
+                if (b->bucket.fields[i] == name)
+                        return i;
+        }
+        return NO_FIELD;
+}
+
+
 Type *new_func(Type **args, size_t num_args, Type *ret)
 {
         Type *f = new_type(TYPE_FUNC, PTR_SIZE, PTR_ALIGN);
@@ -127,58 +196,120 @@ Type *type_incomplete(Sym *symbol)
 
 Type *type_ptr(Type *elem)
 {
-        Type *cached, *type;
+        Type *type = map_get(&cached_ptr_types, elem);
         
-        for (size_t i = 0; i < buf_len(cached_ptr_types); i++) {
-                cached = cached_ptr_types[i];
-                if (cached->elem == elem)
-                        return cached;
-        }
+        if (type)
+                return type;
         type = new_ptr(elem);
-        buf_push(cached_ptr_types, type);
+        map_put(&cached_ptr_types, elem, type);
         return type;
 }
 
 
 Type *type_array(Type *type, size_t length)
 {
-        Type *cached;
+        Type **bucket, *cached;
+        uint64_t key;
         
-        for (size_t i = 0; i < buf_len(cached_array_types); i++) {
-                cached = cached_array_types[i];
+        key = type_cache_key(hash_mix(hash_ptr(type), length));
+        bucket = map_get_uint64(&cached_array_types, key);
+        
+        for (size_t i = 0; i < buf__len(bucket); i++) {
+                cached = bucket[i];
                 if (    cached->array.type == type &&
                         cached->array.length == length) {
                                 return cached;
                 }
         }
         type = new_array(type, length);
-        buf_push(cached_array_types, type);
+        buf_push(bucket, type);
+        map_put_uint64(&cached_array_types, key, bucket);
         return type;
 }
 
 
 Type *type_func(Type **args, size_t num_args, Type *ret)
 {
-        Type *cached, *type;
+        Type **bucket, *cached, *type;
+        uint64_t key;
+        
+        key = hash_mix(hash_ptr(ret), num_args);
+        for (size_t i = 0; i < num_args; i++) {
+                key = hash_mix(key, (uintptr_t) args[i]);
+        }
+        key = type_cache_key(key);
+        bucket = map_get_uint64(&cached_function_types, key);
         
-        for (size_t i = 0; i < buf_len(cached_function_types); i++) {
-                char match = TRUE;
-                cached = cached_function_types[i];
+        for (size_t i = 0; i < buf__len(bucket); i++) {
+                cached = bucket[i];
                 if (    cached->func.num_args != num_args ||
                         cached->func.ret != ret) continue;
-                for (size_t j = 0; j < num_args; j++) {
-                        if (cached->func.args[j] != args[j]) {
-                                match = FALSE;
-                                break;
-                        }
-                }
-                if (match)
-                        return cached;
+                if (num_args == 0 ||
+                        memcmp(cached->func.args, args, num_args * sizeof(Type *)) == 0)
+                                return cached;
         }
         type = new_func(args, num_args, ret);
-        buf_push(cached_function_types, type);
+        buf_push(bucket, type);
+        map_put_uint64(&cached_function_types, key, bucket);
         return type;
 }
 
+
+static void bucket_test(Type *int_type, Type *char_type)
+{
+        const char *names[] = {str_intern("c"), str_intern("i"), str_intern("d")};
+        Type *types[] = {char_type, int_type, char_type}, *b, *many[40];
+        const char *fields[40];
+        char name[16];
+        
+        b = new_bucket(TYPE_STRUCT, names, types, 3);
+        assert(b->size == 12 && b->align == 4);
+        assert(b->bucket.offsets[1] == 4 && b->bucket.offsets[2] == 8);
+        assert(field_index(b, names[2]) == 2);
+        assert(field_index(b, str_intern("x")) == NO_FIELD);
+        
+        b = new_bucket(TYPE_UNION, names, types, 3);
+        assert(b->size == 4 && b->bucket.offsets[1] == 0);
+        
+        b = new_bucket(TYPE_STRUCT, NULL, NULL, 0);
+        assert(b->size == 0 && b->align == 1);
+        
+        for (int i = 0; i < 40; i++) {
+                sprintf(name, "f%d", i % 39);
+                fields[i] = str_intern(name);
+                many[i] = i % 2 ? int_type : type_ptr(char_type);
+        }
+        b = new_bucket(TYPE_STRUCT, fields, many, 40);
+        assert(b->bucket.index.len && b->size == 20 * 8 + 20 * 4 + 20 * 4);
+        assert(field_index(b, str_intern("f7")) == 7);
+        assert(field_index(b, str_intern("f0")) == 0);
+        assert(field_index(b, str_intern("f39")) == NO_FIELD);
+        assert(b->bucket.offsets[39] == b->size - 8);
+}
+
+
+void type_test()
+{
+        Type *int_type = new_type(TYPE_INT, 4, 4);
+        Type *char_type = new_type(TYPE_CHAR, 1, 1);
+        Type *args[] = {int_type, char_type};
+        Type *other[] = {char_type, int_type};
+        
+        assert(type_ptr(int_type) == type_ptr(int_type));
+        assert(type_ptr(int_type) != type_ptr(char_type));
+        assert(type_ptr(type_ptr(int_type))->elem == type_ptr(int_type));
+        
+        assert(type_array(int_type, 16) == type_array(int_type, 16));
+        assert(type_array(int_type, 16) != type_array(int_type, 17));
+        assert(type_array(int_type, 16)->size == 64);
+        
+        assert(type_func(args, 2, int_type) == type_func(args, 2, int_type));
+        assert(type_func(args, 2, int_type) != type_func(other, 2, int_type));
+        assert(type_func(args, 1, int_type) != type_func(args, 2, int_type));
+        assert(type_func(args, 2, NULL) != type_func(args, 2, int_type));
+        
+        bucket_test(int_type, char_type);
+}
+
 #endif
 
@@ -0,0 +1,561 @@
+#ifndef X64_ENCODER
+#define X64_ENCODER
+
+// A small x86-64 instruction encoder appending to x64_code, a stretchy
+// buffer.  Only the forms the code generator needs are here: register
+// to register, register and memory at [base + disp], immediates and
+// rel32 jumps and calls.  Jumps to labels not yet known return the
+// offset of their rel32, which x64_patch points at the label later.
+//
+// Sizes are operand sizes in bytes, 1, 2, 4 or 8.  32-bit operations
+// clear the upper half of their destination, as the hardware does.
+
+enum Reg {
+        RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+        R8, R9, R10, R11, R12, R13, R14, R15,
+};
+
+// xmm registers are numbered alike
+enum {
+        XMM0, XMM1, XMM2,
+};
+
+// condition codes, the low nibble of jcc and setcc
+enum Cond {
+        CC_O, CC_NO, CC_B, CC_AE, CC_E, CC_NE, CC_BE, CC_A,
+        CC_S, CC_NS, CC_P, CC_NP, CC_L, CC_GE, CC_LE, CC_G,
+};
+
+#define cc_not(cc) ((cc) ^ 1)
+
+// the /digit of the 0x81 group, also opcode >> 3 of its reg, r/m form
+enum AluOp {
+        ALU_ADD = 0,
+        ALU_OR = 1,
+        ALU_AND = 4,
+        ALU_SUB = 5,
+        ALU_XOR = 6,
+        ALU_CMP = 7,
+};
+
+// the /digit of the shift groups
+enum ShiftOp {
+        SHIFT_SHL = 4,
+        SHIFT_SHR = 5,
+        SHIFT_SAR = 7,
+};
+
+// low byte of the scalar SSE opcodes, 0x0f prefixed
+enum SseOp {
+        SSE_ADD = 0x58,
+        SSE_MUL = 0x59,
+        SSE_SUB = 0x5c,
+        SSE_DIV = 0x5e,
+};
+
+uint8_t *x64_code;
+
+#define x64_pos() buf__len(x64_code)
+#define fits_int8(v) ((v) >= INT8_MIN && (v) <= INT8_MAX)
+#define fits_int32(v) ((v) >= INT32_MIN && (v) <= INT32_MAX)
+
+
+static void x64_u8(unsigned byte)
+{
+        buf_push(x64_code, byte);
+}
+
+
+static void x64_u32(uint32_t v)
+{
+        buf__fit(x64_code, 4);
+        memcpy(x64_code + buf_len(x64_code), &v, 4);
+        buf_len(x64_code) += 4;
+}
+
+
+static void x64_u64(uint64_t v)
+{
+        buf__fit(x64_code, 8);
+        memcpy(x64_code + buf_len(x64_code), &v, 8);
+        buf_len(x64_code) += 8;
+}
+
+
+// Emits [prefix] [REX] opcode ModRM [SIB] [disp] where ModRM names reg
+// and either register rm or, if is_mem, memory at [rm + disp].  The
+// opcode is one to three bytes, most significant first, the prefix is
+// 0x66, 0xf2 or 0xf3 of SSE forms, 0x66 is added for size 2.
+static void x64_modrm(int prefix, int size, uint32_t op, int reg, int rm,
+        char is_mem, int32_t disp)
+{
+        int rex = 0x40 | (size == 8) << 3 | (reg & 8) >> 1 | (rm & 8) >> 3;
+        int mod = 3;
+
+        if (size == 2)
+                x64_u8(0x66);
+        if (prefix)
+                x64_u8(prefix);
+        // without a REX, byte registers 4 to 7 are ah, ch, dh and bh
+        if (rex != 0x40 || (size == 1 && (reg >= RSP || (!is_mem && rm >= RSP))))
+                x64_u8(rex);
+        if (op > 0xffff)
+                x64_u8(op >> 16);
+        if (op > 0xff)
+                x64_u8(op >> 8);
+        x64_u8(op);
+        if (is_mem) {
+                if (disp == 0 && (rm & 7) != RBP)
+                        mod = 0;
+                else if (fits_int8(disp))
+                        mod = 1;
+                else    mod = 2;
+        }
+        x64_u8(mod << 6 | (reg & 7) << 3 | (rm & 7));
+        if (is_mem && (rm & 7) == RSP)
+                x64_u8(0x24); // SIB of [rsp]
+        if (mod == 1)
+                x64_u8(disp);
+        else if (mod == 2)
+                x64_u32(disp);
+}
+
+#define x64_rr(size, op, reg, rm) x64_modrm(0, size, op, reg, rm, 0, 0)
+#define x64_rm(size, op, reg, base, disp) x64_modrm(0, size, op, reg, base, 1, disp)
+
+
+void x64_mov_rr(int size, int dst, int src)
+{
+        x64_rr(size, size == 1 ? 0x88 : 0x89, src, dst);
+}
+
+
+void x64_mov_ri(int dst, int64_t imm)
+{
+        if (imm >= 0 && imm <= UINT32_MAX) {
+                if (dst >= R8)
+                        x64_u8(0x41);
+                x64_u8(0xb8 + (dst & 7));
+                x64_u32(imm);
+        } else if (fits_int32(imm)) {
+                x64_rr(8, 0xc7, 0, dst);
+                x64_u32(imm);
+        } else {
+                x64_u8(0x48 | (dst & 8) >> 3);
+                x64_u8(0xb8 + (dst & 7));
+                x64_u64(imm);
+        }
+}
+
+
+// Loads of 1 and 2 bytes are extended to 32 bits, the width integers
+// are computed at, of 4 and 8 bytes are plain moves.
+void x64_load(int size, char is_unsigned, int dst, int base, int32_t disp)
+{
+        switch (size) {
+        case 1:
+                x64_rm(4, is_unsigned ? 0x0fb6 : 0x0fbe, dst, base, disp);
+                break;
+        case 2:
+                x64_rm(4, is_unsigned ? 0x0fb7 : 0x0fbf, dst, base, disp);
+                break;
+        default:
+                x64_rm(size, 0x8b, dst, base, disp);
+        }
+}
+
+
+void x64_store(int size, int src, int base, int32_t disp)
+{
+        x64_rm(size, size == 1 ? 0x88 : 0x89, src, base, disp);
+}
+
+
+void x64_lea(int dst, int base, int32_t disp)
+{
+        x64_rm(8, 0x8d, dst, base, disp);
+}
+
+
+// lea dst, [rip + rel32], returns where the rel32 is to be patched
+size_t x64_lea_rip(int dst)
+{
+        x64_u8(0x48 | (dst & 8) >> 1);
+        x64_u8(0x8d);
+        x64_u8((dst & 7) << 3 | 5);
+        x64_u32(0);
+        return x64_pos() - 4;
+}
+
+
+// Extends the low from_size bytes of src into dst, to 8 bytes if
+// to_size is 8 and to 4 otherwise.
+void x64_extend(int to_size, int from_size, char is_unsigned, int dst, int src)
+{
+        int size = to_size == 8 ? 8 : 4;
+
+        switch (from_size) {
+        case 1:
+                assert(src < RSP || src >= R8); // spl to dil would need a REX
+                x64_rr(size, is_unsigned ? 0x0fb6 : 0x0fbe, dst, src);
+                break;
+        case 2:
+                x64_rr(size, is_unsigned ? 0x0fb7 : 0x0fbf, dst, src);
+                break;
+        case 4:
+                if (is_unsigned || size == 4)
+                        x64_mov_rr(4, dst, src);
+                else    x64_rr(8, 0x63, dst, src); // movsxd
+                break;
+        default:
+                if (dst != src)
+                        x64_mov_rr(8, dst, src);
+        }
+}
+
+
+void x64_alu_rr(enum AluOp op, int size, int dst, int src)
+{
+        x64_rr(size, op << 3 | (size == 1 ? 0 : 1), src, dst);
+}
+
+
+void x64_alu_ri(enum AluOp op, int size, int dst, int32_t imm)
+{
+        if (fits_int8(imm)) {
+                x64_rr(size, 0x83, op, dst);
+                x64_u8(imm);
+        } else {
+                x64_rr(size, 0x81, op, dst);
+                x64_u32(imm);
+        }
+}
+
+
+void x64_test_rr(int size, int a, int b)
+{
+        x64_rr(size, 0x85, b, a);
+}
+
+
+void x64_imul_rr(int size, int dst, int src)
+{
+        x64_rr(size, 0x0faf, dst, src);
+}
+
+
+void x64_imul_ri(int size, int dst, int src, int32_t imm)
+{
+        if (fits_int8(imm)) {
+                x64_rr(size, 0x6b, dst, src);
+                x64_u8(imm);
+        } else {
+                x64_rr(size, 0x69, dst, src);
+                x64_u32(imm);
+        }
+}
+
+
+// rdx:rax divided by src, the quotient in rax and the remainder in rdx
+void x64_div(int size, char is_unsigned, int src)
+{
+        if (is_unsigned) {
+                x64_alu_rr(ALU_XOR, 4, RDX, RDX);
+                x64_rr(size, 0xf7, 6, src);
+        } else {
+                if (size == 8)
+                        x64_u8(0x48);
+                x64_u8(0x99); // cdq or cqo
+                x64_rr(size, 0xf7, 7, src);
+        }
+}
+
+
+void x64_shift_cl(enum ShiftOp op, int size, int dst)
+{
+        x64_rr(size, 0xd3, op, dst);
+}
+
+
+void x64_shift_ri(enum ShiftOp op, int size, int dst, uint8_t count)
+{
+        x64_rr(size, 0xc1, op, dst);
+        x64_u8(count);
+}
+
+
+void x64_neg(int size, int dst)
+{
+        x64_rr(size, 0xf7, 3, dst);
+}
+
+
+void x64_not(int size, int dst)
+{
+        x64_rr(size, 0xf7, 2, dst);
+}
+
+
+// dst = cc ? 1 : 0
+void x64_setcc(enum Cond cc, int dst)
+{
+        x64_rr(1, 0x0f90 | cc, 0, dst);
+        x64_extend(4, 1, 1, dst, dst);
+}
+
+
+void x64_push(int reg)
+{
+        if (reg >= R8)
+                x64_u8(0x41);
+        x64_u8(0x50 + (reg & 7));
+}
+
+
+void x64_pop(int reg)
+{
+        if (reg >= R8)
+                x64_u8(0x41);
+        x64_u8(0x58 + (reg & 7));
+}
+
+
+// copies rcx bytes from [rsi] to [rdi]
+void x64_rep_movsb(void)
+{
+        x64_u8(0xf3);
+        x64_u8(0xa4);
+}
+
+
+void x64_ret(void)
+{
+        x64_u8(0xc3);
+}
+
+
+void x64_leave(void)
+{
+        x64_u8(0xc9);
+}
+
+
+// Jumps and calls to a known target take it, to a later one take 0 and
+// return the offset of their rel32 for x64_patch.  Code starts with a
+// function prologue, so 0 is never a target.
+void x64_patch(size_t at, size_t target)
+{
+        int32_t rel = target - (at + 4);
+
+        memcpy(x64_code + at, &rel, 4);
+}
+
+
+size_t x64_jmp(size_t target)
+{
+        int64_t rel = (int64_t) target - (int64_t) (x64_pos() + 2);
+
+        if (target && fits_int8(rel)) {
+                x64_u8(0xeb);
+                x64_u8(rel);
+                return 0;
+        }
+        x64_u8(0xe9);
+        x64_u32(0);
+        x64_patch(x64_pos() - 4, target ? target : x64_pos());
+        return x64_pos() - 4;
+}
+
+
+size_t x64_jcc(enum Cond cc, size_t target)
+{
+        int64_t rel = (int64_t) target - (int64_t) (x64_pos() + 2);
+
+        if (target && fits_int8(rel)) {
+                x64_u8(0x70 | cc);
+                x64_u8(rel);
+                return 0;
+        }
+        x64_u8(0x0f);
+        x64_u8(0x80 | cc);
+        x64_u32(0);
+        x64_patch(x64_pos() - 4, target ? target : x64_pos());
+        return x64_pos() - 4;
+}
+
+
+size_t x64_call(size_t target)
+{
+        x64_u8(0xe8);
+        x64_u32(0);
+        x64_patch(x64_pos() - 4, target ? target : x64_pos());
+        return x64_pos() - 4;
+}
+
+
+void x64_call_r(int reg)
+{
+        x64_rr(4, 0xff, 2, reg);
+}
+
+
+// Scalar SSE, size 8 for double and 4 for float.  sse_op is one of
+// SseOp, or 0x10 to load and 0x11 to store with x64_sse_rm.
+void x64_sse_rr(int size, int op, int dst, int src)
+{
+        x64_modrm(size == 8 ? 0xf2 : 0xf3, 4, 0x0f00 | op, dst, src, 0, 0);
+}
+
+
+void x64_sse_rm(int size, int op, int reg, int base, int32_t disp)
+{
+        x64_modrm(size == 8 ? 0xf2 : 0xf3, 4, 0x0f00 | op, reg, base, 1, disp);
+}
+
+#define x64_sse_load(size, dst, base, disp) x64_sse_rm(size, 0x10, dst, base, disp)
+#define x64_sse_store(size, src, base, disp) x64_sse_rm(size, 0x11, src, base, disp)
+
+
+// compares a with b setting the flags as an unsigned compare, with the
+// parity flag set for NaN
+void x64_ucomis(int size, int a, int b)
+{
+        x64_modrm(size == 8 ? 0x66 : 0, 4, 0x0f2e, a, b, 0, 0);
+}
+
+
+// between float sizes
+void x64_cvt_float(int to_size, int dst, int src)
+{
+        x64_modrm(to_size == 8 ? 0xf3 : 0xf2, 4, 0x0f5a, dst, src, 0, 0);
+}
+
+
+// from an integer of int_size bytes, 4 or 8
+void x64_cvt_from_int(int size, int int_size, int dst, int src)
+{
+        x64_modrm(size == 8 ? 0xf2 : 0xf3, int_size, 0x0f2a, dst, src, 0, 0);
+}
+
+
+// to an integer of int_size bytes, 4 or 8, truncating
+void x64_cvt_to_int(int size, int int_size, int dst, int src)
+{
+        x64_modrm(size == 8 ? 0xf2 : 0xf3, int_size, 0x0f2c, dst, src, 0, 0);
+}
+
+
+// the bits of a general register to an xmm register and back
+void x64_movq_to_xmm(int xmm, int reg)
+{
+        x64_modrm(0x66, 8, 0x0f6e, xmm, reg, 0, 0);
+}
+
+
+void x64_movq_from_xmm(int reg, int xmm)
+{
+        x64_modrm(0x66, 8, 0x0f7e, xmm, reg, 0, 0);
+}
+
+
+void x64_movaps(int dst, int src)
+{
+        x64_modrm(0, 4, 0x0f28, dst, src, 0, 0);
+}
+
+
+void x64_xorps(int dst, int src)
+{
+        x64_modrm(0, 4, 0x0f57, dst, src, 0, 0);
+}
+
+
+// Checks encodings against the bytes an assembler emits for them.
+#define x64_expect(...) do {                                            \
+        uint8_t expected[] = {__VA_ARGS__};                             \
+        assert(buf__len(x64_code) == sizeof(expected));                 \
+        assert(memcmp(x64_code, expected, sizeof(expected)) == 0);      \
+        buf_len(x64_code) = 0;                                          \
+} while (0)
+
+void x64_test()
+{
+        uint8_t *saved = x64_code;
+
+        x64_code = NULL;
+        buf_init(x64_code);
+        x64_mov_rr(8, RAX, RCX);
+        x64_expect(0x48, 0x89, 0xc8);
+        x64_mov_rr(4, R11, RAX);
+        x64_expect(0x41, 0x89, 0xc3);
+        x64_mov_ri(RAX, 1);
+        x64_expect(0xb8, 1, 0, 0, 0);
+        x64_mov_ri(RCX, -1);
+        x64_expect(0x48, 0xc7, 0xc1, 0xff, 0xff, 0xff, 0xff);
+        x64_mov_ri(RDX, 0x123456789);
+        x64_expect(0x48, 0xba, 0x89, 0x67, 0x45, 0x23, 1, 0, 0, 0);
+
+        x64_load(8, 0, RAX, RBP, -8);
+        x64_expect(0x48, 0x8b, 0x45, 0xf8);
+        x64_load(1, 0, RAX, RSP, 0);
+        x64_expect(0x0f, 0xbe, 0x04, 0x24);
+        x64_load(2, 1, RCX, RSI, 0x100);
+        x64_expect(0x0f, 0xb7, 0x8e, 0, 1, 0, 0);
+        x64_load(4, 0, RAX, R13, 0);
+        x64_expect(0x41, 0x8b, 0x45, 0);
+        x64_store(1, RSI, RAX, 0);
+        x64_expect(0x40, 0x88, 0x30);
+        x64_store(2, RCX, RDX, 4);
+        x64_expect(0x66, 0x89, 0x4a, 4);
+        x64_lea(RAX, RBP, -16);
+        x64_expect(0x48, 0x8d, 0x45, 0xf0);
+        x64_extend(8, 4, 0, RAX, RAX);
+        x64_expect(0x48, 0x63, 0xc0);
+        x64_extend(4, 1, 1, RAX, RAX);
+        x64_expect(0x0f, 0xb6, 0xc0);
+
+        x64_alu_rr(ALU_SUB, 8, RAX, RCX);
+        x64_expect(0x48, 0x29, 0xc8);
+        x64_alu_ri(ALU_CMP, 4, RAX, 1000);
+        x64_expect(0x81, 0xf8, 0xe8, 3, 0, 0);
+        x64_alu_ri(ALU_ADD, 8, RSP, 8);
+        x64_expect(0x48, 0x83, 0xc4, 8);
+        x64_imul_rr(4, RAX, RCX);
+        x64_expect(0x0f, 0xaf, 0xc1);
+        x64_div(8, 0, RCX);
+        x64_expect(0x48, 0x99, 0x48, 0xf7, 0xf9);
+        x64_shift_cl(SHIFT_SAR, 4, RAX);
+        x64_expect(0xd3, 0xf8);
+        x64_setcc(CC_L, RAX);
+        x64_expect(0x0f, 0x9c, 0xc0, 0x0f, 0xb6, 0xc0);
+        x64_push(RBP);
+        x64_pop(R11);
+        x64_call_r(R11);
+        x64_expect(0x55, 0x41, 0x5b, 0x41, 0xff, 0xd3);
+
+        x64_sse_rr(8, SSE_ADD, XMM0, XMM1);
+        x64_expect(0xf2, 0x0f, 0x58, 0xc1);
+        x64_sse_load(4, XMM0, RBP, -4);
+        x64_expect(0xf3, 0x0f, 0x10, 0x45, 0xfc);
+        x64_cvt_from_int(8, 8, XMM0, RAX);
+        x64_expect(0xf2, 0x48, 0x0f, 0x2a, 0xc0);
+        x64_cvt_to_int(8, 4, RAX, XMM0);
+        x64_expect(0xf2, 0x0f, 0x2c, 0xc0);
+        x64_ucomis(8, XMM0, XMM1);
+        x64_expect(0x66, 0x0f, 0x2e, 0xc1);
+        x64_movq_to_xmm(XMM1, RAX);
+        x64_expect(0x66, 0x48, 0x0f, 0x6e, 0xc8);
+
+        // a backward jump is short, a forward one is patched
+        x64_u8(0x90);
+        x64_jmp(1);
+        x64_patch(x64_jcc(CC_E, 0), 13);
+        x64_expect(0x90, 0xeb, 0xfe, 0x0f, 0x84, 4, 0, 0, 0);
+
+        buf_free(x64_code);
+        x64_code = saved;
+}
+
+#undef x64_expect
+
+#endif